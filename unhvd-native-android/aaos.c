@@ -1,76 +1,312 @@
 #include "aaos.h"
 
 #include <malloc.h>
+#include <string.h> //memcpy
+#include <stdatomic.h>
+
+#ifdef __ANDROID__
 #include <aaudio/AAudio.h>
 
 #include <android/log.h>
 #define LOGV(...) ((void)__android_log_print(ANDROID_LOG_VERBOSE, "unhvd_native_android", __VA_ARGS__))
 #define LOGI(...) ((void)__android_log_print(ANDROID_LOG_INFO, "unhvd_native_android", __VA_ARGS__))
 #define LOGE(...) ((void)__android_log_print(ANDROID_LOG_ERROR, "unhvd_native_android", __VA_ARGS__))
+#else
+// null/file backend standing in for AAudio on hosts without it
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#define LOGV(...) ((void)0)
+#define LOGI(...) ((void)(fprintf(stderr, __VA_ARGS__), fputc('\n', stderr)))
+#define LOGE(...) ((void)(fprintf(stderr, __VA_ARGS__), fputc('\n', stderr)))
+#endif
+
+enum aaos_constants
+{
+	AAOS_DEFAULT_SAMPLE_RATE = 24000,
+	AAOS_DEFAULT_TARGET_MS = 60,
+	AAOS_DEFAULT_CAPACITY_MS = 500,
+	AAOS_TARGET_UP_MS = 20, // target growth after underrun
+	AAOS_TARGET_DOWN_MS = 10, // target decrease after stable period
+	AAOS_STABLE_MS = 5000, // period without underrun to decrease target
+	AAOS_MAX_DRIFT_PPM = 5000, // playback rate correction limit
+	AAOS_BURST_MS = 10, // host backend callback period
+	AAOS_PLC_HISTORY_MS = 30, // audio kept for concealment
+	AAOS_PLC_WINDOW_MS = 10, // pitch estimation window at the end of history
+	AAOS_PLC_MIN_PERIOD_US = 2500, // pitch period search range (400 Hz - 67 Hz)
+	AAOS_PLC_MAX_PERIOD_MS = 15,
+	AAOS_PLC_FADE_MS = 60, // concealment fades out to silence
+	AAOS_PLC_CROSSFADE_MS = 5, // concealment to audio transition
+	AAOS_PLC_MAX_GAP_MS = 250, // longer timestamp gaps are discontinuities, not losses
+};
+
+// packet loss concealment state
+struct aaos_plc
+{
+	int16_t* history; // last frames of real audio, oldest first
+	int32_t frames; // history size
+	int heard; // history holds real audio
+	int32_t period; // repeated pitch period in frames, 0 when not concealing
+	int32_t position; // frames concealed so far
+};
 
 struct aaos
 {
+#ifdef __ANDROID__
 	AAudioStream* stream;
+#else
+	pthread_t thread;
+	int thread_started;
+	atomic_int stop;
+	FILE* file;
+#endif
+	int32_t sample_rate;
+	int32_t channels;
+
+	// lock-free single producer (aaos_write) single consumer (callback) ring of frames
+	int16_t* ring;
+	uint32_t mask; // capacity in frames - 1 (power of two)
+	atomic_uint head; // written by producer
+	atomic_uint tail; // written by consumer
+
+	// jitter buffer state owned by consumer
+	int32_t min_target; // frames
+	int32_t max_target;
+	int32_t stable; // frames played since last underrun or target change
+	int priming; // silence until target depth is buffered
+	float level; // smoothed buffered frames
+	float phase; // fractional position between tail and the next frame
+
+	// concealment of chunks lost in transit (producer) and of underruns (consumer)
+	struct aaos_plc writer_plc;
+	struct aaos_plc reader_plc;
+	int16_t* scratch; // producer concealment and crossfade buffer of AAOS_PLC_CROSSFADE_MS
+	int32_t scratch_frames;
+	int64_t next_timestamp; // expected sender timestamp of next write, 0 before the first
+	atomic_int delay; // minimal target from aaos_set_delay
+
+	// statistics
+	atomic_int concealed;
+	atomic_int target;
+	atomic_int ratio_ppm;
+	atomic_int underruns;
+	atomic_int overruns;
+	atomic_int dropped;
 };
 
 static struct aaos* aaos_close_and_return_null(struct aaos* a, const char* msg);
+static void aaos_render(struct aaos* a, int16_t* out, int32_t frames);
+static uint32_t aaos_push(struct aaos* a, const int16_t* buffer, uint32_t frames);
+static int aaos_plc_init(struct aaos* a, struct aaos_plc* p);
+static void aaos_plc_remember(struct aaos* a, struct aaos_plc* p, const int16_t* in, int32_t frames);
+static int32_t aaos_plc_conceal(struct aaos* a, struct aaos_plc* p, int16_t* out, int32_t frames);
+static void aaos_plc_resume(struct aaos* a, struct aaos_plc* p, int16_t* inout, int32_t frames);
+
+#ifdef __ANDROID__
+static aaudio_data_callback_result_t aaos_data_callback(AAudioStream* stream, void* user, void* data, int32_t frames);
+static void aaos_error_callback(AAudioStream* stream, void* user, aaudio_result_t error);
+static int aaos_open(struct aaos* a);
+#else
+static void* aaos_host_thread(void* user);
+static int aaos_open(struct aaos* a, const char* file);
+#endif
 
 struct aaos* aaos_init()
+{
+	struct aaos_config config = { 0 };
+	return aaos_init_config(&config);
+}
+
+struct aaos* aaos_init_config(const struct aaos_config* config)
 {
 	LOGI("aaos_init()");
 	struct aaos* a, zero_aaos = { 0 };
+	const int32_t target_ms = config->target_ms > 0 ? config->target_ms : AAOS_DEFAULT_TARGET_MS;
+	const int32_t capacity_ms = config->capacity_ms > 0 ? config->capacity_ms : AAOS_DEFAULT_CAPACITY_MS;
+	uint32_t capacity = 2;
 
 	if ((a = (struct aaos*)malloc(sizeof(struct aaos))) == NULL)
 		return aaos_close_and_return_null(NULL, "not enough memory for aaos");
 
 	*a = zero_aaos;
 
+	a->sample_rate = config->sample_rate > 0 ? config->sample_rate : AAOS_DEFAULT_SAMPLE_RATE;
+	a->channels = config->channels > 0 ? config->channels : 1;
+
+	while (capacity < (uint32_t)((int64_t)a->sample_rate * capacity_ms / 1000))
+		capacity *= 2;
+
+	a->mask = capacity - 1;
+	a->max_target = (int32_t)(capacity / 2);
+	a->min_target = (int32_t)((int64_t)a->sample_rate * target_ms / 1000);
+	a->priming = 1;
+
+	if (a->min_target < 2 || a->min_target > a->max_target)
+		return aaos_close_and_return_null(a, "jitter buffer target exceeds half of capacity");
+
+	atomic_init(&a->target, a->min_target);
+
+	if ((a->ring = (int16_t*)malloc(capacity * a->channels * sizeof(int16_t))) == NULL)
+		return aaos_close_and_return_null(a, "not enough memory for audio ring");
+
+	a->scratch_frames = a->sample_rate * AAOS_PLC_CROSSFADE_MS / 1000;
+
+	if (aaos_plc_init(a, &a->writer_plc) != 0 || aaos_plc_init(a, &a->reader_plc) != 0 ||
+		(a->scratch = (int16_t*)malloc(a->scratch_frames * a->channels * sizeof(int16_t))) == NULL)
+		return aaos_close_and_return_null(a, "not enough memory for loss concealment");
+
+#ifdef __ANDROID__
+	if (aaos_open(a) != 0)
+#else
+	if (aaos_open(a, config->file) != 0)
+#endif
+		return aaos_close_and_return_null(a, "failed to open audio output");
+
+	return a;
+}
+
+#ifdef __ANDROID__
+static int aaos_open(struct aaos* a)
+{
 	AAudioStreamBuilder* builder = NULL;
 	aaudio_result_t result = AAudio_createStreamBuilder(&builder);
-	AAudioStreamBuilder_setChannelCount(builder, 1); // Mono
+
+	if (result != AAUDIO_OK)
+	{
+		LOGE("aaos: failed to create the AAudioStreamBuilder: %s", AAudio_convertResultToText(result));
+		return -1;
+	}
+
+	AAudioStreamBuilder_setChannelCount(builder, a->channels);
 	AAudioStreamBuilder_setSharingMode(builder, AAUDIO_SHARING_MODE_SHARED); // Maybe we need EX mode if we want LOW_LATENCY? Doesn't seem to give it to me anyway
 	AAudioStreamBuilder_setPerformanceMode(builder, AAUDIO_PERFORMANCE_MODE_NONE); // doesn't seem to respect LOW_LATENCY, but does give me POWER_SAVING if I ask. But does lower buffer sizes.
 	AAudioStreamBuilder_setFormat(builder, AAUDIO_FORMAT_PCM_I16); // signed int16 data
-	AAudioStreamBuilder_setSampleRate(builder, 24000);
+	AAudioStreamBuilder_setSampleRate(builder, a->sample_rate);
+	// the device pulls samples from the jitter buffer, delivery timing no longer matters
+	AAudioStreamBuilder_setDataCallback(builder, aaos_data_callback, a);
+	AAudioStreamBuilder_setErrorCallback(builder, aaos_error_callback, a);
 
 	LOGI("aaos: Created the AAudioStreamBuilder: %s", AAudio_convertResultToText(result));
 
-	AAudioStream* stream;
-	result = AAudioStreamBuilder_openStream(builder, &stream);
+	result = AAudioStreamBuilder_openStream(builder, &a->stream);
 
 	LOGI("aaos: Created the AAudioStream - result %s", AAudio_convertResultToText(result));
 
+	// clean up the builder
+	AAudioStreamBuilder_delete(builder);
+
+	if (result != AAUDIO_OK)
+	{
+		a->stream = NULL;
+		return -1;
+	}
+
 	// log the specifics of the output AAudioStream we got given by the system
 	LOGI("aaos: Stream deviceId:%d, sharingMode:%d, sampleRate:%d, samplesPerFrame:%d, channelCount:%d, format:%d, bufferCapacity:%d, bufferSize:%d, framesPerBurst:%d, performanceMode:%d",
-		AAudioStream_getDeviceId(stream), AAudioStream_getSharingMode(stream), AAudioStream_getSampleRate(stream),
-		AAudioStream_getSamplesPerFrame(stream), AAudioStream_getChannelCount(stream), AAudioStream_getFormat(stream),
-		AAudioStream_getBufferCapacityInFrames(stream), AAudioStream_getBufferSizeInFrames(stream), AAudioStream_getFramesPerBurst(stream),
-		AAudioStream_getPerformanceMode(stream));
+		AAudioStream_getDeviceId(a->stream), AAudioStream_getSharingMode(a->stream), AAudioStream_getSampleRate(a->stream),
+		AAudioStream_getSamplesPerFrame(a->stream), AAudioStream_getChannelCount(a->stream), AAudioStream_getFormat(a->stream),
+		AAudioStream_getBufferCapacityInFrames(a->stream), AAudioStream_getBufferSizeInFrames(a->stream), AAudioStream_getFramesPerBurst(a->stream),
+		AAudioStream_getPerformanceMode(a->stream));
 
-	// clean up the builder
-	result = AAudioStreamBuilder_delete(builder);
+	result = AAudioStream_requestStart(a->stream);
 
-	LOGI("aaos: Deleted the AAudioStreamBuilder: %s", AAudio_convertResultToText(result));
+	LOGI("aaos: Requested the AAudioStream to start: %s", AAudio_convertResultToText(result));
 
-	result = AAudioStream_requestStart(stream);
+	return result == AAUDIO_OK ? 0 : -1;
+}
 
-	LOGI("aaos: Requested the AAudioStream to start: %s", AAudio_convertResultToText(result));
+// realtime thread, no locks, no allocations, no logging
+static aaudio_data_callback_result_t aaos_data_callback(AAudioStream* stream, void* user, void* data, int32_t frames)
+{
+	aaos_render((struct aaos*)user, (int16_t*)data, frames);
+	return AAUDIO_CALLBACK_RESULT_CONTINUE;
+}
 
-	a->stream = stream;
-	return a;
+static void aaos_error_callback(AAudioStream* stream, void* user, aaudio_result_t error)
+{
+	LOGE("aaos: stream error: %s", AAudio_convertResultToText(error));
+}
+#else
+static int aaos_open(struct aaos* a, const char* file)
+{
+	if (file && (a->file = fopen(file, "wb")) == NULL)
+	{
+		LOGE("aaos: failed to open output file %s", file);
+		return -1;
+	}
+
+	if (pthread_create(&a->thread, NULL, aaos_host_thread, a) != 0)
+		return -1;
+
+	a->thread_started = 1;
+
+	LOGI("aaos: host backend, sampleRate:%d, channelCount:%d, output:%s", a->sample_rate, a->channels, file ? file : "null");
+
+	return 0;
+}
+
+// pulls bursts at device pace like AAudio callback would
+static void* aaos_host_thread(void* user)
+{
+	struct aaos* a = (struct aaos*)user;
+	const int32_t burst = a->sample_rate * AAOS_BURST_MS / 1000;
+	int16_t* buffer = (int16_t*)malloc(burst * a->channels * sizeof(int16_t));
+	struct timespec next;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	while (buffer && !atomic_load(&a->stop))
+	{
+		aaos_render(a, buffer, burst);
+
+		if (a->file)
+			fwrite(buffer, a->channels * sizeof(int16_t), burst, a->file);
+
+		next.tv_nsec += AAOS_BURST_MS * 1000000L;
+		if (next.tv_nsec >= 1000000000L)
+		{
+			next.tv_nsec -= 1000000000L;
+			++next.tv_sec;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+
+	free(buffer);
+	return NULL;
 }
+#endif
 
 void aaos_close(struct aaos* a)
 {
 	if (a == NULL)
 		return;
 
-	aaudio_result_t result = AAudioStream_requestStop(a->stream);
-	LOGI("aaos: Requested the AAudioStream to stop: %s", AAudio_convertResultToText(result));
+#ifdef __ANDROID__
+	if (a->stream)
+	{
+		aaudio_result_t result = AAudioStream_requestStop(a->stream);
+		LOGI("aaos: Requested the AAudioStream to stop: %s", AAudio_convertResultToText(result));
+
+		result = AAudioStream_close(a->stream);
+		LOGI("aaos: Closed the AAudioStream: %s", AAudio_convertResultToText(result));
+	}
+#else
+	atomic_store(&a->stop, 1);
 
-	result = AAudioStream_close(a->stream);
-	LOGI("aaos: Closed the AAudioStream: %s", AAudio_convertResultToText(result));
+	if (a->thread_started)
+		pthread_join(a->thread, NULL);
 
+	if (a->file)
+		fclose(a->file);
+#endif
+
+	LOGI("aaos: underruns %d, overruns %d, dropped %d frames, concealed %d frames", atomic_load(&a->underruns),
+		atomic_load(&a->overruns), atomic_load(&a->dropped), atomic_load(&a->concealed));
+
+	free(a->writer_plc.history);
+	free(a->reader_plc.history);
+	free(a->scratch);
+	free(a->ring);
 	free(a);
 
 	LOGI("aaos_close()");
@@ -87,19 +323,339 @@ static struct aaos* aaos_close_and_return_null(struct aaos* a, const char* msg)
 	return NULL;
 }
 
-// push the samples directly to the buffer
+// producer side, whatever doesn't fit in the ring is dropped
 int32_t aaos_write(struct aaos* a, const int16_t* buffer, const int32_t buflen)
 {
-	// write the audio data non-blocking (write, or dump if the buffer is full?)
-	aaudio_result_t result = AAudioStream_write(a->stream, buffer, buflen, 0);
-	if (result < 0)
+	if (a == NULL || buffer == NULL || buflen < 0)
+		return -1;
+
+	return (int32_t)aaos_push(a, buffer, (uint32_t)buflen);
+}
+
+int32_t aaos_write_timestamped(struct aaos* a, const int16_t* buffer, const int32_t buflen, int64_t timestamp_us)
+{
+	if (a == NULL || buffer == NULL || buflen < 0)
+		return -1;
+
+	const int32_t channels = a->channels;
+	const int64_t gap = a->next_timestamp ? (timestamp_us - a->next_timestamp) * a->sample_rate / 1000000 : 0;
+	const int64_t max_gap = (int64_t)a->sample_rate * AAOS_PLC_MAX_GAP_MS / 1000;
+	int32_t frames = buflen, skip = 0;
+
+	// duplicated or reordered audio, only what follows written frames is new
+	// (timestamps far in the past are sender restart, new stream written whole)
+	if (gap < 0 && -gap <= max_gap)
+	{
+		if (-gap >= frames)
+			return 0;
+		skip = (int32_t)-gap;
+		frames -= skip;
+		buffer += skip * channels;
+	}
+	else if (gap < 0)
+		a->writer_plc.period = 0;
+
+	// lost chunks (gap over a millisecond) are concealed, longer gaps are a new stream
+	if (gap * 1000 > a->sample_rate && gap <= max_gap)
 	{
-		LOGE("aaos: error writing to stream: %s", AAudio_convertResultToText(result));
+		for (int64_t done = 0; done < gap; done += a->scratch_frames)
+		{
+			const int32_t n = gap - done < a->scratch_frames ? (int32_t)(gap - done) : a->scratch_frames;
+
+			atomic_fetch_add_explicit(&a->concealed, aaos_plc_conceal(a, &a->writer_plc, a->scratch, n), memory_order_relaxed);
+			aaos_push(a, a->scratch, n);
+		}
 	}
-	// debug only, if samples are not being written for some reason (also returned to caller)
-	//else
-	//{
-	//	LOGV("aaos: wrote %d/%d audio samples", result, buflen);
-	//}
-	return result;
-}
\ No newline at end of file
+	else if (gap > 0)
+		a->writer_plc.period = 0;
+
+	// crossfade from concealment in a copy, caller buffer is const
+	int32_t written = 0;
+
+	if (a->writer_plc.period)
+	{
+		const int32_t n = frames < a->scratch_frames ? frames : a->scratch_frames;
+
+		memcpy(a->scratch, buffer, n * channels * sizeof(int16_t));
+		aaos_plc_resume(a, &a->writer_plc, a->scratch, n);
+		written = (int32_t)aaos_push(a, a->scratch, n);
+
+		if (written == n)
+			written += (int32_t)aaos_push(a, buffer + n * channels, frames - n);
+	}
+	else
+		written = (int32_t)aaos_push(a, buffer, frames);
+
+	aaos_plc_remember(a, &a->writer_plc, buffer, frames);
+	a->next_timestamp = timestamp_us + (int64_t)buflen * 1000000 / a->sample_rate;
+
+	return written;
+}
+
+int32_t aaos_set_delay(struct aaos* a, int32_t delay_ms)
+{
+	if (a == NULL || delay_ms < 0)
+		return -1;
+
+	const int64_t delay = (int64_t)a->sample_rate * delay_ms / 1000;
+
+	atomic_store_explicit(&a->delay, delay < a->max_target ? (int32_t)delay : a->max_target, memory_order_relaxed);
+
+	return 0;
+}
+
+static uint32_t aaos_push(struct aaos* a, const int16_t* buffer, uint32_t count)
+{
+	const uint32_t head = atomic_load_explicit(&a->head, memory_order_relaxed);
+	const uint32_t tail = atomic_load_explicit(&a->tail, memory_order_acquire);
+	const uint32_t space = a->mask + 1 - (head - tail);
+	const uint32_t frames = count < space ? count : space;
+	const uint32_t first = head & a->mask;
+	const uint32_t split = first + frames > a->mask + 1 ? a->mask + 1 - first : frames;
+
+	memcpy(a->ring + first * a->channels, buffer, split * a->channels * sizeof(int16_t));
+	memcpy(a->ring, buffer + split * a->channels, (frames - split) * a->channels * sizeof(int16_t));
+
+	atomic_store_explicit(&a->head, head + frames, memory_order_release);
+
+	if (frames < count)
+	{
+		atomic_fetch_add_explicit(&a->overruns, 1, memory_order_relaxed);
+		atomic_fetch_add_explicit(&a->dropped, count - frames, memory_order_relaxed);
+	}
+
+	return frames;
+}
+
+// consumer side (device callback), fills frames with resampled buffered audio or concealment
+static void aaos_render(struct aaos* a, int16_t* out, int32_t frames)
+{
+	const int32_t channels = a->channels;
+	const uint32_t head = atomic_load_explicit(&a->head, memory_order_acquire);
+	uint32_t tail = atomic_load_explicit(&a->tail, memory_order_relaxed);
+	uint32_t buffered = head - tail;
+	int32_t target = atomic_load_explicit(&a->target, memory_order_relaxed);
+	const int32_t delay = atomic_load_explicit(&a->delay, memory_order_relaxed);
+	const int32_t depth = target > delay ? target : delay;
+	int32_t i = 0;
+
+	// after underrun (and at start) wait for target depth instead of playing crackle
+	if (a->priming && buffered >= (uint32_t)depth)
+	{
+		a->priming = 0;
+		a->level = (float)buffered;
+		a->phase = 0.0f;
+	}
+
+	// latency accumulated in delivery bursts (e.g. after network stall) is trimmed back to target
+	if (!a->priming && buffered > (uint32_t)(depth + a->max_target))
+	{
+		atomic_fetch_add_explicit(&a->dropped, buffered - depth, memory_order_relaxed);
+		tail += buffered - depth;
+		buffered = depth;
+		a->level = (float)depth;
+	}
+
+	// smoothed depth (time constant about a second) steers playback rate so that
+	// sender and device clock drift neither drains nor fills the buffer
+	a->level += (buffered - a->level) * frames / a->sample_rate;
+
+	int32_t ppm = (int32_t)((a->level - depth) / depth * AAOS_MAX_DRIFT_PPM);
+	ppm = ppm > AAOS_MAX_DRIFT_PPM ? AAOS_MAX_DRIFT_PPM : (ppm < -AAOS_MAX_DRIFT_PPM ? -AAOS_MAX_DRIFT_PPM : ppm);
+	const float ratio = 1.0f + ppm * 1e-6f;
+
+	// linear interpolation at fractional position, needs the next frame too
+	for (; !a->priming && i < frames && buffered >= 2; ++i)
+	{
+		const int16_t* s0 = a->ring + (tail & a->mask) * channels;
+		const int16_t* s1 = a->ring + ((tail + 1) & a->mask) * channels;
+
+		for (int32_t c = 0; c < channels; ++c)
+			out[i * channels + c] = (int16_t)(s0[c] + (s1[c] - s0[c]) * a->phase);
+
+		a->phase += ratio;
+
+		const uint32_t step = (uint32_t)a->phase;
+		a->phase -= step;
+		tail += step;
+		buffered -= step;
+	}
+
+	atomic_store_explicit(&a->tail, tail, memory_order_release);
+	atomic_store_explicit(&a->ratio_ppm, ppm, memory_order_relaxed);
+
+	aaos_plc_resume(a, &a->reader_plc, out, i);
+	aaos_plc_remember(a, &a->reader_plc, out, i);
+
+	if (i < frames)
+	{
+		// repeat recent audio fading to silence rather than cut it
+		atomic_fetch_add_explicit(&a->concealed, aaos_plc_conceal(a, &a->reader_plc, out + i * channels, frames - i), memory_order_relaxed);
+
+		// ran dry while playing, jitter is larger than the buffer absorbs
+		if (!a->priming)
+		{
+			atomic_fetch_add_explicit(&a->underruns, 1, memory_order_relaxed);
+			target = target + a->sample_rate * AAOS_TARGET_UP_MS / 1000;
+			atomic_store_explicit(&a->target, target < a->max_target ? target : a->max_target, memory_order_relaxed);
+			a->priming = 1;
+			a->stable = 0;
+		}
+		return;
+	}
+
+	// long without underrun, try lower latency
+	if ((a->stable += frames) > a->sample_rate / 1000 * AAOS_STABLE_MS)
+	{
+		target = target - a->sample_rate * AAOS_TARGET_DOWN_MS / 1000;
+		atomic_store_explicit(&a->target, target > a->min_target ? target : a->min_target, memory_order_relaxed);
+		a->stable = 0;
+	}
+}
+
+static int aaos_plc_init(struct aaos* a, struct aaos_plc* p)
+{
+	p->frames = a->sample_rate * AAOS_PLC_HISTORY_MS / 1000;
+	p->history = (int16_t*)calloc(p->frames * a->channels, sizeof(int16_t));
+
+	return p->history ? 0 : -1;
+}
+
+// keeps the last history frames of real audio
+static void aaos_plc_remember(struct aaos* a, struct aaos_plc* p, const int16_t* in, int32_t frames)
+{
+	const int32_t channels = a->channels;
+
+	p->heard = p->heard || frames > 0;
+
+	if (frames >= p->frames)
+	{
+		memcpy(p->history, in + (frames - p->frames) * channels, p->frames * channels * sizeof(int16_t));
+		return;
+	}
+
+	memmove(p->history, p->history + frames * channels, (p->frames - frames) * channels * sizeof(int16_t));
+	memcpy(p->history + (p->frames - frames) * channels, in, frames * channels * sizeof(int16_t));
+}
+
+// pitch period maximizing normalized correlation of the history end with its past (first channel)
+static int32_t aaos_plc_period(struct aaos* a, const struct aaos_plc* p)
+{
+	const int32_t channels = a->channels;
+	const int32_t window = a->sample_rate * AAOS_PLC_WINDOW_MS / 1000;
+	const int32_t min_period = (int32_t)((int64_t)a->sample_rate * AAOS_PLC_MIN_PERIOD_US / 1000000);
+	const int32_t max_period = a->sample_rate * AAOS_PLC_MAX_PERIOD_MS / 1000;
+	const int16_t* end = p->history + (p->frames - window) * channels;
+	int32_t best = max_period;
+	float best_score = 0.0f;
+
+	for (int32_t lag = min_period; lag <= max_period && lag + window <= p->frames; ++lag)
+	{
+		const int16_t* past = end - lag * channels;
+		float xy = 0.0f, yy = 0.0f;
+
+		for (int32_t i = 0; i < window; ++i)
+		{
+			xy += (float)end[i * channels] * past[i * channels];
+			yy += (float)past[i * channels] * past[i * channels];
+		}
+
+		const float score = yy > 0.0f && xy > 0.0f ? xy * xy / yy : 0.0f;
+
+		if (score > best_score)
+		{
+			best_score = score;
+			best = lag;
+		}
+	}
+
+	return best;
+}
+
+// the last pitch period repeated with gain fading to silence, returns frames before silence
+static int32_t aaos_plc_conceal(struct aaos* a, struct aaos_plc* p, int16_t* out, int32_t frames)
+{
+	const int32_t channels = a->channels;
+	const int32_t fade = a->sample_rate * AAOS_PLC_FADE_MS / 1000;
+
+	// nothing to repeat before the first audio
+	if (!p->heard)
+	{
+		memset(out, 0, frames * channels * sizeof(int16_t));
+		return 0;
+	}
+
+	if (p->period == 0)
+	{
+		p->period = aaos_plc_period(a, p);
+		p->position = 0;
+	}
+
+	const int16_t* last = p->history + (p->frames - p->period) * channels;
+	const int32_t audible = p->position < fade ? (fade - p->position < frames ? fade - p->position : frames) : 0;
+
+	for (int32_t i = 0; i < frames; ++i, ++p->position)
+	{
+		const float gain = p->position < fade ? 1.0f - (float)p->position / fade : 0.0f;
+		const int16_t* s = last + (p->position % p->period) * channels;
+
+		for (int32_t c = 0; c < channels; ++c)
+			out[i * channels + c] = (int16_t)(s[c] * gain);
+	}
+
+	return audible;
+}
+
+// crossfade from continued concealment to audio at the start of inout, ends concealment
+static void aaos_plc_resume(struct aaos* a, struct aaos_plc* p, int16_t* inout, int32_t frames)
+{
+	const int32_t channels = a->channels;
+	const int32_t fade = a->sample_rate * AAOS_PLC_FADE_MS / 1000;
+	const int32_t crossfade = a->sample_rate * AAOS_PLC_CROSSFADE_MS / 1000;
+	const int32_t n = frames < crossfade ? frames : crossfade;
+
+	if (p->period == 0 || frames == 0)
+		return;
+
+	const int16_t* last = p->history + (p->frames - p->period) * channels;
+
+	for (int32_t i = 0; i < n; ++i, ++p->position)
+	{
+		const float gain = p->position < fade ? 1.0f - (float)p->position / fade : 0.0f;
+		const float w = (float)(i + 1) / (n + 1);
+		const int16_t* s = last + (p->position % p->period) * channels;
+
+		for (int32_t c = 0; c < channels; ++c)
+			inout[i * channels + c] = (int16_t)(s[c] * gain * (1.0f - w) + inout[i * channels + c] * w);
+	}
+
+	p->period = 0;
+}
+
+int32_t aaos_get_stats(struct aaos* a, struct aaos_stats* stats)
+{
+	if (a == NULL || stats == NULL)
+		return -1;
+
+	const uint32_t head = atomic_load_explicit(&a->head, memory_order_relaxed);
+	const uint32_t tail = atomic_load_explicit(&a->tail, memory_order_relaxed);
+
+	stats->underruns = atomic_load_explicit(&a->underruns, memory_order_relaxed);
+	stats->overruns = atomic_load_explicit(&a->overruns, memory_order_relaxed);
+	stats->dropped = atomic_load_explicit(&a->dropped, memory_order_relaxed);
+	stats->buffered_ms = (int32_t)((int64_t)(int32_t)(head - tail) * 1000 / a->sample_rate);
+	const int32_t target = atomic_load_explicit(&a->target, memory_order_relaxed);
+	const int32_t delay = atomic_load_explicit(&a->delay, memory_order_relaxed);
+
+	stats->target_ms = (int32_t)((int64_t)(target > delay ? target : delay) * 1000 / a->sample_rate);
+	stats->ratio_ppm = atomic_load_explicit(&a->ratio_ppm, memory_order_relaxed);
+	stats->concealed = atomic_load_explicit(&a->concealed, memory_order_relaxed);
+	stats->latency_ms = stats->buffered_ms;
+#ifdef __ANDROID__
+	stats->latency_ms += (int32_t)((int64_t)AAudioStream_getBufferSizeInFrames(a->stream) * 1000 / a->sample_rate);
+#else
+	stats->latency_ms += AAOS_BURST_MS;
+#endif
+
+	return 0;
+}
@@ -9,15 +9,54 @@ extern "C" {
 
 struct aaos;
 
+// audio output configuration, zero fields take defaults
+struct aaos_config
+{
+	int32_t sample_rate; // e.g. 24000 (default)
+	int32_t channels; // interleaved channels, 1 (default) for mono
+	int32_t target_ms; // initial and minimal jitter buffer depth, grows after underruns, default 60
+	int32_t capacity_ms; // ring buffer size, jitter buffer depth is limited to its half, default 500
+	const char* file; // host backend only, NULL discards samples, otherwise raw int16 output file
+};
+
+// output statistics, counters since init
+struct aaos_stats
+{
+	int32_t underruns; // callbacks that ran out of buffered samples (concealed, then silence until target depth)
+	int32_t overruns; // writes that didn't fit in the ring
+	int32_t dropped; // frames dropped by overruns and by trimming latency after bursts
+	int32_t buffered_ms; // current jitter buffer depth
+	int32_t target_ms; // current adaptive target depth (or delay if larger)
+	int32_t ratio_ppm; // playback rate deviation compensating clock drift, in parts per million
+	int32_t concealed; // frames synthesized by packet loss concealment (lost chunks and underruns)
+	int32_t latency_ms; // buffered audio and device buffer, time until newly written frame plays
+};
+
+// default configuration
 struct aaos* aaos_init();
 
+// AAudio data callback on Android, null/file backend paced by thread on other hosts, NULL on error
+struct aaos* aaos_init_config(const struct aaos_config* config);
+
 void aaos_close(struct aaos* a);
 
-// push the samples directly to the buffer
+// queue buflen frames of interleaved samples for playback, never blocks (single producer thread)
+// returns number of frames queued (less if the ring is full) or negative value on error
 int32_t aaos_write(struct aaos* a, const int16_t* buffer, const int32_t buflen);
 
+// aaos_write with sender timestamp of the first frame in microseconds (monotonic sender clock)
+// gaps (lost chunks) are concealed by repeating pitch period of recent audio with crossfade,
+// frames overlapping already written ones are dropped, timestamps far in the past (sender restart) start new stream
+int32_t aaos_write_timestamped(struct aaos* a, const int16_t* buffer, const int32_t buflen, int64_t timestamp_us);
+
+// minimal jitter buffer depth (e.g. to delay audio to match video), limited to half of capacity, 0 for none
+int32_t aaos_set_delay(struct aaos* a, int32_t delay_ms);
+
+// 0 on success, negative value on error
+int32_t aaos_get_stats(struct aaos* a, struct aaos_stats* stats);
+
 #ifdef __cplusplus
 }
 #endif
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,230 @@
+#include "aoc.h"
+
+#include <malloc.h>
+
+#ifdef __ANDROID__
+#include <android/log.h>
+#define LOGI(...) ((void)__android_log_print(ANDROID_LOG_INFO, "unhvd_native_android", __VA_ARGS__))
+#define LOGE(...) ((void)__android_log_print(ANDROID_LOG_ERROR, "unhvd_native_android", __VA_ARGS__))
+#else
+#include <stdio.h>
+#define LOGI(...) ((void)(fprintf(stderr, __VA_ARGS__), fputc('\n', stderr)))
+#define LOGE(...) ((void)(fprintf(stderr, __VA_ARGS__), fputc('\n', stderr)))
+#endif
+
+#ifdef UNHVD_OPUS
+// libopus built for the target ABI, see README
+
+#include <opus/opus.h>
+
+enum aoc_constants
+{
+	AOC_DEFAULT_SAMPLE_RATE = 24000,
+	AOC_DEFAULT_FRAME_MS = 20,
+	AOC_DEFAULT_BITRATE = 24000,
+	AOC_DEFAULT_LOSS_PERCENT = 10,
+	AOC_MAX_PACKET_MS = 120, // the longest Opus packet
+};
+
+struct aoc
+{
+	OpusEncoder* encoder; // sender side
+	OpusDecoder* decoder; // receiver side
+	int32_t sample_rate;
+	int32_t channels;
+	int32_t frame_size; // frames per packet
+};
+
+static struct aoc* aoc_create(const struct aoc_config* config);
+static struct aoc* aoc_close_and_return_null(struct aoc* c, const char* msg, int error);
+
+struct aoc* aoc_init_encoder(const struct aoc_config* config)
+{
+	LOGI("aoc_init_encoder()");
+	struct aoc* c;
+	const int32_t frame_ms = config->frame_ms > 0 ? config->frame_ms : AOC_DEFAULT_FRAME_MS;
+	const int32_t bitrate = config->bitrate > 0 ? config->bitrate : AOC_DEFAULT_BITRATE;
+	const int32_t loss_percent = config->loss_percent > 0 ? config->loss_percent : AOC_DEFAULT_LOSS_PERCENT;
+	int error = OPUS_OK;
+
+	if ((c = aoc_create(config)) == NULL)
+		return NULL;
+
+	// in-band FEC is coded by SILK layer, only for frames of 10 ms or longer
+	if (frame_ms != 10 && frame_ms != 20 && frame_ms != 40 && frame_ms != 60)
+		return aoc_close_and_return_null(c, "frame duration must be 10, 20, 40 or 60 ms", OPUS_OK);
+
+	c->frame_size = c->sample_rate / 1000 * frame_ms;
+
+	// voice application favours SILK which carries FEC, low delay mode would disable it
+	if ((c->encoder = opus_encoder_create(c->sample_rate, c->channels, OPUS_APPLICATION_VOIP, &error)) == NULL)
+		return aoc_close_and_return_null(c, "failed to create Opus encoder", error);
+
+	if ((error = opus_encoder_ctl(c->encoder, OPUS_SET_BITRATE(bitrate))) != OPUS_OK ||
+		(error = opus_encoder_ctl(c->encoder, OPUS_SET_INBAND_FEC(1))) != OPUS_OK ||
+		(error = opus_encoder_ctl(c->encoder, OPUS_SET_PACKET_LOSS_PERC(loss_percent))) != OPUS_OK)
+		return aoc_close_and_return_null(c, "failed to configure Opus encoder", error);
+
+	LOGI("aoc: %d Hz, %d channels, %d ms packets, %d bps, %d%% expected loss",
+		c->sample_rate, c->channels, frame_ms, bitrate, loss_percent);
+
+	return c;
+}
+
+struct aoc* aoc_init_decoder(const struct aoc_config* config)
+{
+	LOGI("aoc_init_decoder()");
+	struct aoc* c;
+	int error = OPUS_OK;
+
+	if ((c = aoc_create(config)) == NULL)
+		return NULL;
+
+	c->frame_size = c->sample_rate / 1000 * AOC_MAX_PACKET_MS;
+
+	if ((c->decoder = opus_decoder_create(c->sample_rate, c->channels, &error)) == NULL)
+		return aoc_close_and_return_null(c, "failed to create Opus decoder", error);
+
+	return c;
+}
+
+static struct aoc* aoc_create(const struct aoc_config* config)
+{
+	struct aoc* c, zero_aoc = { 0 };
+
+	if ((c = (struct aoc*)malloc(sizeof(struct aoc))) == NULL)
+		return aoc_close_and_return_null(NULL, "not enough memory for aoc", OPUS_OK);
+
+	*c = zero_aoc;
+
+	c->sample_rate = config->sample_rate > 0 ? config->sample_rate : AOC_DEFAULT_SAMPLE_RATE;
+	c->channels = config->channels > 0 ? config->channels : 1;
+
+	if (c->sample_rate != 8000 && c->sample_rate != 12000 && c->sample_rate != 16000 &&
+		c->sample_rate != 24000 && c->sample_rate != 48000)
+		return aoc_close_and_return_null(c, "Opus sample rate must be 8, 12, 16, 24 or 48 kHz", OPUS_OK);
+
+	if (c->channels > 2)
+		return aoc_close_and_return_null(c, "Opus supports mono and stereo only", OPUS_OK);
+
+	return c;
+}
+
+void aoc_close(struct aoc* c)
+{
+	if (c == NULL)
+		return;
+
+	if (c->encoder)
+		opus_encoder_destroy(c->encoder);
+	if (c->decoder)
+		opus_decoder_destroy(c->decoder);
+
+	free(c);
+}
+
+static struct aoc* aoc_close_and_return_null(struct aoc* c, const char* msg, int error)
+{
+	if (error != OPUS_OK)
+		LOGE("aoc: %s: %s", msg, opus_strerror(error));
+	else
+		LOGE("aoc: %s", msg);
+
+	aoc_close(c);
+
+	return NULL;
+}
+
+int32_t aoc_frame_size(struct aoc* c)
+{
+	return c ? c->frame_size : -1;
+}
+
+int32_t aoc_encode(struct aoc* c, const int16_t* buffer, uint8_t* packet, int32_t size)
+{
+	if (c == NULL || c->encoder == NULL || buffer == NULL || packet == NULL)
+		return -1;
+
+	const int32_t bytes = opus_encode(c->encoder, buffer, c->frame_size, packet, size);
+
+	if (bytes < 0)
+		LOGE("aoc: failed to encode: %s", opus_strerror(bytes));
+
+	return bytes;
+}
+
+int32_t aoc_decode(struct aoc* c, const uint8_t* packet, int32_t size, int16_t* buffer, int32_t buflen)
+{
+	if (c == NULL || c->decoder == NULL || packet == NULL || size <= 0 || buffer == NULL)
+		return -1;
+
+	const int32_t frames = opus_decode(c->decoder, packet, size, buffer, buflen, 0);
+
+	if (frames < 0)
+		LOGE("aoc: failed to decode: %s", opus_strerror(frames));
+
+	return frames;
+}
+
+int32_t aoc_decode_fec(struct aoc* c, const uint8_t* packet, int32_t size, int16_t* buffer, int32_t buflen)
+{
+	if (c == NULL || c->decoder == NULL || packet == NULL || size <= 0 || buffer == NULL)
+		return -1;
+
+	// the lost packet is assumed to be as long as this one (constant frame duration of sender)
+	int32_t frames = opus_decoder_get_nb_samples(c->decoder, packet, size);
+
+	if (frames < 0)
+	{
+		LOGE("aoc: invalid packet: %s", opus_strerror(frames));
+		return frames;
+	}
+
+	if (frames > buflen)
+		return -1;
+
+	if ((frames = opus_decode(c->decoder, packet, size, buffer, frames, 1)) < 0)
+		LOGE("aoc: failed to recover lost packet: %s", opus_strerror(frames));
+
+	return frames;
+}
+
+#else // built without Opus, codec is unavailable
+
+struct aoc* aoc_init_encoder(const struct aoc_config* config)
+{
+	LOGE("aoc: built without Opus support (UNHVD_OPUS)");
+	return NULL;
+}
+
+struct aoc* aoc_init_decoder(const struct aoc_config* config)
+{
+	LOGE("aoc: built without Opus support (UNHVD_OPUS)");
+	return NULL;
+}
+
+void aoc_close(struct aoc* c)
+{
+}
+
+int32_t aoc_frame_size(struct aoc* c)
+{
+	return -1;
+}
+
+int32_t aoc_encode(struct aoc* c, const int16_t* buffer, uint8_t* packet, int32_t size)
+{
+	return -1;
+}
+
+int32_t aoc_decode(struct aoc* c, const uint8_t* packet, int32_t size, int16_t* buffer, int32_t buflen)
+{
+	return -1;
+}
+
+int32_t aoc_decode_fec(struct aoc* c, const uint8_t* packet, int32_t size, int16_t* buffer, int32_t buflen)
+{
+	return -1;
+}
+
+#endif // UNHVD_OPUS
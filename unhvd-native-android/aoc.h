@@ -0,0 +1,52 @@
+#ifndef AOC_H
+#define AOC_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Opus codec needs libopus and UNHVD_OPUS defined when building,
+// otherwise initialization fails and other functions return errors
+struct aoc;
+
+// Opus audio codec configuration, zero fields take defaults
+struct aoc_config
+{
+	int32_t sample_rate; // 8000, 12000, 16000, 24000 (default) or 48000
+	int32_t channels; // interleaved channels, 1 (default) or 2
+	int32_t frame_ms; // encoder only, packet duration 10, 20 (default), 40 or 60
+	int32_t bitrate; // encoder only, bits per second, default 24000 (16x less than 24 kHz int16 mono)
+	int32_t loss_percent; // encoder only, expected packet loss, in-band FEC needs at least 1, default 10
+};
+
+// sender side encoder with in-band forward error correction, NULL on error
+struct aoc* aoc_init_encoder(const struct aoc_config* config);
+
+// receiver side decoder, NULL on error
+struct aoc* aoc_init_decoder(const struct aoc_config* config);
+
+void aoc_close(struct aoc* c);
+
+// frames per packet produced by encoder, maximal frames per packet (120 ms) for decoder
+int32_t aoc_frame_size(struct aoc* c);
+
+// encode exactly aoc_frame_size frames of interleaved samples into single packet of up to size bytes
+// (4000 is always enough), returns packet size or negative value on error
+int32_t aoc_encode(struct aoc* c, const int16_t* buffer, uint8_t* packet, int32_t size);
+
+// decode packet into up to buflen frames of interleaved samples
+// returns decoded frames or negative value on error
+int32_t aoc_decode(struct aoc* c, const uint8_t* packet, int32_t size, int16_t* buffer, int32_t buflen);
+
+// recover the packet lost just before this one from in-band FEC data of this packet
+// (packet loss concealment if it has none), call before aoc_decode of the same packet
+// returns recovered frames (duration of this packet) or negative value on error
+int32_t aoc_decode_fec(struct aoc* c, const uint8_t* packet, int32_t size, int16_t* buffer, int32_t buflen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
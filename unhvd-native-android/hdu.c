@@ -9,12 +9,38 @@
  *
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE //sched_setaffinity, CPU_SET
+#endif
+
 #include "hdu.h"
 
 #include <stdlib.h> //malloc
-#include <android/log.h>
+#include <limits.h> //INT_MAX
+#include <string.h> //memmove
+#include <math.h> //sqrt, tan
+#include <stdio.h> //snprintf, fopen
+#include <pthread.h>
+#include <sched.h> //sched_setaffinity
+#include <unistd.h> //sysconf
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#if defined(__arm__)
+#include <sys/auxv.h> //getauxval
+#include <asm/hwcap.h> //HWCAP_NEON
+#endif
+#endif
+
+#ifdef __ANDROID__
+#include <android/log.h>
 #define LOGI(...) ((void)__android_log_print(ANDROID_LOG_INFO, "unhvd_native_android", __VA_ARGS__))
+#else
+//host builds (tests)
+#define LOGI(...) ((void)(fprintf(stderr, __VA_ARGS__), fputc('\n', stderr)))
+#endif
 
  // YUV -> RGB conversion macros
 #define CLIP(X) ( (X) > 255 ? 255 : (X) < 0 ? 0 : X)
@@ -28,6 +54,85 @@
 //in binary 10 ones followed by 6 zeroes
 static const uint16_t P010LE_MAX = 0xFFC0;
 
+//per hdu_depth_format bits holding depth, raw value is used as is (LSB aligned formats are not shifted)
+static const uint16_t HDU_DEPTH_MASK[] = {P010LE_MAX, 0xFFFF, 0x03FF, 0xFFFF, 0x0FFF};
+
+//voxel set key has 3 wrapping coordinates, the rest of entry is frame stamp
+enum { HDU_VOXEL_KEY_BITS = 14, HDU_VOXEL_MAX_PROBES = 32 };
+
+//row bands per thread, more bands than threads balance uneven cores
+enum { HDU_BANDS_PER_THREAD = 4, HDU_MAX_BANDS = HDU_MAX_THREADS * HDU_BANDS_PER_THREAD };
+
+//persistent worker threads, the calling thread also takes bands
+struct hdu_pool
+{
+	pthread_t threads[HDU_MAX_THREADS];
+	int workers; //number of started threads (excluding caller)
+
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond; //new generation of work or stop
+	pthread_cond_t done_cond; //all workers finished current generation
+	int generation;
+	int active; //workers still processing current generation
+	int stop;
+
+	//current job, valid for the generation
+	const struct hdu *h;
+	const struct hdu_depth *depth;
+	struct hdu_point_cloud *pc;
+	int bands;
+	int next_band; //atomically incremented
+	int counts[HDU_MAX_BANDS]; //points written by each band
+	int valid[HDU_MAX_BANDS]; //valid depth pixels seen by each band
+	int kept[HDU_MAX_BANDS]; //points kept after decimation by each band
+
+	cpu_set_t big_cores;
+	int pin;
+};
+
+//pixels processed by kernel stages at once, small enough to stay in L1, delta tile is a block
+enum { HDU_BLOCK = HDU_TILE };
+
+//intermediate results of kernel stages for a block of row pixels
+struct hdu_block
+{
+	float x[HDU_BLOCK] __attribute__((aligned(32)));
+	float y[HDU_BLOCK] __attribute__((aligned(32)));
+	float z[HDU_BLOCK] __attribute__((aligned(32)));
+	color32 colors[HDU_BLOCK] __attribute__((aligned(32)));
+	uint64_t valid; //bit per pixel with depth in [min_depth, max_depth] range
+};
+
+//current row of depth and color planes
+struct hdu_row
+{
+	const uint16_t *depth;
+	uint16_t mask; //depth bits of the format, all bits for temporally filtered history
+	const uint16_t *depth_raw; //decoded depth rows for neighbourhood filters, clamped at borders
+	const uint16_t *depth_up;
+	const uint16_t *depth_down;
+	int width;
+	const uint8_t *color_y;
+	const uint16_t *color_uv; //NV12 interleaved chroma
+	const uint8_t *color_u; //YUV420P chroma planes
+	const uint8_t *color_v;
+	const float *ray_x; //depth multipliers giving x
+	const float *ray_y; //depth multipliers giving y
+	int r;
+};
+
+//kernel stages, each processes n pixels starting at column c
+struct hdu_kernel
+{
+	const char *name;
+	void (*positions)(const struct hdu *h, const struct hdu_row *row, int c, int n, struct hdu_block *b);
+	void (*colors)(const struct hdu_row *row, int c, int n, struct hdu_block *b); //NV12
+	void (*colors_planar)(const struct hdu_row *row, int c, int n, struct hdu_block *b); //YUV420P
+	int (*store)(const struct hdu_block *b, int n, float3 *data, color32 *colors); //returns points written
+	void (*temporal)(const struct hdu *h, const uint16_t *depth, uint16_t *history, uint8_t *age, int n); //filters n pixels in place
+	uint64_t (*edges)(const struct hdu *h, const struct hdu_row *row, int c, int n, struct hdu_block *b); //returns points to keep
+};
+
 struct hdu
 {
 	float ppx;
@@ -37,11 +142,126 @@ struct hdu
 	float depth_unit;
 	float min_depth;
 	float max_depth;
+	float max_margin;
+
+	//stream formats, selected once at stream start
+	int depth_format;
+	int color_format;
+	uint16_t depth_mask;
+	void (*colors)(const struct hdu_row *row, int c, int n, struct hdu_block *b);
+
+	int distortion_model;
+	double distortion_coeffs[HDU_DISTORTION_COEFFS];
+
+	//per pixel ray directions (z = 1) for current resolution
+	float *ray_x;
+	float *ray_y;
+	float (*ray_bounds)[4]; //per tile of HDU_BLOCK pixels min x, max x, min y, max y of rays
+	int ray_width;
+	int ray_height;
+
+	int decimation;
+	int stride;
+	float voxel_size;
+
+	int vertex_format;
+	float position_scale_inv;
+	float position_offset[3];
+	int color_output;
+	//depth to color pixel projection (color K * [R|t], y flip folded in) for registration
+	int registration;
+	float color_projection[3][4];
+	int (*store)(const struct hdu *h, const struct hdu_block *b, int n, struct hdu_point_cloud *pc, int first);
+
+	//temporal filter state, history is filtered depth with precision below format mask, age counts frames a hole was filled
+	int temporal_alpha; //weight of new depth in 1/256, 0 if disabled
+	float temporal_threshold;
+	int temporal_threshold_raw; //in masked depth units for current format
+	int temporal_persistence;
+	int temporal_reset;
+	uint16_t *temporal_depth;
+	uint8_t *temporal_age;
+	int temporal_pixels;
+
+	//spatial filter, relative depth jump to neighbour rejecting point and bilateral range sigma
+	float spatial_threshold;
+	float spatial_sigma;
+
+	//sensor to world transform of the next frame, applied before store
+	int posed;
+	float pose[3][4];
+
+	//organized output and delta mode, reference depth of tiles and frame of their last change
+	int organized;
+	float delta_threshold;
+	int delta_threshold_raw; //in masked depth units for current format
+	int delta_reset; //configuration changed, all tiles are recomputed
+	int delta_reset_frame;
+	uint16_t *delta_depth;
+	int *delta_frame;
+	int delta_pixels;
+	int frame;
+
+	//culling, roi clipped to depth image and frustum planes (pose folded in) prepared per frame
+	int roi[4]; //x, y, width, height, 0 width for none
+	int roi_left, roi_right, roi_top, roi_bottom;
+	int frustum;
+	float frustum_world[6][4];
+	float frustum_planes[6][4];
+
+	//mesh of organized cloud, sensor depth of stored points (0 if not stored) and triangles of grid quads
+	float mesh_threshold;
+	float *mesh_z;
+	uint8_t *mesh_quads; //bit 0 upper left, bit 1 lower right triangle of quad at its top left pixel
+	int mesh_pixels;
+	int mesh_step; //grid step the quads were built for
+	int mesh_version;
+
+	//background model in result unit (0 for none) and samples of frames it is learned from
+	float *background;
+	int background_width;
+	int background_height;
+	float background_threshold;
+	int background_frames; //frames to learn from, 0 if not learning
+	int background_mode;
+	int background_sampled;
+	uint16_t *background_samples; //masked depth, frame after frame
+	uint16_t *background_sample; //current frame samples while learning
+	int background_samples_size;
+
+	//open addressing voxel set reused across frames, entry is stamp << 42 | voxel key
+	uint64_t *voxels;
+	int voxels_log2;
+	uint64_t voxel_stamp;
+
+	int threads;
+	struct hdu_pool *pool;
+
+	const struct hdu_kernel *kernel;
 };
 
+static struct hdu *hdu_close_and_return_null(struct hdu *h, const char *msg);
+static const struct hdu_kernel *hdu_select_kernel();
+static int hdu_rays(struct hdu *h, int width, int height);
+static int hdu_unproject_finish(struct hdu *h, const struct hdu_depth *depth, struct hdu_point_cloud *pc, int valid, int kept);
+static int hdu_voxel_prepare(struct hdu *h, int pixels);
+static int hdu_temporal_prepare(struct hdu *h, int pixels);
+static int hdu_delta_prepare(struct hdu *h, int width, int height);
+static int hdu_background_prepare(struct hdu *h, int pixels);
+static void hdu_cull_prepare(struct hdu *h, const struct hdu_depth *depth);
+static int hdu_mesh_prepare(struct hdu *h, int pixels);
+static void hdu_mesh(struct hdu *h, const struct hdu_depth *depth, struct hdu_point_cloud *pc);
+static void hdu_background_finish(struct hdu *h, const struct hdu_depth *depth);
+static uint64_t hdu_voxel_mask(const struct hdu *h, const struct hdu_block *b, int n);
+static int hdu_set_vertex_format(struct hdu *h, const struct hdu_config *c);
+static void hdu_set_registration(struct hdu *h, const struct hdu_config *c);
+static struct hdu_pool *hdu_pool_init(int threads);
+static void hdu_pool_close(struct hdu_pool *p);
+static int hdu_big_cores(cpu_set_t *set);
+
 struct hdu *hdu_init(const struct hdu_config *c)
 {
-	struct hdu *h;
+	struct hdu *h, zero_hdu = {0};
 
 	if( ( h = (struct hdu*)malloc(sizeof(struct hdu))) == NULL )
 	{
@@ -50,78 +270,3575 @@ struct hdu *hdu_init(const struct hdu_config *c)
 		return NULL;
 	}
 
+	*h = zero_hdu;
+
 	h->ppx = c->ppx;
 	h->ppy = c->ppy;
 	h->fx = c->fx;
 	h->fy = c->fy;
 	h->depth_unit = c->depth_unit;
 	h->min_depth = c->min_margin;
-	h->max_depth = P010LE_MAX * c->depth_unit - c->max_margin;
+	h->max_margin = c->max_margin;
+
+	h->distortion_model = c->distortion_model;
+	for(int i=0;i<HDU_DISTORTION_COEFFS;++i)
+		h->distortion_coeffs[i] = c->distortion_coeffs[i];
+
+	//ray table is built on first frame, when resolution is known
+
+	hdu_set_registration(h, c);
+
+	if(hdu_set_decimation(h, c->decimation, c->stride, c->voxel_size) != HDU_OK)
+		return hdu_close_and_return_null(h, "hdu: invalid decimation configuration");
+
+	if(hdu_set_temporal(h, c->temporal_alpha, c->temporal_threshold, c->temporal_persistence) != HDU_OK)
+		return hdu_close_and_return_null(h, "hdu: invalid temporal filter configuration");
+
+	if(hdu_set_spatial(h, c->spatial_threshold, c->spatial_sigma) != HDU_OK)
+		return hdu_close_and_return_null(h, "hdu: invalid spatial filter configuration");
+
+	if(hdu_set_vertex_format(h, c) != HDU_OK)
+		return hdu_close_and_return_null(h, "hdu: invalid vertex format or color output configuration");
+
+	if(c->delta_threshold < 0.0f || (c->delta_threshold > 0.0f && !c->organized))
+		return hdu_close_and_return_null(h, "hdu: delta mode needs organized point cloud");
+
+	h->organized = c->organized != 0;
+	h->delta_threshold = c->delta_threshold;
+
+	if(hdu_set_background(h, c->background_threshold) != HDU_OK)
+		return hdu_close_and_return_null(h, "hdu: invalid background threshold");
+
+	if(c->mesh_threshold < 0.0f)
+		return hdu_close_and_return_null(h, "hdu: invalid mesh threshold");
+
+	h->mesh_threshold = c->mesh_threshold;
+
+	h->threads = c->threads;
+
+	if(h->threads <= 0)
+	{
+		cpu_set_t big;
+		h->threads = hdu_big_cores(&big);
+	}
+
+	if(h->threads > HDU_MAX_THREADS)
+		h->threads = HDU_MAX_THREADS;
+
+	//single threaded unprojection needs no pool
+	if(h->threads > 1 && (h->pool = hdu_pool_init(h->threads)) == NULL)
+	{
+		LOGI("hdu: failed to start worker threads, unprojecting on single thread");
+		h->threads = 1;
+	}
+
+	h->kernel = hdu_select_kernel();
+
+	if(hdu_set_formats(h, c->depth_format, c->color_format) != HDU_OK)
+		return hdu_close_and_return_null(h, "hdu: invalid depth or color format");
+
+	LOGI("hdu: unprojecting with %d threads, %s kernel", h->threads, h->kernel->name);
 
 	return h;
 }
 
+static struct hdu *hdu_close_and_return_null(struct hdu *h, const char *msg)
+{
+	if(msg)
+		LOGI("%s", msg);
+
+	hdu_close(h);
+
+	return NULL;
+}
+
+int hdu_set_decimation(struct hdu *h, int mode, int stride, float voxel_size)
+{
+	if(mode < HDU_DECIMATION_NONE || mode > HDU_DECIMATION_VOXEL_GRID)
+		return HDU_ERROR;
+
+	if(mode == HDU_DECIMATION_STRIDE && stride < 1)
+		return HDU_ERROR;
+
+	if( (mode == HDU_DECIMATION_DEPTH_ADAPTIVE || mode == HDU_DECIMATION_VOXEL_GRID) && voxel_size <= 0.0f)
+		return HDU_ERROR;
+
+	h->decimation = mode;
+	h->stride = stride;
+	h->voxel_size = voxel_size;
+	h->delta_reset = 1;
+
+	return HDU_OK;
+}
+
+int hdu_set_temporal(struct hdu *h, float alpha, float threshold, int persistence)
+{
+	if(alpha < 0.0f || alpha > 1.0f || threshold < 0.0f || persistence < 0 || persistence > 255)
+		return HDU_ERROR;
+
+	//history from before the filter was disabled is stale
+	if(h->temporal_alpha == 0)
+		h->temporal_reset = 1;
+
+	//weight in 1/256 steps, smallest alpha still filters at 1/256
+	h->temporal_alpha = (int)(alpha * 256.0f + 0.5f);
+	if(alpha > 0.0f && h->temporal_alpha == 0)
+		h->temporal_alpha = 1;
+	h->temporal_threshold = threshold;
+	h->temporal_persistence = persistence;
+
+	return HDU_OK;
+}
+
+int hdu_set_spatial(struct hdu *h, float threshold, float sigma)
+{
+	if(threshold < 0.0f || sigma < 0.0f)
+		return HDU_ERROR;
+
+	h->spatial_threshold = threshold;
+	h->spatial_sigma = sigma;
+	h->delta_reset = 1;
+
+	return HDU_OK;
+}
+
+int hdu_set_formats(struct hdu *h, int depth_format, int color_format)
+{
+	if(depth_format < HDU_DEPTH_P010 || depth_format > HDU_DEPTH_GRAY12)
+		return HDU_ERROR;
+	if(color_format < HDU_COLOR_FORMAT_NV12 || color_format > HDU_COLOR_FORMAT_NONE)
+		return HDU_ERROR;
+
+	h->depth_format = depth_format;
+	h->depth_mask = HDU_DEPTH_MASK[depth_format];
+	h->max_depth = h->depth_mask * h->depth_unit - h->max_margin;
+	h->temporal_reset = 1; //history is in format units
+	h->delta_reset = 1; //and so is delta reference
+	h->background_sampled = 0; //and background samples
+
+	h->color_format = color_format;
+	h->colors = color_format == HDU_COLOR_FORMAT_YUV420P ? h->kernel->colors_planar : h->kernel->colors;
+
+	return HDU_OK;
+}
+
+int hdu_set_pose(struct hdu *h, const float *pose)
+{
+	const int was_posed = h->posed;
+	int changed = 0;
+
+	h->posed = 0;
+
+	if(pose != NULL)
+	{
+		for(int i=0;i<3;++i)
+			for(int j=0;j<4;++j)
+			{
+				changed |= h->pose[i][j] != pose[i * 4 + j];
+				h->pose[i][j] = pose[i * 4 + j];
+			}
+
+		//identity needs no pass
+		for(int i=0;i<3;++i)
+			for(int j=0;j<4;++j)
+				h->posed |= h->pose[i][j] != (i == j ? 1.0f : 0.0f);
+	}
+
+	//moved points are all dirty
+	if(h->posed != was_posed || (h->posed && changed))
+		h->delta_reset = 1;
+
+	return HDU_OK;
+}
+
+int hdu_set_roi(struct hdu *h, int x, int y, int width, int height)
+{
+	if(width < 0 || height < 0)
+		return HDU_ERROR;
+
+	int roi[4] = {x, y, width, height};
+
+	if(width == 0 || height == 0)
+		memset(roi, 0, sizeof(roi));
+
+	if(memcmp(h->roi, roi, sizeof(roi)) != 0)
+		h->delta_reset = 1;
+
+	memcpy(h->roi, roi, sizeof(roi));
+
+	return HDU_OK;
+}
+
+int hdu_set_frustum(struct hdu *h, const float *m)
+{
+	float planes[6][4] = {{0}};
+
+	//Gribb-Hartmann, left, right, bottom, top, near, far as 4th row +- 1st, 2nd and 3rd
+	if(m != NULL)
+		for(int p=0;p<6;++p)
+			for(int j=0;j<4;++j)
+				planes[p][j] = m[12 + j] + (p % 2 ? -m[(p / 2) * 4 + j] : m[(p / 2) * 4 + j]);
+
+	if(h->frustum != (m != NULL) || memcmp(h->frustum_world, planes, sizeof(planes)) != 0)
+		h->delta_reset = 1;
+
+	h->frustum = m != NULL;
+	memcpy(h->frustum_world, planes, sizeof(planes));
+
+	return HDU_OK;
+}
+
+int hdu_background_learn(struct hdu *h, int frames, int mode)
+{
+	if(frames < 0 || frames > HDU_BACKGROUND_MAX_FRAMES)
+		return HDU_ERROR;
+	if(mode < HDU_BACKGROUND_MEDIAN || mode > HDU_BACKGROUND_MIN)
+		return HDU_ERROR;
+
+	h->background_frames = frames;
+	h->background_mode = mode;
+	h->background_sampled = 0;
+
+	return HDU_OK;
+}
+
+int hdu_set_background(struct hdu *h, float threshold)
+{
+	if(threshold < 0.0f)
+		return HDU_ERROR;
+
+	h->background_threshold = threshold;
+	h->delta_reset = 1;
+
+	return HDU_OK;
+}
+
+//header is magic, width and height followed by float depth per pixel, native byte order
+static const char HDU_BACKGROUND_MAGIC[4] = {'H', 'D', 'U', 'B'};
+
+int hdu_background_save(const struct hdu *h, const char *file)
+{
+	const int size[2] = {h->background_width, h->background_height};
+	const size_t pixels = (size_t)size[0] * size[1];
+	FILE *f;
+	int ok;
+
+	if(h->background == NULL)
+	{
+		LOGI("hdu: no background model to save");
+		return HDU_ERROR;
+	}
+
+	if( (f = fopen(file, "wb")) == NULL )
+	{
+		LOGI("hdu: failed to open background model file %s for writing", file);
+		return HDU_ERROR;
+	}
+
+	ok = fwrite(HDU_BACKGROUND_MAGIC, sizeof(HDU_BACKGROUND_MAGIC), 1, f) == 1 &&
+		fwrite(size, sizeof(size), 1, f) == 1 &&
+		fwrite(h->background, sizeof(float), pixels, f) == pixels;
+
+	if(fclose(f) != 0 || !ok)
+	{
+		LOGI("hdu: failed to write background model file %s", file);
+		return HDU_ERROR;
+	}
+
+	return HDU_OK;
+}
+
+int hdu_background_load(struct hdu *h, const char *file)
+{
+	char magic[4];
+	int size[2];
+	size_t pixels;
+	float *background;
+	FILE *f;
+
+	if( (f = fopen(file, "rb")) == NULL )
+	{
+		LOGI("hdu: failed to open background model file %s", file);
+		return HDU_ERROR;
+	}
+
+	if(fread(magic, sizeof(magic), 1, f) != 1 || memcmp(magic, HDU_BACKGROUND_MAGIC, sizeof(magic)) != 0 ||
+		fread(size, sizeof(size), 1, f) != 1 || size[0] <= 0 || size[1] <= 0 || size[0] > 16384 || size[1] > 16384)
+	{
+		fclose(f);
+		LOGI("hdu: %s is not background model file", file);
+		return HDU_ERROR;
+	}
+
+	pixels = (size_t)size[0] * size[1];
+
+	if( (background = (float*)malloc(pixels * sizeof(float))) == NULL )
+	{
+		fclose(f);
+		LOGI("hdu: not enough memory for background model");
+		return HDU_ERROR;
+	}
+
+	if(fread(background, sizeof(float), pixels, f) != pixels)
+	{
+		free(background);
+		fclose(f);
+		LOGI("hdu: truncated background model file %s", file);
+		return HDU_ERROR;
+	}
+
+	fclose(f);
+
+	free(h->background);
+	h->background = background;
+	h->background_width = size[0];
+	h->background_height = size[1];
+	h->delta_reset = 1;
+
+	return HDU_OK;
+}
+
 void hdu_close(struct hdu *h)
 {
 	if(h == NULL)
 		return;
 
+	hdu_pool_close(h->pool);
+
+	free(h->ray_x);
+	free(h->ray_y);
+	free(h->ray_bounds);
+	free(h->voxels);
+	free(h->temporal_depth);
+	free(h->temporal_age);
+	free(h->delta_depth);
+	free(h->delta_frame);
+	free(h->background);
+	free(h->background_samples);
+	free(h->mesh_z);
+	free(h->mesh_quads);
 	free(h);
 }
 
-void hdu_unproject(const struct hdu *h, const struct hdu_depth *depth, struct hdu_point_cloud *pc)
+static void hdu_positions_scalar(const struct hdu *h, const struct hdu_row *row, int c, int n, struct hdu_block *b)
 {
-	//LOGI("hdu_unproject hdu_depth: %dx%d %d", depth->width, depth->height, depth->depth_stride);
-	//LOGI("hdu_unproject hdu      : %f,%f,%f,%f,%f,%f,%f", h->fx, h->fy, h->ppx, h->ppy, h->min_depth, h->max_depth, h->depth_unit);
-	//LOGI("hdu_unproject pc       : %d,%d,%p,%p", pc->size, pc->used, pc->data, pc->colors);
-	const int pc_size = pc->size;
-	const color32 default_color = 0xFFFFFFFF; // RGBA(255, 255, 255, 255), opaque white
-	int points=0;
+	uint64_t valid = 0;
 	float d;
-	// Y-plane length depth->color_stride * depth->height
-	const uint8_t* colorY = depth->colors;
-	// UV interleaved plane, length depth->color_stride * (depth->height / 2) in bytes (half of that in short ints)
-	const uint16_t* colorUV = ((const uint16_t*)((uint8_t*)depth->colors) + depth->color_stride * depth->height);
+
+	for(int i=0;i<n;++i, ++c)
+	{
+		d = (row->depth[c] & row->mask) * h->depth_unit;
+
+		b->x[i] = d * row->ray_x[c];
+		b->y[i] = d * row->ray_y[c];
+		b->z[i] = d;
+
+		valid |= (uint64_t)(d > h->min_depth && d <= h->max_depth) << i;
+	}
+
+	b->valid = valid;
+}
+
+//exponential smoothing, reset on motion (difference above threshold), holes filled for persistence frames
+//step is rounded up in magnitude, symmetric for both directions and reaching new depth exactly
+//history keeps full precision, it is not masked with the depth format mask again
+static void hdu_temporal_scalar(const struct hdu *h, const uint16_t *depth, uint16_t *history, uint8_t *age, int n)
+{
+	const int mask = h->depth_mask, alpha = h->temporal_alpha;
+	const int threshold = h->temporal_threshold_raw, persistence = h->temporal_persistence;
+
+	//branch-free, vectorizes
+	for(int i=0;i<n;++i)
+	{
+		const int d = depth[i] & mask, p = history[i], a = age[i];
+		const int diff = d - p;
+		const int step = (abs(diff) * alpha + 255) >> 8;
+		const int smooth = p + (diff < 0 ? -step : step);
+		const int moved = (p == 0) | (diff > threshold) | (diff < -threshold);
+		const int hold = (d == 0) & (p != 0) & (a < persistence);
+
+		history[i] = d ? (moved ? d : smooth) : (hold ? p : 0);
+		age[i] = d ? 0 : a + hold;
+	}
+}
+
+//flying pixel rejection and bilateral smoothing over 4 neighbours for block pixels [begin, end)
+//neighbours without depth are ignored, center is block depth (possibly temporally filtered)
+static uint64_t hdu_edges_range(const struct hdu *h, const struct hdu_row *row, int c, int begin, int end, struct hdu_block *b)
+{
+	const float scale = h->depth_unit;
+	const float threshold = h->spatial_threshold > 0.0f ? h->spatial_threshold : __FLT_MAX__;
+	const float inv_sigma = h->spatial_sigma > 0.0f ? 1.0f / h->spatial_sigma : 0.0f;
+	const int mask = h->depth_mask;
+	uint64_t keep = 0;
+
+	for(int i=begin;i<end;++i)
+	{
+		const int x = c + i;
+		const float n[4] =
+		{
+			(row->depth_raw[x > 0 ? x - 1 : x] & mask) * scale,
+			(row->depth_raw[x + 1 < row->width ? x + 1 : x] & mask) * scale,
+			(row->depth_up[x] & mask) * scale,
+			(row->depth_down[x] & mask) * scale
+		};
+		const float z = b->z[i];
+		float jump = 0.0f, sum_w = 1.0f, sum_wz = z;
+
+		for(int k=0;k<4;++k)
+		{
+			const float dz = fabsf(z - n[k]);
+			const float w = n[k] > 0.0f && dz * inv_sigma < 1.0f ? 1.0f - dz * inv_sigma : 0.0f;
+
+			jump = n[k] > 0.0f && dz > jump ? dz : jump;
+			sum_w += w;
+			sum_wz += w * n[k];
+		}
+
+		keep |= (uint64_t)(jump <= threshold * z) << i;
+
+		if(inv_sigma > 0.0f && z > 0.0f)
+		{
+			const float ratio = sum_wz / (sum_w * z);
+			b->x[i] *= ratio;
+			b->y[i] *= ratio;
+			b->z[i] *= ratio;
+		}
+	}
+
+	return keep;
+}
+
+static uint64_t hdu_edges_scalar(const struct hdu *h, const struct hdu_row *row, int c, int n, struct hdu_block *b)
+{
+	return hdu_edges_range(h, row, c, 0, n, b);
+}
+
+//unaligned 4 byte load
+static inline uint32_t hdu_load32(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+//colors stages are instantiated for NV12 (planar 0) and YUV420P (planar 1) chroma layout
+static inline __attribute__((always_inline)) void hdu_colors_scalar_body(const struct hdu_row *row, int c, int n, struct hdu_block *b, int planar)
+{
 	uint8_t Y, R, G, B = 0;
 	uint16_t UV = 0;
 
-	for(int r=0;r<depth->height;++r)
-		for(int c=0;c<depth->width && points < pc_size;++c)
-		{
-			d = depth->data[r * depth->depth_stride / 2 + c] * h->depth_unit;
-			//if (d <= h->min_depth || d > h->max_depth)
-			//	continue;
+	for(int i=0;i<n;++i, ++c)
+	{
+		// combine Y and UV values from NV12 here to RGBA color32 struct, U in low byte
+		Y = row->color_y[c];
+		UV = planar ? row->color_u[c / 2] | row->color_v[c / 2] << 8 : row->color_uv[c / 2];
 
-			pc->data[points][0] = d * (c - h->ppx) / h->fx;
-			pc->data[points][1] = -d * (r - h->ppy) / h->fy;
-			pc->data[points][2] = d;
+		// combine for RGB
+		R = YUV2R(Y, UV & 0xFF, UV >> 8);
+		G = YUV2G(Y, UV & 0xFF, UV >> 8);
+		B = YUV2B(Y, UV & 0xFF, UV >> 8);
 
-			// TODO debug point
-			//if (r==120 && c==160)
-			//	LOGI("pc point: %d: (%f, %f, %f)", points, pc->data[points][0], pc->data[points][1], pc->data[points][2]);
+		//b->colors[i] = (R << 24) | (G << 16) | (B << 8) | 0xFF; // big-endian
+		b->colors[i] = (0xFF << 24) | (B << 16) | (G << 8) | (R & 0xFF); // little-endian
+	}
+}
 
-			if (depth->colors)
-			{
-				// combine Y and UV values from NV12 here to RGBA color32 struct
-				Y = colorY[r * depth->color_stride + c];
-				UV = colorUV[(r / 2) * (depth->color_stride / 2) + (c / 2)];
+static void hdu_colors_scalar(const struct hdu_row *row, int c, int n, struct hdu_block *b)
+{
+	hdu_colors_scalar_body(row, c, n, b, 0);
+}
 
-				// combine for RGB
-				R = YUV2R(Y, UV >> 8, UV & 0xFF);
-				G = YUV2G(Y, UV >> 8, UV & 0xFF);
-				B = YUV2B(Y, UV >> 8, UV & 0xFF);
+static void hdu_colors_planar_scalar(const struct hdu_row *row, int c, int n, struct hdu_block *b)
+{
+	hdu_colors_scalar_body(row, c, n, b, 1);
+}
 
-				//pc->colors[points] = (R << 24) | (G << 16) | (B << 8) | 0xFF; // big-endian
-				pc->colors[points] = (0xFF << 24) | (B << 16) | (G << 8) | (R & 0xFF); // little-endian
-			}
-			else
-			{
-				pc->colors[points] = default_color;
-			}
+//branch-free compaction, invalid points are overwritten by the next one
+static int hdu_store_scalar(const struct hdu_block *b, int n, float3 *data, color32 *colors)
+{
+	int points = 0;
 
-			++points;
-		}
+	for(int i=0;i<n;++i)
+	{
+		data[points][0] = b->x[i];
+		data[points][1] = b->y[i];
+		data[points][2] = b->z[i];
+		colors[points] = b->colors[i];
 
-	pc->used = points;
-	return;
+		points += (b->valid >> i) & 1;
+	}
+
+	return points;
+}
+
+//byte shuffles packing 32 bit lanes selected by 4 bit mask to the front
+static const uint8_t HDU_LEFT_PACK[16][16] __attribute__((aligned(16))) =
+{
+	{0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+	{0x00, 0x01, 0x02, 0x03, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+	{0x04, 0x05, 0x06, 0x07, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+	{0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+	{0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+	{0x00, 0x01, 0x02, 0x03, 0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+	{0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+	{0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80},
+	{0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+	{0x00, 0x01, 0x02, 0x03, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+	{0x04, 0x05, 0x06, 0x07, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+	{0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80},
+	{0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+	{0x00, 0x01, 0x02, 0x03, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80},
+	{0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80},
+	{0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F}
+};
+
+static const struct hdu_kernel HDU_KERNEL_SCALAR =
+	{"scalar", hdu_positions_scalar, hdu_colors_scalar, hdu_colors_planar_scalar, hdu_store_scalar, hdu_temporal_scalar, hdu_edges_scalar};
+
+#if defined(__x86_64__) || defined(__i386__)
+
+//SSE4.1 for 32 bit integer multiply/min/max, compiled for target regardless of global flags
+#define HDU_SSE41 __attribute__((target("sse4.1")))
+#define HDU_AVX2 __attribute__((target("avx2")))
+
+static HDU_SSE41 void hdu_positions_sse41(const struct hdu *h, const struct hdu_row *row, int c, int n, struct hdu_block *b)
+{
+	const __m128 unit = _mm_set1_ps(h->depth_unit);
+	const __m128i bits = _mm_set1_epi16((short)row->mask);
+	const __m128 min = _mm_set1_ps(h->min_depth);
+	const __m128 max = _mm_set1_ps(h->max_depth);
+	uint64_t valid = 0;
+	int i = 0;
+
+	for(;i + 4 <= n;i += 4, c += 4)
+	{
+		__m128 d = _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_and_si128(_mm_loadl_epi64((const __m128i*)(row->depth + c)), bits)));
+		d = _mm_mul_ps(d, unit);
+
+		_mm_store_ps(b->x + i, _mm_mul_ps(d, _mm_loadu_ps(row->ray_x + c)));
+		_mm_store_ps(b->y + i, _mm_mul_ps(d, _mm_loadu_ps(row->ray_y + c)));
+		_mm_store_ps(b->z + i, d);
+
+		valid |= (uint64_t)_mm_movemask_ps(_mm_and_ps(_mm_cmpgt_ps(d, min), _mm_cmple_ps(d, max))) << i;
+	}
+
+	if(i < n)
+	{
+		struct hdu_block tail;
+		hdu_positions_scalar(h, row, c, n - i, &tail);
+		memcpy(b->x + i, tail.x, (n - i) * sizeof(float));
+		memcpy(b->y + i, tail.y, (n - i) * sizeof(float));
+		memcpy(b->z + i, tail.z, (n - i) * sizeof(float));
+		valid |= tail.valid << i;
+	}
+
+	b->valid = valid;
+}
+
+//R, G, B in 0-255 from 32 bit Y, U, V lanes
+static HDU_SSE41 __m128i hdu_yuv2rgba_sse41(__m128i Y, __m128i U, __m128i V)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i max = _mm_set1_epi32(255);
+	const __m128i round = _mm_set1_epi32(128);
+	const __m128i C = _mm_mullo_epi32(_mm_sub_epi32(Y, _mm_set1_epi32(16)), _mm_set1_epi32(298));
+	const __m128i D = _mm_sub_epi32(U, round);
+	const __m128i E = _mm_sub_epi32(V, round);
+
+	__m128i R = _mm_add_epi32(_mm_add_epi32(C, _mm_mullo_epi32(E, _mm_set1_epi32(409))), round);
+	__m128i G = _mm_sub_epi32(_mm_sub_epi32(C, _mm_mullo_epi32(D, _mm_set1_epi32(100))), _mm_mullo_epi32(E, _mm_set1_epi32(208)));
+	__m128i B = _mm_add_epi32(_mm_add_epi32(C, _mm_mullo_epi32(D, _mm_set1_epi32(516))), round);
+	G = _mm_add_epi32(G, round);
+
+	R = _mm_min_epi32(_mm_max_epi32(_mm_srai_epi32(R, 8), zero), max);
+	G = _mm_min_epi32(_mm_max_epi32(_mm_srai_epi32(G, 8), zero), max);
+	B = _mm_min_epi32(_mm_max_epi32(_mm_srai_epi32(B, 8), zero), max);
+
+	__m128i rgba = _mm_or_si128(R, _mm_slli_epi32(G, 8));
+	rgba = _mm_or_si128(rgba, _mm_slli_epi32(B, 16));
+	return _mm_or_si128(rgba, _mm_set1_epi32((int)0xFF000000));
+}
+
+static inline HDU_SSE41 __attribute__((always_inline)) void hdu_colors_sse41_body(const struct hdu_row *row, int c, int n, struct hdu_block *b, int planar)
+{
+	const __m128i mask = _mm_set1_epi32(0xFF);
+	int i = 0;
+
+	//c is even, each UV pair covers two pixels
+	for(;i + 8 <= n;i += 8, c += 8)
+	{
+		const __m128i y8 = _mm_loadl_epi64((const __m128i*)(row->color_y + c));
+		const __m128i uv = _mm_cvtepu16_epi32(planar ?
+			_mm_unpacklo_epi8(_mm_cvtsi32_si128(hdu_load32(row->color_u + c / 2)), _mm_cvtsi32_si128(hdu_load32(row->color_v + c / 2))) :
+			_mm_loadl_epi64((const __m128i*)(row->color_uv + c / 2)));
+		const __m128i uv_lo = _mm_unpacklo_epi32(uv, uv);
+		const __m128i uv_hi = _mm_unpackhi_epi32(uv, uv);
+
+		_mm_store_si128((__m128i*)(b->colors + i), hdu_yuv2rgba_sse41(_mm_cvtepu8_epi32(y8),
+			_mm_and_si128(uv_lo, mask), _mm_srli_epi32(uv_lo, 8)));
+		_mm_store_si128((__m128i*)(b->colors + i + 4), hdu_yuv2rgba_sse41(_mm_cvtepu8_epi32(_mm_srli_si128(y8, 4)),
+			_mm_and_si128(uv_hi, mask), _mm_srli_epi32(uv_hi, 8)));
+	}
+
+	if(i < n)
+	{
+		struct hdu_block tail;
+		hdu_colors_scalar_body(row, c, n - i, &tail, planar);
+		memcpy(b->colors + i, tail.colors, (n - i) * sizeof(color32));
+	}
+}
+
+static HDU_SSE41 void hdu_temporal_sse41(const struct hdu *h, const uint16_t *depth, uint16_t *history, uint8_t *age, int n)
+{
+	const __m128i mask = _mm_set1_epi16((short)h->depth_mask);
+	const __m128i alpha = _mm_set1_epi32(h->temporal_alpha);
+	const __m128i threshold = _mm_set1_epi32(h->temporal_threshold_raw);
+	const __m128i persistence = _mm_set1_epi32(h->temporal_persistence);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128i round = _mm_set1_epi32(255);
+	int i = 0;
+
+	for(;i + 4 <= n;i += 4)
+	{
+		const __m128i d = _mm_cvtepu16_epi32(_mm_and_si128(_mm_loadl_epi64((const __m128i*)(depth + i)), mask));
+		const __m128i p = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)(history + i)));
+		const __m128i a = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(hdu_load32(age + i)));
+		const __m128i diff = _mm_sub_epi32(d, p);
+		const __m128i step = _mm_srli_epi32(_mm_add_epi32(_mm_mullo_epi32(_mm_abs_epi32(diff), alpha), round), 8);
+		const __m128i smooth = _mm_add_epi32(p, _mm_sign_epi32(step, diff));
+		const __m128i p0 = _mm_cmpeq_epi32(p, zero);
+		const __m128i d0 = _mm_cmpeq_epi32(d, zero);
+		const __m128i moved = _mm_or_si128(p0, _mm_cmpgt_epi32(_mm_abs_epi32(diff), threshold));
+		const __m128i hold = _mm_andnot_si128(p0, _mm_and_si128(d0, _mm_cmplt_epi32(a, persistence)));
+
+		__m128i out = _mm_blendv_epi8(smooth, d, moved);
+		out = _mm_blendv_epi8(out, _mm_and_si128(hold, p), d0);
+
+		const __m128i new_age = _mm_and_si128(d0, _mm_add_epi32(a, _mm_and_si128(hold, one)));
+		const uint32_t age4 = (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(_mm_packus_epi32(new_age, zero), zero));
+
+		_mm_storel_epi64((__m128i*)(history + i), _mm_packus_epi32(out, zero));
+		memcpy(age + i, &age4, sizeof(age4));
+	}
+
+	if(i < n)
+		hdu_temporal_scalar(h, depth + i, history + i, age + i, n - i);
+}
+
+static inline HDU_SSE41 __m128 hdu_depth4_sse41(const uint16_t *depth, __m128i mask, __m128 scale)
+{
+	return _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_and_si128(_mm_loadl_epi64((const __m128i*)depth), mask))), scale);
+}
+
+static HDU_SSE41 uint64_t hdu_edges_sse41(const struct hdu *h, const struct hdu_row *row, int c, int n, struct hdu_block *b)
+{
+	const __m128 scale = _mm_set1_ps(h->depth_unit);
+	const __m128i mask = _mm_set1_epi16((short)h->depth_mask);
+	const __m128 threshold = _mm_set1_ps(h->spatial_threshold > 0.0f ? h->spatial_threshold : __FLT_MAX__);
+	const __m128 inv_sigma = _mm_set1_ps(h->spatial_sigma > 0.0f ? 1.0f / h->spatial_sigma : 0.0f);
+	const __m128 abs = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	//columns with both horizontal neighbours inside the row, vectors are unaligned at row start
+	const int begin = c == 0 ? 1 : 0;
+	const int end = c + n < row->width ? n : n - 1;
+	uint64_t keep = hdu_edges_range(h, row, c, 0, begin, b);
+	int i = begin;
+
+	for(;i + 4 <= end;i += 4)
+	{
+		const int x = c + i;
+		const __m128 nb[4] =
+		{
+			hdu_depth4_sse41(row->depth_raw + x - 1, mask, scale),
+			hdu_depth4_sse41(row->depth_raw + x + 1, mask, scale),
+			hdu_depth4_sse41(row->depth_up + x, mask, scale),
+			hdu_depth4_sse41(row->depth_down + x, mask, scale)
+		};
+		const __m128 z = _mm_loadu_ps(b->z + i);
+		__m128 jump = zero, sum_w = one, sum_wz = z;
+
+		for(int k=0;k<4;++k)
+		{
+			const __m128 present = _mm_cmpgt_ps(nb[k], zero);
+			const __m128 dz = _mm_and_ps(_mm_sub_ps(z, nb[k]), abs);
+			const __m128 w = _mm_and_ps(present, _mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(dz, inv_sigma)), zero));
+
+			jump = _mm_max_ps(jump, _mm_and_ps(present, dz));
+			sum_w = _mm_add_ps(sum_w, w);
+			sum_wz = _mm_add_ps(sum_wz, _mm_mul_ps(w, nb[k]));
+		}
+
+		keep |= (uint64_t)_mm_movemask_ps(_mm_cmple_ps(jump, _mm_mul_ps(threshold, z))) << i;
+
+		if(h->spatial_sigma > 0.0f)
+		{
+			const __m128 ratio = _mm_blendv_ps(one, _mm_div_ps(sum_wz, _mm_mul_ps(sum_w, z)), _mm_cmpgt_ps(z, zero));
+			_mm_storeu_ps(b->x + i, _mm_mul_ps(_mm_loadu_ps(b->x + i), ratio));
+			_mm_storeu_ps(b->y + i, _mm_mul_ps(_mm_loadu_ps(b->y + i), ratio));
+			_mm_storeu_ps(b->z + i, _mm_mul_ps(z, ratio));
+		}
+	}
+
+	return keep | hdu_edges_range(h, row, c, i, n, b);
+}
+
+static HDU_SSE41 void hdu_colors_sse41(const struct hdu_row *row, int c, int n, struct hdu_block *b)
+{
+	hdu_colors_sse41_body(row, c, n, b, 0);
+}
+
+static HDU_SSE41 void hdu_colors_planar_sse41(const struct hdu_row *row, int c, int n, struct hdu_block *b)
+{
+	hdu_colors_sse41_body(row, c, n, b, 1);
+}
+
+//interleave 4 points into 3 vectors: x0y0z0x1 y1z1x2y2 z2x3y3z3
+static HDU_SSE41 void hdu_store_xyz_sse41(float *out, __m128 x, __m128 y, __m128 z)
+{
+	const __m128 xy01 = _mm_unpacklo_ps(x, y);
+	const __m128 xy23 = _mm_unpackhi_ps(x, y);
+	const __m128 t0 = _mm_shuffle_ps(z, xy01, _MM_SHUFFLE(2, 2, 0, 0));
+	const __m128 t1 = _mm_shuffle_ps(xy01, z, _MM_SHUFFLE(1, 1, 3, 3));
+	const __m128 t2 = _mm_shuffle_ps(z, xy23, _MM_SHUFFLE(2, 2, 2, 2));
+	const __m128 t3 = _mm_shuffle_ps(xy23, z, _MM_SHUFFLE(3, 3, 3, 3));
+
+	_mm_storeu_ps(out, _mm_shuffle_ps(xy01, t0, _MM_SHUFFLE(2, 0, 1, 0)));
+	_mm_storeu_ps(out + 4, _mm_shuffle_ps(t1, xy23, _MM_SHUFFLE(1, 0, 2, 0)));
+	_mm_storeu_ps(out + 8, _mm_shuffle_ps(t2, t3, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+static HDU_SSE41 int hdu_store_sse41(const struct hdu_block *b, int n, float3 *data, color32 *colors)
+{
+	const uint64_t all = n == HDU_BLOCK ? ~(uint64_t)0 : ((uint64_t)1 << n) - 1;
+	int i = 0, points = 0;
+
+	if((b->valid & all) == all)
+	{	//common case, nothing to compact
+		for(;i + 4 <= n;i += 4)
+			hdu_store_xyz_sse41((float*)(data + i), _mm_load_ps(b->x + i), _mm_load_ps(b->y + i), _mm_load_ps(b->z + i));
+
+		memcpy(colors, b->colors, i * sizeof(colors[0]));
+		points = i;
+	}
+	else
+		for(;i + 4 <= n;i += 4)
+		{	//branch-free, packs valid lanes to the front and stores all 4, the next group overwrites the rest
+			const uint32_t mask = (b->valid >> i) & 0xF;
+			const __m128i shuffle = _mm_load_si128((const __m128i*)HDU_LEFT_PACK[mask]);
+			const __m128 x = _mm_castsi128_ps(_mm_shuffle_epi8(_mm_castps_si128(_mm_load_ps(b->x + i)), shuffle));
+			const __m128 y = _mm_castsi128_ps(_mm_shuffle_epi8(_mm_castps_si128(_mm_load_ps(b->y + i)), shuffle));
+			const __m128 z = _mm_castsi128_ps(_mm_shuffle_epi8(_mm_castps_si128(_mm_load_ps(b->z + i)), shuffle));
+
+			hdu_store_xyz_sse41((float*)(data + points), x, y, z);
+			_mm_storeu_si128((__m128i*)(colors + points), _mm_shuffle_epi8(_mm_load_si128((const __m128i*)(b->colors + i)), shuffle));
+
+			points += __builtin_popcount(mask);
+		}
+
+	for(;i<n;++i)
+	{
+		data[points][0] = b->x[i];
+		data[points][1] = b->y[i];
+		data[points][2] = b->z[i];
+		colors[points] = b->colors[i];
+
+		points += (b->valid >> i) & 1;
+	}
+
+	return points;
+}
+
+static HDU_AVX2 void hdu_positions_avx2(const struct hdu *h, const struct hdu_row *row, int c, int n, struct hdu_block *b)
+{
+	const __m256 unit = _mm256_set1_ps(h->depth_unit);
+	const __m128i bits = _mm_set1_epi16((short)row->mask);
+	const __m256 min = _mm256_set1_ps(h->min_depth);
+	const __m256 max = _mm256_set1_ps(h->max_depth);
+	uint64_t valid = 0;
+	int i = 0;
+
+	for(;i + 8 <= n;i += 8, c += 8)
+	{
+		__m256 d = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i*)(row->depth + c)), bits)));
+		d = _mm256_mul_ps(d, unit);
+
+		_mm256_store_ps(b->x + i, _mm256_mul_ps(d, _mm256_loadu_ps(row->ray_x + c)));
+		_mm256_store_ps(b->y + i, _mm256_mul_ps(d, _mm256_loadu_ps(row->ray_y + c)));
+		_mm256_store_ps(b->z + i, d);
+
+		const __m256 in = _mm256_and_ps(_mm256_cmp_ps(d, min, _CMP_GT_OQ), _mm256_cmp_ps(d, max, _CMP_LE_OQ));
+		valid |= (uint64_t)_mm256_movemask_ps(in) << i;
+	}
+
+	if(i < n)
+	{
+		struct hdu_block tail;
+		hdu_positions_scalar(h, row, c, n - i, &tail);
+		memcpy(b->x + i, tail.x, (n - i) * sizeof(float));
+		memcpy(b->y + i, tail.y, (n - i) * sizeof(float));
+		memcpy(b->z + i, tail.z, (n - i) * sizeof(float));
+		valid |= tail.valid << i;
+	}
+
+	b->valid = valid;
+}
+
+static inline HDU_AVX2 __attribute__((always_inline)) void hdu_colors_avx2_body(const struct hdu_row *row, int c, int n, struct hdu_block *b, int planar)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i max = _mm256_set1_epi32(255);
+	const __m256i round = _mm256_set1_epi32(128);
+	const __m256i mask = _mm256_set1_epi32(0xFF);
+	int i = 0;
+
+	//c is even, each UV pair covers two pixels
+	for(;i + 8 <= n;i += 8, c += 8)
+	{
+		const __m128i uv4 = planar ?
+			_mm_unpacklo_epi8(_mm_cvtsi32_si128(hdu_load32(row->color_u + c / 2)), _mm_cvtsi32_si128(hdu_load32(row->color_v + c / 2))) :
+			_mm_loadl_epi64((const __m128i*)(row->color_uv + c / 2));
+		const __m256i uv = _mm256_cvtepu16_epi32(_mm_unpacklo_epi16(uv4, uv4));
+		const __m256i Y = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(row->color_y + c)));
+		const __m256i C = _mm256_mullo_epi32(_mm256_sub_epi32(Y, _mm256_set1_epi32(16)), _mm256_set1_epi32(298));
+		const __m256i D = _mm256_sub_epi32(_mm256_and_si256(uv, mask), round);
+		const __m256i E = _mm256_sub_epi32(_mm256_srli_epi32(uv, 8), round);
+
+		__m256i R = _mm256_add_epi32(_mm256_add_epi32(C, _mm256_mullo_epi32(E, _mm256_set1_epi32(409))), round);
+		__m256i G = _mm256_sub_epi32(_mm256_sub_epi32(C, _mm256_mullo_epi32(D, _mm256_set1_epi32(100))), _mm256_mullo_epi32(E, _mm256_set1_epi32(208)));
+		__m256i B = _mm256_add_epi32(_mm256_add_epi32(C, _mm256_mullo_epi32(D, _mm256_set1_epi32(516))), round);
+		G = _mm256_add_epi32(G, round);
+
+		R = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(R, 8), zero), max);
+		G = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(G, 8), zero), max);
+		B = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(B, 8), zero), max);
+
+		__m256i rgba = _mm256_or_si256(R, _mm256_slli_epi32(G, 8));
+		rgba = _mm256_or_si256(rgba, _mm256_slli_epi32(B, 16));
+		_mm256_store_si256((__m256i*)(b->colors + i), _mm256_or_si256(rgba, _mm256_set1_epi32((int)0xFF000000)));
+	}
+
+	if(i < n)
+	{
+		struct hdu_block tail;
+		hdu_colors_scalar_body(row, c, n - i, &tail, planar);
+		memcpy(b->colors + i, tail.colors, (n - i) * sizeof(color32));
+	}
+}
+
+static HDU_AVX2 void hdu_colors_avx2(const struct hdu_row *row, int c, int n, struct hdu_block *b)
+{
+	hdu_colors_avx2_body(row, c, n, b, 0);
+}
+
+static HDU_AVX2 void hdu_colors_planar_avx2(const struct hdu_row *row, int c, int n, struct hdu_block *b)
+{
+	hdu_colors_avx2_body(row, c, n, b, 1);
+}
+
+static const struct hdu_kernel HDU_KERNEL_SSE41 =
+	{"sse4.1", hdu_positions_sse41, hdu_colors_sse41, hdu_colors_planar_sse41, hdu_store_sse41, hdu_temporal_sse41, hdu_edges_sse41};
+static const struct hdu_kernel HDU_KERNEL_AVX2 =
+	{"avx2", hdu_positions_avx2, hdu_colors_avx2, hdu_colors_planar_avx2, hdu_store_sse41, hdu_temporal_sse41, hdu_edges_sse41};
+
+#endif // x86
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+//4 bit mask from all ones/zeroes lanes
+static inline uint32_t hdu_movemask_neon(uint32x4_t m)
+{
+	static const uint32_t bits[4] = {1, 2, 4, 8};
+	const uint32x4_t v = vandq_u32(m, vld1q_u32(bits));
+#if defined(__aarch64__)
+	return vaddvq_u32(v);
+#else
+	const uint32x2_t p = vpadd_u32(vget_low_u32(v), vget_high_u32(v));
+	return vget_lane_u32(vpadd_u32(p, p), 0);
+#endif
+}
+
+//moves 32 bit lanes selected by mask to the front
+static inline uint8x16_t hdu_left_pack_neon(uint8x16_t v, uint32_t mask)
+{
+	const uint8x16_t idx = vld1q_u8(HDU_LEFT_PACK[mask]);
+#if defined(__aarch64__)
+	return vqtbl1q_u8(v, idx);
+#else
+	const uint8x8x2_t t = {{vget_low_u8(v), vget_high_u8(v)}};
+	return vcombine_u8(vtbl2_u8(t, vget_low_u8(idx)), vtbl2_u8(t, vget_high_u8(idx)));
+#endif
+}
+
+static void hdu_positions_neon(const struct hdu *h, const struct hdu_row *row, int c, int n, struct hdu_block *b)
+{
+	const float32x4_t unit = vdupq_n_f32(h->depth_unit);
+	const uint16x4_t bits = vdup_n_u16(row->mask);
+	const float32x4_t min = vdupq_n_f32(h->min_depth);
+	const float32x4_t max = vdupq_n_f32(h->max_depth);
+	uint64_t valid = 0;
+	int i = 0;
+
+	for(;i + 4 <= n;i += 4, c += 4)
+	{
+		const float32x4_t d = vmulq_f32(vcvtq_f32_u32(vmovl_u16(vand_u16(vld1_u16(row->depth + c), bits))), unit);
+
+		vst1q_f32(b->x + i, vmulq_f32(d, vld1q_f32(row->ray_x + c)));
+		vst1q_f32(b->y + i, vmulq_f32(d, vld1q_f32(row->ray_y + c)));
+		vst1q_f32(b->z + i, d);
+
+		valid |= (uint64_t)hdu_movemask_neon(vandq_u32(vcgtq_f32(d, min), vcleq_f32(d, max))) << i;
+	}
+
+	if(i < n)
+	{
+		struct hdu_block tail;
+		hdu_positions_scalar(h, row, c, n - i, &tail);
+		memcpy(b->x + i, tail.x, (n - i) * sizeof(float));
+		memcpy(b->y + i, tail.y, (n - i) * sizeof(float));
+		memcpy(b->z + i, tail.z, (n - i) * sizeof(float));
+		valid |= tail.valid << i;
+	}
+
+	b->valid = valid;
+}
+
+//R, G, B in 0-255 from 32 bit Y, U, V lanes
+static inline uint32x4_t hdu_yuv2rgba_neon(int32x4_t Y, int32x4_t U, int32x4_t V)
+{
+	const int32x4_t zero = vdupq_n_s32(0);
+	const int32x4_t max = vdupq_n_s32(255);
+	const int32x4_t round = vdupq_n_s32(128);
+	const int32x4_t C = vmulq_n_s32(vsubq_s32(Y, vdupq_n_s32(16)), 298);
+	const int32x4_t D = vsubq_s32(U, round);
+	const int32x4_t E = vsubq_s32(V, round);
+
+	int32x4_t R = vaddq_s32(vmlaq_n_s32(C, E, 409), round);
+	int32x4_t G = vaddq_s32(vmlsq_n_s32(vmlsq_n_s32(C, D, 100), E, 208), round);
+	int32x4_t B = vaddq_s32(vmlaq_n_s32(C, D, 516), round);
+
+	R = vminq_s32(vmaxq_s32(vshrq_n_s32(R, 8), zero), max);
+	G = vminq_s32(vmaxq_s32(vshrq_n_s32(G, 8), zero), max);
+	B = vminq_s32(vmaxq_s32(vshrq_n_s32(B, 8), zero), max);
+
+	uint32x4_t rgba = vorrq_u32(vreinterpretq_u32_s32(R), vshlq_n_u32(vreinterpretq_u32_s32(G), 8));
+	rgba = vorrq_u32(rgba, vshlq_n_u32(vreinterpretq_u32_s32(B), 16));
+	return vorrq_u32(rgba, vdupq_n_u32(0xFF000000));
+}
+
+static inline __attribute__((always_inline)) void hdu_colors_neon_body(const struct hdu_row *row, int c, int n, struct hdu_block *b, int planar)
+{
+	const uint32x4_t mask = vdupq_n_u32(0xFF);
+	int i = 0;
+
+	//c is even, each UV pair covers two pixels
+	for(;i + 8 <= n;i += 8, c += 8)
+	{
+		const uint16x8_t y8 = vmovl_u8(vld1_u8(row->color_y + c));
+		const uint16x4_t uv4 = planar ?
+			vreinterpret_u16_u8(vzip_u8(vcreate_u8(hdu_load32(row->color_u + c / 2)), vcreate_u8(hdu_load32(row->color_v + c / 2))).val[0]) :
+			vld1_u16(row->color_uv + c / 2);
+		const uint16x4x2_t uv = vzip_u16(uv4, uv4);
+		const uint32x4_t uv_lo = vmovl_u16(uv.val[0]);
+		const uint32x4_t uv_hi = vmovl_u16(uv.val[1]);
+
+		vst1q_u32(b->colors + i, hdu_yuv2rgba_neon(vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(y8))),
+			vreinterpretq_s32_u32(vandq_u32(uv_lo, mask)), vreinterpretq_s32_u32(vshrq_n_u32(uv_lo, 8))));
+		vst1q_u32(b->colors + i + 4, hdu_yuv2rgba_neon(vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(y8))),
+			vreinterpretq_s32_u32(vandq_u32(uv_hi, mask)), vreinterpretq_s32_u32(vshrq_n_u32(uv_hi, 8))));
+	}
+
+	if(i < n)
+	{
+		struct hdu_block tail;
+		hdu_colors_scalar_body(row, c, n - i, &tail, planar);
+		memcpy(b->colors + i, tail.colors, (n - i) * sizeof(color32));
+	}
+}
+
+static void hdu_colors_neon(const struct hdu_row *row, int c, int n, struct hdu_block *b)
+{
+	hdu_colors_neon_body(row, c, n, b, 0);
+}
+
+static void hdu_colors_planar_neon(const struct hdu_row *row, int c, int n, struct hdu_block *b)
+{
+	hdu_colors_neon_body(row, c, n, b, 1);
+}
+
+static void hdu_temporal_neon(const struct hdu *h, const uint16_t *depth, uint16_t *history, uint8_t *age, int n)
+{
+	const uint16x4_t mask = vdup_n_u16(h->depth_mask);
+	const int32x4_t alpha = vdupq_n_s32(h->temporal_alpha);
+	const int32x4_t threshold = vdupq_n_s32(h->temporal_threshold_raw);
+	const int32x4_t persistence = vdupq_n_s32(h->temporal_persistence);
+	const int32x4_t zero = vdupq_n_s32(0);
+	const int32x4_t round = vdupq_n_s32(255);
+	int i = 0;
+
+	for(;i + 4 <= n;i += 4)
+	{
+		const int32x4_t d = vreinterpretq_s32_u32(vmovl_u16(vand_u16(vld1_u16(depth + i), mask)));
+		const int32x4_t p = vreinterpretq_s32_u32(vmovl_u16(vld1_u16(history + i)));
+		const int32x4_t a = vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(vmovl_u8(vcreate_u8(hdu_load32(age + i))))));
+		const int32x4_t diff = vsubq_s32(d, p);
+		const int32x4_t step = vshrq_n_s32(vaddq_s32(vmulq_s32(vabsq_s32(diff), alpha), round), 8);
+		const int32x4_t smooth = vbslq_s32(vcltq_s32(diff, zero), vsubq_s32(p, step), vaddq_s32(p, step));
+		const uint32x4_t p0 = vceqq_s32(p, zero);
+		const uint32x4_t d0 = vceqq_s32(d, zero);
+		const uint32x4_t moved = vorrq_u32(p0, vcgtq_s32(vabsq_s32(diff), threshold));
+		const uint32x4_t hold = vbicq_u32(vandq_u32(d0, vcltq_s32(a, persistence)), p0);
+
+		int32x4_t out = vbslq_s32(moved, d, smooth);
+		out = vbslq_s32(d0, vandq_s32(vreinterpretq_s32_u32(hold), p), out);
+
+		//hold lanes are all ones (-1), subtracting adds one
+		const int32x4_t new_age = vandq_s32(vreinterpretq_s32_u32(d0), vsubq_s32(a, vreinterpretq_s32_u32(hold)));
+		const uint32_t age4 = vget_lane_u32(vreinterpret_u32_u8(vqmovn_u16(vcombine_u16(vqmovun_s32(new_age), vdup_n_u16(0)))), 0);
+
+		vst1_u16(history + i, vqmovun_s32(out));
+		memcpy(age + i, &age4, sizeof(age4));
+	}
+
+	if(i < n)
+		hdu_temporal_scalar(h, depth + i, history + i, age + i, n - i);
+}
+
+static inline float32x4_t hdu_depth4_neon(const uint16_t *depth, uint16x4_t mask, float32x4_t scale)
+{
+	return vmulq_f32(vcvtq_f32_u32(vmovl_u16(vand_u16(vld1_u16(depth), mask))), scale);
+}
+
+static uint64_t hdu_edges_neon(const struct hdu *h, const struct hdu_row *row, int c, int n, struct hdu_block *b)
+{
+	const float32x4_t scale = vdupq_n_f32(h->depth_unit);
+	const uint16x4_t mask = vdup_n_u16(h->depth_mask);
+	const float32x4_t threshold = vdupq_n_f32(h->spatial_threshold > 0.0f ? h->spatial_threshold : __FLT_MAX__);
+	const float32x4_t inv_sigma = vdupq_n_f32(h->spatial_sigma > 0.0f ? 1.0f / h->spatial_sigma : 0.0f);
+	const float32x4_t zero = vdupq_n_f32(0.0f);
+	const float32x4_t one = vdupq_n_f32(1.0f);
+	const uint32x4_t lane_bits = {1, 2, 4, 8};
+	//columns with both horizontal neighbours inside the row
+	const int begin = c == 0 ? 1 : 0;
+	const int end = c + n < row->width ? n : n - 1;
+	uint64_t keep = hdu_edges_range(h, row, c, 0, begin, b);
+	int i = begin;
+
+	for(;i + 4 <= end;i += 4)
+	{
+		const int x = c + i;
+		const float32x4_t nb[4] =
+		{
+			hdu_depth4_neon(row->depth_raw + x - 1, mask, scale),
+			hdu_depth4_neon(row->depth_raw + x + 1, mask, scale),
+			hdu_depth4_neon(row->depth_up + x, mask, scale),
+			hdu_depth4_neon(row->depth_down + x, mask, scale)
+		};
+		const float32x4_t z = vld1q_f32(b->z + i);
+		float32x4_t jump = zero, sum_w = one, sum_wz = z;
+
+		for(int k=0;k<4;++k)
+		{
+			const uint32x4_t present = vcgtq_f32(nb[k], zero);
+			const float32x4_t dz = vabdq_f32(z, nb[k]);
+			const float32x4_t w = vmaxq_f32(vmlsq_f32(one, dz, inv_sigma), zero);
+
+			jump = vmaxq_f32(jump, vreinterpretq_f32_u32(vandq_u32(present, vreinterpretq_u32_f32(dz))));
+			sum_w = vaddq_f32(sum_w, vreinterpretq_f32_u32(vandq_u32(present, vreinterpretq_u32_f32(w))));
+			sum_wz = vaddq_f32(sum_wz, vreinterpretq_f32_u32(vandq_u32(present, vreinterpretq_u32_f32(vmulq_f32(w, nb[k])))));
+		}
+
+		const uint32x4_t in = vandq_u32(vcleq_f32(jump, vmulq_f32(threshold, z)), lane_bits);
+		keep |= (uint64_t)(vgetq_lane_u32(in, 0) | vgetq_lane_u32(in, 1) | vgetq_lane_u32(in, 2) | vgetq_lane_u32(in, 3)) << i;
+
+		if(h->spatial_sigma > 0.0f)
+		{	//true division, bit-exact with scalar reference
+			const float32x4_t den = vmulq_f32(sum_w, z);
+#if defined(__aarch64__)
+			const float32x4_t quotient = vdivq_f32(sum_wz, den);
+#else
+			float num_lanes[4], den_lanes[4];
+			vst1q_f32(num_lanes, sum_wz);
+			vst1q_f32(den_lanes, den);
+			for(int k=0;k<4;++k)
+				num_lanes[k] /= den_lanes[k];
+			const float32x4_t quotient = vld1q_f32(num_lanes);
+#endif
+			const float32x4_t ratio = vbslq_f32(vcgtq_f32(z, zero), quotient, one);
+			vst1q_f32(b->x + i, vmulq_f32(vld1q_f32(b->x + i), ratio));
+			vst1q_f32(b->y + i, vmulq_f32(vld1q_f32(b->y + i), ratio));
+			vst1q_f32(b->z + i, vmulq_f32(z, ratio));
+		}
+	}
+
+	return keep | hdu_edges_range(h, row, c, i, n, b);
+}
+
+static int hdu_store_neon(const struct hdu_block *b, int n, float3 *data, color32 *colors)
+{
+	const uint64_t all = n == HDU_BLOCK ? ~(uint64_t)0 : ((uint64_t)1 << n) - 1;
+	int i = 0, points = 0;
+
+	if((b->valid & all) == all)
+	{	//common case, nothing to compact
+		for(;i + 4 <= n;i += 4)
+		{
+			float32x4x3_t xyz = {{vld1q_f32(b->x + i), vld1q_f32(b->y + i), vld1q_f32(b->z + i)}};
+			vst3q_f32((float*)(data + i), xyz);
+		}
+
+		memcpy(colors, b->colors, i * sizeof(colors[0]));
+		points = i;
+	}
+	else
+		for(;i + 4 <= n;i += 4)
+		{	//branch-free, packs valid lanes to the front and stores all 4, the next group overwrites the rest
+			const uint32_t mask = (b->valid >> i) & 0xF;
+			float32x4x3_t xyz;
+
+			xyz.val[0] = vreinterpretq_f32_u8(hdu_left_pack_neon(vreinterpretq_u8_f32(vld1q_f32(b->x + i)), mask));
+			xyz.val[1] = vreinterpretq_f32_u8(hdu_left_pack_neon(vreinterpretq_u8_f32(vld1q_f32(b->y + i)), mask));
+			xyz.val[2] = vreinterpretq_f32_u8(hdu_left_pack_neon(vreinterpretq_u8_f32(vld1q_f32(b->z + i)), mask));
+
+			vst3q_f32((float*)(data + points), xyz);
+			vst1q_u32(colors + points, vreinterpretq_u32_u8(hdu_left_pack_neon(vreinterpretq_u8_u32(vld1q_u32(b->colors + i)), mask)));
+
+			points += __builtin_popcount(mask);
+		}
+
+	for(;i<n;++i)
+	{
+		data[points][0] = b->x[i];
+		data[points][1] = b->y[i];
+		data[points][2] = b->z[i];
+		colors[points] = b->colors[i];
+
+		points += (b->valid >> i) & 1;
+	}
+
+	return points;
+}
+
+static const struct hdu_kernel HDU_KERNEL_NEON =
+	{"neon", hdu_positions_neon, hdu_colors_neon, hdu_colors_planar_neon, hdu_store_neon, hdu_temporal_neon, hdu_edges_neon};
+
+#endif // NEON
+
+//IEEE 754 half precision, round to nearest even, small values flushed to zero
+static inline uint16_t hdu_half(float f)
+{
+#if defined(__ARM_FP16_FORMAT_IEEE)
+	const __fp16 h = f;
+	uint16_t u;
+	memcpy(&u, &h, sizeof(u));
+	return u;
+#else
+	uint32_t x;
+	memcpy(&x, &f, sizeof(x));
+
+	const uint16_t sign = (x >> 16) & 0x8000;
+	x &= 0x7FFFFFFF;
+
+	if(x >= 0x47800000) //overflow, inf or nan
+		return sign | (x > 0x7F800000 ? 0x7E00 : 0x7C00);
+	if(x < 0x38800000) //below half normal range
+		return sign;
+
+	//rebias exponent and round
+	x += 0xC8000FFF + ((x >> 13) & 1);
+	return sign | (x >> 13);
+#endif
+}
+
+//clamped and rounded to int16 range
+static inline int16_t hdu_short(float f)
+{
+	f = f < -32768.0f ? -32768.0f : f > 32767.0f ? 32767.0f : f;
+	return (int16_t)(f + (f >= 0.0f ? 0.5f : -0.5f));
+}
+
+//per format position writers, instantiated into hdu_store_compact by constant propagation
+typedef void (*hdu_write_fn)(const struct hdu *h, const struct hdu_block *b, int i, struct hdu_point_cloud *pc, int index);
+
+static inline void hdu_write_half4(const struct hdu *h, const struct hdu_block *b, int i, struct hdu_point_cloud *pc, int index)
+{
+	uint16_t *out = (uint16_t*)pc->data + 4 * index;
+
+	out[0] = hdu_half(b->x[i]);
+	out[1] = hdu_half(b->y[i]);
+	out[2] = hdu_half(b->z[i]);
+	out[3] = 0x3C00; // 1.0
+}
+
+static inline void hdu_write_short4(const struct hdu *h, const struct hdu_block *b, int i, struct hdu_point_cloud *pc, int index)
+{
+	int16_t *out = (int16_t*)pc->data + 4 * index;
+
+	out[0] = hdu_short((b->x[i] - h->position_offset[0]) * h->position_scale_inv);
+	out[1] = hdu_short((b->y[i] - h->position_offset[1]) * h->position_scale_inv);
+	out[2] = hdu_short((b->z[i] - h->position_offset[2]) * h->position_scale_inv);
+	out[3] = 0;
+}
+
+static inline void hdu_write_float3_color32(const struct hdu *h, const struct hdu_block *b, int i, struct hdu_point_cloud *pc, int index)
+{
+	struct hdu_vertex *out = (struct hdu_vertex*)pc->data + index;
+
+	out->position[0] = b->x[i];
+	out->position[1] = b->y[i];
+	out->position[2] = b->z[i];
+	out->color = b->colors[i]; //interleaved, written even without color output
+}
+
+static inline void hdu_write_soa(const struct hdu *h, const struct hdu_block *b, int i, struct hdu_point_cloud *pc, int index)
+{
+	float *x = (float*)pc->data;
+
+	x[index] = b->x[i];
+	x[pc->size + index] = b->y[i];
+	x[2 * pc->size + index] = b->z[i];
+}
+
+//branch-free compaction, invalid points are overwritten by the next one
+static inline __attribute__((always_inline)) int hdu_store_compact(const struct hdu *h, const struct hdu_block *b, int n,
+	struct hdu_point_cloud *pc, int first, hdu_write_fn write, int colors)
+{
+	int points = first;
+
+	for(int i=0;i<n;++i)
+	{
+		write(h, b, i, pc, points);
+		if(colors)
+			pc->colors[points] = b->colors[i];
+		points += (b->valid >> i) & 1;
+	}
+
+	return points - first;
+}
+
+typedef int (*hdu_store_fn)(const struct hdu *h, const struct hdu_block *b, int n, struct hdu_point_cloud *pc, int first);
+
+//store stage for vertex format writer with (1) or without (0) separate colors
+#define HDU_STORE(name, write, colors) \
+	static int name(const struct hdu *h, const struct hdu_block *b, int n, struct hdu_point_cloud *pc, int first) \
+	{ return hdu_store_compact(h, b, n, pc, first, write, colors); }
+
+HDU_STORE(hdu_store_half4, hdu_write_half4, 1)
+HDU_STORE(hdu_store_half4_position, hdu_write_half4, 0)
+HDU_STORE(hdu_store_short4, hdu_write_short4, 1)
+HDU_STORE(hdu_store_short4_position, hdu_write_short4, 0)
+HDU_STORE(hdu_store_float3_color32, hdu_write_float3_color32, 0)
+HDU_STORE(hdu_store_soa, hdu_write_soa, 1)
+HDU_STORE(hdu_store_soa_position, hdu_write_soa, 0)
+
+static int hdu_store_float3(const struct hdu *h, const struct hdu_block *b, int n, struct hdu_point_cloud *pc, int first)
+{	//architecture specific
+	return h->kernel->store(b, n, pc->data + first, pc->colors + first);
+}
+
+static int hdu_store_float3_position(const struct hdu *h, const struct hdu_block *b, int n, struct hdu_point_cloud *pc, int first)
+{	//kernel store packs colors too, send them to scratch (vector stores may write 3 past n)
+	color32 scratch[HDU_BLOCK + 4];
+	return h->kernel->store(b, n, pc->data + first, scratch);
+}
+
+int hdu_vertex_size(int format)
+{
+	switch(format)
+	{
+		case HDU_VERTEX_FLOAT3: return sizeof(float3);
+		case HDU_VERTEX_HALF4: return 4 * sizeof(uint16_t);
+		case HDU_VERTEX_SHORT4: return 4 * sizeof(int16_t);
+		case HDU_VERTEX_FLOAT3_COLOR32: return sizeof(struct hdu_vertex);
+		case HDU_VERTEX_SOA: return 3 * sizeof(float);
+	}
+	return 0;
+}
+
+static int hdu_set_vertex_format(struct hdu *h, const struct hdu_config *c)
+{
+	static const hdu_store_fn stores[][2] = //[vertex_format][separate colors]
+	{
+		{hdu_store_float3_position, hdu_store_float3},
+		{hdu_store_half4_position, hdu_store_half4},
+		{hdu_store_short4_position, hdu_store_short4},
+		{hdu_store_float3_color32, hdu_store_float3_color32},
+		{hdu_store_soa_position, hdu_store_soa},
+	};
+
+	if(c->vertex_format < HDU_VERTEX_FLOAT3 || c->vertex_format > HDU_VERTEX_SOA)
+		return HDU_ERROR;
+
+	if(c->color_output < HDU_COLOR_RGBA || c->color_output > HDU_COLOR_NONE)
+		return HDU_ERROR;
+
+	if(c->vertex_format == HDU_VERTEX_SHORT4 && c->position_scale <= 0.0f)
+		return HDU_ERROR;
+
+	h->vertex_format = c->vertex_format;
+	h->color_output = c->color_output;
+	h->store = stores[c->vertex_format][c->color_output != HDU_COLOR_NONE];
+	h->position_scale_inv = c->vertex_format == HDU_VERTEX_SHORT4 ? 1.0f / c->position_scale : 1.0f;
+
+	for(int i=0;i<3;++i)
+		h->position_offset[i] = c->position_offset[i];
+
+	return HDU_OK;
+}
+
+//color sampled by projecting points to color camera (different sensor and resolution)
+static void hdu_set_registration(struct hdu *h, const struct hdu_config *c)
+{
+	const float K[3][3] = { {c->color_fx, 0.0f, c->color_ppx}, {0.0f, c->color_fy, c->color_ppy}, {0.0f, 0.0f, 1.0f} };
+	const float *R = c->color_rotation;
+	const float *t = c->color_translation;
+
+	if( (h->registration = c->color_fx > 0.0f && c->color_fy > 0.0f) == 0 )
+		return;
+
+	for(int i=0;i<3;++i)
+	{
+		for(int j=0;j<3;++j)
+			h->color_projection[i][j] = K[i][0] * R[j] + K[i][1] * R[3 + j] + K[i][2] * R[6 + j];
+
+		h->color_projection[i][3] = K[i][0] * t[0] + K[i][1] * t[1] + K[i][2] * t[2];
+		//unprojected y points up, camera y points down
+		h->color_projection[i][1] = -h->color_projection[i][1];
+	}
+}
+
+//moves count points from src to dst index (overlap allowed)
+static void hdu_move_points(const struct hdu *h, struct hdu_point_cloud *pc, int dst, int src, int count)
+{
+	const int size = hdu_vertex_size(h->vertex_format);
+
+	if(h->vertex_format == HDU_VERTEX_SOA)
+		for(int i=0;i<3;++i)
+		{
+			float *a = (float*)pc->data + i * pc->size;
+			memmove(a + dst, a + src, count * sizeof(float));
+		}
+	else
+		memmove((uint8_t*)pc->data + dst * size, (uint8_t*)pc->data + src * size, count * size);
+
+	if(h->vertex_format != HDU_VERTEX_FLOAT3_COLOR32 && h->color_output != HDU_COLOR_NONE)
+		memmove(pc->colors + dst, pc->colors + src, count * sizeof(pc->colors[0]));
+}
+
+//the best kernel supported by the CPU we are running on
+static const struct hdu_kernel *hdu_select_kernel()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+
+	if(__builtin_cpu_supports("avx2"))
+		return &HDU_KERNEL_AVX2;
+	if(__builtin_cpu_supports("sse4.1"))
+		return &HDU_KERNEL_SSE41;
+#elif defined(__aarch64__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+	return &HDU_KERNEL_NEON;
+#elif defined(__arm__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+	if(getauxval(AT_HWCAP) & HWCAP_NEON)
+		return &HDU_KERNEL_NEON;
+#endif
+	return &HDU_KERNEL_SCALAR;
+}
+
+//every stride-th pixel of the block starting at column c
+static uint64_t hdu_stride_mask(int c, int n, int stride)
+{
+	uint64_t mask = 0;
+
+	for(int i=(stride - c % stride) % stride;i<n;i+=stride)
+		mask |= (uint64_t)1 << i;
+
+	return mask;
+}
+
+//pixels of columns left to right - 1, tile is not entirely outside
+static uint64_t hdu_columns_mask(int c, int n, int left, int right)
+{
+	const int begin = left - c > 0 ? left - c : 0;
+	const int end = right - c < n ? right - c : n;
+
+	return (end == 64 ? ~(uint64_t)0 : ((uint64_t)1 << end) - 1) & ~(((uint64_t)1 << begin) - 1);
+}
+
+//power of two stride from depth so that near pixels are kept as sparse as distant ones
+static uint64_t hdu_depth_adaptive_mask(const struct hdu *h, const struct hdu_block *b, int r, int c, int n)
+{
+	const float spacing = h->voxel_size * h->fx;
+	uint64_t mask = 0;
+
+	for(int i=0;i<n;++i)
+	{
+		const float f = spacing / b->z[i];
+		const int k = f >= 16.0f ? 16 : f >= 8.0f ? 8 : f >= 4.0f ? 4 : f >= 2.0f ? 2 : 1;
+
+		mask |= (uint64_t)((((c + i) | r) & (k - 1)) == 0) << i;
+	}
+
+	return mask;
+}
+
+//depth pixels in range for rows skipped by decimation
+static int hdu_count_valid(const struct hdu *h, const struct hdu_row *row, int n)
+{
+	int valid = 0;
+
+	for(int i=0;i<n;++i)
+	{
+		const float d = (row->depth[i] & row->mask) * h->depth_unit;
+		valid += (d > h->min_depth) & (d <= h->max_depth);
+	}
+
+	return valid;
+}
+
+//normalized texture coordinates of pixel centers packed as unorm16 u (low) and v (high)
+static void hdu_uvs(const struct hdu_depth *depth, int r, int c, int n, struct hdu_block *b)
+{
+	const float su = 65535.0f / depth->width;
+	const uint32_t v = (uint32_t)((r + 0.5f) * (65535.0f / depth->height) + 0.5f) << 16;
+
+	for(int i=0;i<n;++i)
+		b->colors[i] = v | (int32_t)((c + i + 0.5f) * su + 0.5f); //signed conversion vectorizes
+}
+
+//color frame planes, chroma is NV12 interleaved or YUV420P U followed by V plane
+struct hdu_planes
+{
+	const uint8_t *y;
+	const uint8_t *uv; //NV12 interleaved chroma or YUV420P U plane
+	const uint8_t *v; //YUV420P V plane
+	int y_stride;
+	int uv_stride;
+	int width;
+	int height;
+};
+
+//missing chroma plane pointers are derived from contiguous frame layout
+static void hdu_color_planes(const struct hdu *h, const struct hdu_depth *depth, struct hdu_planes *p)
+{
+	const int planar = h->color_format == HDU_COLOR_FORMAT_YUV420P;
+
+	p->width = h->registration && depth->color_width ? depth->color_width : depth->width;
+	p->height = h->registration && depth->color_height ? depth->color_height : depth->height;
+	p->y = depth->colors;
+	p->y_stride = depth->color_stride;
+	p->uv_stride = depth->color_uv_stride ? depth->color_uv_stride : (planar ? depth->color_stride / 2 : depth->color_stride);
+	p->uv = depth->color_u ? depth->color_u : p->y + p->y_stride * p->height;
+	p->v = depth->color_v ? depth->color_v : p->uv + p->uv_stride * ((p->height + 1) / 2);
+}
+
+//colors (or color frame texture coordinates) of valid points reprojected to color camera
+static inline __attribute__((always_inline)) void hdu_registered_colors_body(const struct hdu *h, const struct hdu_planes *planes,
+	int n, struct hdu_block *b, int planar)
+{
+	const float (*P)[4] = h->color_projection;
+	const int width = planes->width;
+	const int height = planes->height;
+	const color32 default_color = 0xFFFFFFFF;
+	float u[HDU_BLOCK], v[HDU_BLOCK];
+
+	//static part is folded into single projection, this loop vectorizes
+	//coordinates are shifted by half pixel so that truncation picks the nearest pixel
+	for(int i=0;i<n;++i)
+	{
+		const float w = P[2][0] * b->x[i] + P[2][1] * b->y[i] + P[2][2] * b->z[i] + P[2][3];
+		const float inv = w > 0.0f ? 1.0f / w : 0.0f;
+
+		u[i] = (P[0][0] * b->x[i] + P[0][1] * b->y[i] + P[0][2] * b->z[i] + P[0][3]) * inv + 0.5f;
+		v[i] = w > 0.0f ? (P[1][0] * b->x[i] + P[1][1] * b->y[i] + P[1][2] * b->z[i] + P[1][3]) * inv + 0.5f : -1.0f;
+	}
+
+	if(h->color_output == HDU_COLOR_UV)
+	{	//clamped to color frame
+		const float su = 65535.0f / width, sv = 65535.0f / height;
+
+		for(int i=0;i<n;++i)
+		{
+			const float U = u[i] * su, V = v[i] * sv;
+			b->colors[i] = (uint32_t)(V < 0.0f ? 0 : V > 65535.0f ? 65535 : (int32_t)(V + 0.5f)) << 16 |
+				(uint32_t)(U < 0.0f ? 0 : U > 65535.0f ? 65535 : (int32_t)(U + 0.5f));
+		}
+		return;
+	}
+
+	for(int i=0;i<n;++i)
+	{
+		int cu, cv;
+		uint8_t Y;
+		uint16_t UV;
+		int R, G, B;
+
+		//also skips invalid points and points behind color camera
+		if(!((b->valid >> i) & 1) || !(u[i] >= 0.0f && u[i] < width && v[i] >= 0.0f && v[i] < height))
+		{
+			b->colors[i] = default_color;
+			continue;
+		}
+
+		cu = (int)u[i];
+		cv = (int)v[i];
+
+		Y = planes->y[cv * planes->y_stride + cu];
+		if(planar)
+			UV = planes->uv[(cv / 2) * planes->uv_stride + cu / 2] | planes->v[(cv / 2) * planes->uv_stride + cu / 2] << 8;
+		else
+			memcpy(&UV, planes->uv + (cv / 2) * planes->uv_stride + (cu / 2) * 2, sizeof(UV));
+
+		R = YUV2R(Y, UV & 0xFF, UV >> 8);
+		G = YUV2G(Y, UV & 0xFF, UV >> 8);
+		B = YUV2B(Y, UV & 0xFF, UV >> 8);
+
+		b->colors[i] = (0xFF << 24) | (B << 16) | (G << 8) | (R & 0xFF); // little-endian
+	}
+}
+
+static void hdu_registered_colors(const struct hdu *h, const struct hdu_planes *planes, int n, struct hdu_block *b)
+{
+	if(h->color_format == HDU_COLOR_FORMAT_YUV420P)
+		hdu_registered_colors_body(h, planes, n, b, 1);
+	else
+		hdu_registered_colors_body(h, planes, n, b, 0);
+}
+
+//sensor to world transform of block positions, vectorizes
+static void hdu_transform(const struct hdu *h, int n, struct hdu_block *b)
+{
+	const float (*T)[4] = h->pose;
+
+	for(int i=0;i<n;++i)
+	{
+		const float x = b->x[i], y = b->y[i], z = b->z[i];
+
+		b->x[i] = T[0][0] * x + T[0][1] * y + T[0][2] * z + T[0][3];
+		b->y[i] = T[1][0] * x + T[1][1] * y + T[1][2] * z + T[1][3];
+		b->z[i] = T[2][0] * x + T[2][1] * y + T[2][2] * z + T[2][3];
+	}
+}
+
+//grid step of mesh and normals, stride decimation reduces mesh resolution
+static inline int hdu_mesh_step(const struct hdu *h)
+{
+	return h->decimation == HDU_DECIMATION_STRIDE ? h->stride : 1;
+}
+
+//sensor depth of stored points for mesh topology, 0 for others
+static void hdu_mesh_depth(const struct hdu *h, const struct hdu_row *row, int c, int n, const struct hdu_block *b)
+{
+	float *z = h->mesh_z + row->r * row->width + c;
+
+	for(int i=0;i<n;++i)
+		z[i] = (b->valid >> i) & 1 ? b->z[i] : 0.0f;
+}
+
+//sensor point of pixel in decoded depth, center if invalid
+static inline void hdu_mesh_point(const struct hdu *h, const uint16_t *depth, const float *ray_x, const float *ray_y, int c,
+	const float *center, float *p)
+{
+	const float d = (depth[c] & h->depth_mask) * h->depth_unit;
+	const int valid = (d > h->min_depth) & (d <= h->max_depth);
+
+	p[0] = valid ? d * ray_x[c] : center[0];
+	p[1] = valid ? d * ray_y[c] : center[1];
+	p[2] = valid ? d : center[2];
+}
+
+//cross product of vertical and horizontal central differences (facing sensor), rotated with pose, 0 for not stored
+static void hdu_normals(const struct hdu *h, const struct hdu_depth *depth, const struct hdu_row *row, int c, int n,
+	const struct hdu_block *b, float3 *normals)
+{
+	const int s = hdu_mesh_step(h), r = row->r, w = depth->width;
+	const int up = r - s >= 0 ? r - s : r, down = r + s < depth->height ? r + s : r;
+	const uint16_t *depth_raw = row->depth_raw;
+	const uint16_t *depth_up = (const uint16_t*)((const uint8_t*)depth->data + up * depth->depth_stride);
+	const uint16_t *depth_down = (const uint16_t*)((const uint8_t*)depth->data + down * depth->depth_stride);
+	const float (*R)[4] = h->pose;
+
+	memset(normals, 0, n * sizeof(float3));
+
+	//only stored points, decimated or culled are often the majority
+	for(uint64_t valid = b->valid;valid;valid &= valid - 1)
+	{
+		const int i = __builtin_ctzll(valid);
+		const float center[3] = {b->x[i], b->y[i], b->z[i]};
+		const int x = c + i, left = x - s >= 0 ? x - s : x, right = x + s < w ? x + s : x;
+		float pl[3], pr[3], pu[3], pd[3], N[3];
+
+		hdu_mesh_point(h, depth_raw, row->ray_x, row->ray_y, left, center, pl);
+		hdu_mesh_point(h, depth_raw, row->ray_x, row->ray_y, right, center, pr);
+		hdu_mesh_point(h, depth_up, h->ray_x + up * w, h->ray_y + up * w, x, center, pu);
+		hdu_mesh_point(h, depth_down, h->ray_x + down * w, h->ray_y + down * w, x, center, pd);
+
+		const float dx[3] = {pr[0] - pl[0], pr[1] - pl[1], pr[2] - pl[2]};
+		const float dy[3] = {pu[0] - pd[0], pu[1] - pd[1], pu[2] - pd[2]};
+
+		N[0] = dy[1] * dx[2] - dy[2] * dx[1];
+		N[1] = dy[2] * dx[0] - dy[0] * dx[2];
+		N[2] = dy[0] * dx[1] - dy[1] * dx[0];
+
+		const float length2 = N[0] * N[0] + N[1] * N[1] + N[2] * N[2];
+		const float inv = length2 > 0.0f ? 1.0f / sqrtf(length2) : 0.0f;
+
+		for(int j=0;j<3;++j)
+			normals[i][j] = (h->posed ? R[j][0] * N[0] + R[j][1] * N[1] + R[j][2] * N[2] : N[j]) * inv;
+	}
+}
+
+//zeroes positions of rejected points and keeps all, organized cloud has point per pixel
+static void hdu_organize(struct hdu_block *b, int n)
+{
+	for(int i=0;i<n;++i)
+	{
+		const float keep = (float)((b->valid >> i) & 1);
+		b->x[i] *= keep;
+		b->y[i] *= keep;
+		b->z[i] *= keep;
+	}
+
+	b->valid = n == 64 ? ~(uint64_t)0 : ((uint64_t)1 << n) - 1;
+}
+
+//keeps points in front of background model, pixels without background are kept
+static uint64_t hdu_background_mask(const struct hdu *h, const struct hdu_row *row, int c, int n, const struct hdu_block *b)
+{
+	const float *background = h->background + row->r * row->width + c;
+	uint64_t keep = 0;
+
+	for(int i=0;i<n;++i)
+		keep |= (uint64_t)((background[i] == 0.0f) | (b->z[i] < background[i] - h->background_threshold)) << i;
+
+	return keep;
+}
+
+//conservative, tile points lie within bounds of its rays and valid depth range
+static int hdu_frustum_tile(const struct hdu *h, const struct hdu_row *row, int c)
+{
+	const float *b = h->ray_bounds[row->r * ((row->width + HDU_BLOCK - 1) / HDU_BLOCK) + c / HDU_BLOCK];
+	float corners[8][3];
+
+	for(int i=0;i<8;++i)
+	{
+		const float d = i & 4 ? h->max_depth : h->min_depth;
+		corners[i][0] = b[i & 1] * d;
+		corners[i][1] = b[2 + ((i >> 1) & 1)] * d;
+		corners[i][2] = d;
+	}
+
+	for(int p=0;p<6;++p)
+	{
+		const float *P = h->frustum_planes[p];
+		int outside = 1;
+
+		for(int i=0;i<8;++i)
+			outside &= P[0] * corners[i][0] + P[1] * corners[i][1] + P[2] * corners[i][2] + P[3] < 0.0f;
+
+		if(outside)
+			return 0;
+	}
+
+	return 1;
+}
+
+//keeps points inside all frustum planes, in sensor frame
+static uint64_t hdu_frustum_mask(const struct hdu *h, int n, const struct hdu_block *b)
+{
+	uint64_t keep = 0;
+
+	for(int i=0;i<n;++i)
+	{
+		int inside = 1;
+
+		for(int p=0;p<6;++p)
+		{
+			const float *P = h->frustum_planes[p];
+			inside &= P[0] * b->x[i] + P[1] * b->y[i] + P[2] * b->z[i] + P[3] >= 0.0f;
+		}
+
+		keep |= (uint64_t)inside << i;
+	}
+
+	return keep;
+}
+
+//organized cloud slots of culled tile, positions at 0 and none stored for mesh
+static const struct hdu_block HDU_BLOCK_CULLED = {.valid = ~(uint64_t)0};
+static const struct hdu_block HDU_BLOCK_CULLED_MESH = {.valid = 0};
+
+//tracks tile change and tells if point cloud needs it recomputed, tiles belong to single band
+static int hdu_delta_tile(const struct hdu *h, const struct hdu_point_cloud *pc, const struct hdu_row *row, int c, int n)
+{
+	const int t = row->r * ((row->width + HDU_BLOCK - 1) / HDU_BLOCK) + c / HDU_BLOCK;
+	const int mask = row->mask, threshold = h->delta_threshold_raw;
+	uint16_t *reference = h->delta_depth + row->r * row->width + c;
+	int changed = h->delta_reset_frame == h->frame;
+
+	for(int i=0;i<n;++i)
+	{
+		const int diff = (row->depth[i + c] & mask) - reference[i];
+		changed |= diff > threshold || -diff > threshold;
+	}
+
+	if(changed)
+	{
+		for(int i=0;i<n;++i)
+			reference[i] = row->depth[i + c] & mask;
+		h->delta_frame[t] = h->frame;
+	}
+
+	return h->delta_frame[t] > pc->frame || h->delta_reset_frame > pc->frame;
+}
+
+//fills pc slots starting at first, returns number of points written
+//valid is set to the number of pixels with valid depth (not rejected as flying pixels) before decimation
+static int hdu_unproject_rows(const struct hdu *h, const struct hdu_depth *depth, struct hdu_point_cloud *pc,
+	int row_begin, int row_end, int first, int *valid, int *kept)
+{
+	const struct hdu_kernel *k = h->kernel;
+	const color32 default_color = 0xFFFFFFFF; // RGBA(255, 255, 255, 255), opaque white
+	int points=first;
+	//color frame planes, chroma has half vertical resolution
+	const int colors = depth->colors && h->color_format != HDU_COLOR_FORMAT_NONE;
+	const int background = h->background && h->background_threshold > 0.0f &&
+		h->background_width == depth->width && h->background_height == depth->height;
+	const int mesh = h->organized && pc->indices && h->mesh_z;
+	const int normals = h->organized && pc->normals;
+	struct hdu_planes planes;
+	struct hdu_block block;
+	struct hdu_row row;
+
+	*valid = 0;
+	*kept = 0;
+
+	hdu_color_planes(h, depth, &planes);
+
+	if(!colors || h->color_output == HDU_COLOR_NONE)
+		for(int i=0;i<HDU_BLOCK;++i)
+			block.colors[i] = default_color;
+
+	for(int r=row_begin;r<row_end;++r)
+	{
+		const int row_points = depth->width < pc->size - points ? depth->width : pc->size - points;
+
+		row.depth = (const uint16_t*)((const uint8_t*)depth->data + r * depth->depth_stride);
+		row.mask = h->depth_mask;
+		row.depth_raw = row.depth;
+		row.depth_up = r > 0 ? (const uint16_t*)((const uint8_t*)row.depth - depth->depth_stride) : row.depth;
+		row.depth_down = r + 1 < depth->height ? (const uint16_t*)((const uint8_t*)row.depth + depth->depth_stride) : row.depth;
+		row.width = depth->width;
+		row.color_y = planes.y + r * planes.y_stride;
+		row.color_uv = (const uint16_t*)(planes.uv + (r / 2) * planes.uv_stride);
+		row.color_u = planes.uv + (r / 2) * planes.uv_stride;
+		row.color_v = planes.v + (r / 2) * planes.uv_stride;
+		row.ray_x = h->ray_x + r * depth->width;
+		row.ray_y = h->ray_y + r * depth->width;
+		row.r = r;
+
+		//filtered in place in history, decimated rows too so that their history stays current
+		if(h->temporal_alpha)
+		{
+			uint16_t *history = h->temporal_depth + r * depth->width;
+			k->temporal(h, row.depth, history, h->temporal_age + r * depth->width, depth->width);
+			row.depth = history;
+			row.mask = 0xFFFF;
+		}
+
+		if(h->background_sample)
+		{
+			uint16_t *sample = h->background_sample + r * depth->width;
+			for(int i=0;i<depth->width;++i)
+				sample[i] = row.depth[i] & row.mask;
+		}
+
+		//organized cloud still needs points of skipped rows
+		const int skip_row = h->decimation == HDU_DECIMATION_STRIDE && r % h->stride;
+		const int culled_row = r < h->roi_top || r >= h->roi_bottom;
+
+		if(culled_row && !h->organized)
+			continue;
+
+		if(skip_row && !h->organized)
+		{
+			*valid += hdu_count_valid(h, &row, row_points);
+			continue;
+		}
+
+		for(int c=0;c<row_points;c+=HDU_BLOCK)
+		{
+			const int n = row_points - c < HDU_BLOCK ? row_points - c : HDU_BLOCK;
+
+			//points of unchanged tile are already in point cloud slots
+			if(h->delta_frame && !hdu_delta_tile(h, pc, &row, c, n))
+			{
+				points += n;
+				continue;
+			}
+
+			if(culled_row || c + n <= h->roi_left || c >= h->roi_right || (h->frustum && !hdu_frustum_tile(h, &row, c)))
+			{
+				if(mesh)
+					hdu_mesh_depth(h, &row, c, n, &HDU_BLOCK_CULLED_MESH);
+				if(h->organized)
+					points += h->store(h, &HDU_BLOCK_CULLED, n, pc, points);
+				continue;
+			}
+
+			k->positions(h, &row, c, n, &block);
+
+			//partially culled tile
+			if(c < h->roi_left || c + n > h->roi_right)
+				block.valid &= hdu_columns_mask(c, n, h->roi_left, h->roi_right);
+			if(h->frustum)
+				block.valid &= hdu_frustum_mask(h, n, &block);
+
+			//background is not counted as valid, decimation statistics are for foreground
+			if(background)
+				block.valid &= hdu_background_mask(h, &row, c, n, &block);
+
+			//rejected points are never stored and are not valid for decimation statistics
+			//(skipped rows are not filtered, like in packed cloud)
+			if(!skip_row && (h->spatial_threshold > 0.0f || h->spatial_sigma > 0.0f))
+				block.valid &= k->edges(h, &row, c, n, &block);
+
+			*valid += __builtin_popcountll(block.valid);
+
+			if(skip_row)
+				block.valid = 0;
+
+			if(h->decimation == HDU_DECIMATION_STRIDE)
+				block.valid &= hdu_stride_mask(c, n, h->stride);
+			else if(h->decimation == HDU_DECIMATION_DEPTH_ADAPTIVE)
+				block.valid &= hdu_depth_adaptive_mask(h, &block, r, c, n);
+			else if(h->decimation == HDU_DECIMATION_VOXEL_GRID)
+				block.valid &= hdu_voxel_mask(h, &block, n);
+
+			if(h->registration && h->color_output != HDU_COLOR_NONE && (colors || h->color_output == HDU_COLOR_UV))
+				hdu_registered_colors(h, &planes, n, &block);
+			else if(h->color_output == HDU_COLOR_UV)
+				hdu_uvs(depth, r, c, n, &block);
+			else if(h->color_output == HDU_COLOR_RGBA && colors)
+				h->colors(&row, c, n, &block);
+
+			if(mesh)
+				hdu_mesh_depth(h, &row, c, n, &block);
+			if(normals)
+				hdu_normals(h, depth, &row, c, n, &block, pc->normals + points);
+
+			//after stages working in sensor frame, still hot in L1
+			if(h->posed)
+				hdu_transform(h, n, &block);
+
+			if(h->organized)
+			{
+				*kept += __builtin_popcountll(block.valid);
+				hdu_organize(&block, n);
+			}
+
+			points += h->store(h, &block, n, pc, points);
+		}
+	}
+
+	if(!h->organized)
+		*kept = points - first;
+
+	return points - first;
+}
+
+static void hdu_pool_run_bands(struct hdu_pool *p)
+{
+	const struct hdu_depth *depth = p->depth;
+	int b;
+
+	while( (b = __atomic_fetch_add(&p->next_band, 1, __ATOMIC_RELAXED)) < p->bands )
+	{
+		const int row_begin = depth->height * b / p->bands;
+		const int row_end = depth->height * (b + 1) / p->bands;
+		//each band has fixed slots matching its pixels, compacted afterwards
+		p->counts[b] = hdu_unproject_rows(p->h, depth, p->pc, row_begin, row_end, row_begin * depth->width, &p->valid[b], &p->kept[b]);
+	}
+}
+
+int hdu_unproject(struct hdu *h, const struct hdu_depth *depth, struct hdu_point_cloud *pc)
+{
+	//LOGI("hdu_unproject hdu_depth: %dx%d %d", depth->width, depth->height, depth->depth_stride);
+	//LOGI("hdu_unproject hdu      : %f,%f,%f,%f,%f,%f,%f", h->fx, h->fy, h->ppx, h->ppy, h->min_depth, h->max_depth, h->depth_unit);
+	//LOGI("hdu_unproject pc       : %d,%d,%p,%p", pc->size, pc->used, pc->data, pc->colors);
+	struct hdu_pool *p = h->pool;
+
+	++h->frame;
+
+	if(h->organized && pc->size < depth->width * depth->height)
+	{
+		LOGI("hdu: organized point cloud smaller than depth frame");
+		pc->used = 0;
+		pc->frame = 0;
+		return HDU_ERROR;
+	}
+
+	if(hdu_rays(h, depth->width, depth->height) != HDU_OK ||
+		(h->decimation == HDU_DECIMATION_VOXEL_GRID && hdu_voxel_prepare(h, depth->width * depth->height) != HDU_OK) ||
+		(h->temporal_alpha && hdu_temporal_prepare(h, depth->width * depth->height) != HDU_OK) ||
+		(h->delta_threshold > 0.0f && hdu_delta_prepare(h, depth->width, depth->height) != HDU_OK) ||
+		(h->background_frames && hdu_background_prepare(h, depth->width * depth->height) != HDU_OK) ||
+		(h->organized && pc->indices && hdu_mesh_prepare(h, depth->width * depth->height) != HDU_OK))
+	{
+		pc->used = 0;
+		pc->frame = 0;
+		return HDU_ERROR;
+	}
+
+	hdu_cull_prepare(h, depth);
+
+	if(p == NULL)
+	{
+		int valid, kept;
+		pc->used = hdu_unproject_rows(h, depth, pc, 0, depth->height, 0, &valid, &kept);
+		return hdu_unproject_finish(h, depth, pc, valid, kept);
+	}
+
+	p->h = h;
+	p->depth = depth;
+	p->pc = pc;
+	p->bands = h->threads * HDU_BANDS_PER_THREAD;
+	if(p->bands > depth->height)
+		p->bands = depth->height;
+	p->next_band = 0;
+
+	pthread_mutex_lock(&p->mutex);
+	p->active = p->workers;
+	++p->generation;
+	pthread_cond_broadcast(&p->work_cond);
+	pthread_mutex_unlock(&p->mutex);
+
+	hdu_pool_run_bands(p);
+
+	pthread_mutex_lock(&p->mutex);
+	while(p->active > 0)
+		pthread_cond_wait(&p->done_cond, &p->mutex);
+	pthread_mutex_unlock(&p->mutex);
+
+	//compact bands, prefix of counts gives the destination
+	int points = 0, valid = 0, kept = 0;
+
+	for(int b=0;b<p->bands;++b)
+	{
+		const int first = depth->height * b / p->bands * depth->width;
+
+		if(first != points && p->counts[b] > 0)
+			hdu_move_points(h, pc, points, first, p->counts[b]);
+
+		points += p->counts[b];
+		valid += p->valid[b];
+		kept += p->kept[b];
+	}
+
+	pc->used = points;
+	return hdu_unproject_finish(h, depth, pc, valid, kept);
+}
+
+int hdu_dirty_capacity(int width, int height)
+{
+	return height * ((width + HDU_BLOCK - 1) / HDU_BLOCK);
+}
+
+//merged ranges of tiles changed in this frame, without delta mode all used points
+static void hdu_dirty_ranges(const struct hdu *h, const struct hdu_depth *depth, struct hdu_point_cloud *pc)
+{
+	const int tiles = (depth->width + HDU_BLOCK - 1) / HDU_BLOCK;
+	const int all = h->delta_frame == NULL || h->delta_reset_frame == h->frame;
+	int *d = pc->dirty, n = 0;
+
+	if(all)
+	{
+		d[0] = 0;
+		d[1] = pc->used;
+		pc->dirty_ranges = pc->used > 0;
+		return;
+	}
+
+	for(int r=0;r<depth->height;++r)
+		for(int t=0;t<tiles;++t)
+		{
+			if(h->delta_frame[r * tiles + t] != h->frame)
+				continue;
+
+			const int first = r * depth->width + t * HDU_BLOCK;
+			const int count = depth->width - t * HDU_BLOCK < HDU_BLOCK ? depth->width - t * HDU_BLOCK : HDU_BLOCK;
+
+			//organized cloud is contiguous across rows
+			if(n > 0 && d[2 * n - 2] + d[2 * n - 1] == first)
+				d[2 * n - 1] += count;
+			else
+			{
+				d[2 * n] = first;
+				d[2 * n + 1] = count;
+				++n;
+			}
+		}
+
+	pc->dirty_ranges = n;
+}
+
+int hdu_mesh_capacity(int width, int height)
+{
+	return width > 1 && height > 1 ? 6 * (width - 1) * (height - 1) : 0;
+}
+
+//triangle without discontinuity, all vertices stored
+static inline int hdu_triangle(float a, float b, float c, float threshold)
+{
+	const float ab_min = a < b ? a : b, ab_max = a > b ? a : b;
+	const float min = ab_min < c ? ab_min : c, max = ab_max > c ? ab_max : c;
+
+	return (min > 0.0f) & (max - min <= threshold * min);
+}
+
+//tile of row changed in this frame
+static int hdu_mesh_row_changed(const struct hdu *h, int tiles, int r)
+{
+	for(int t=0;t<tiles;++t)
+		if(h->delta_frame[r * tiles + t] == h->frame)
+			return 1;
+	return 0;
+}
+
+//quads of changed rows are updated, indices rewritten only if topology changed since point cloud indices
+static void hdu_mesh(struct hdu *h, const struct hdu_depth *depth, struct hdu_point_cloud *pc)
+{
+	const int w = depth->width, s = hdu_mesh_step(h);
+	const int tiles = (w + HDU_BLOCK - 1) / HDU_BLOCK;
+	const int all = h->mesh_step != s || h->delta_frame == NULL || h->delta_reset_frame == h->frame;
+	const float threshold = h->mesh_threshold > 0.0f ? h->mesh_threshold : INFINITY;
+	const float *z = h->mesh_z;
+	uint8_t *quads = h->mesh_quads;
+	int changed = h->mesh_step != s;
+
+	h->mesh_step = s;
+
+	for(int r=0;r + s < depth->height;r+=s)
+	{
+		//with delta quads of unchanged rows are the same
+		if(!all && !hdu_mesh_row_changed(h, tiles, r) && !hdu_mesh_row_changed(h, tiles, r + s))
+			continue;
+
+		const float *top = z + r * w, *bottom = z + (r + s) * w;
+
+		for(int c=0;c + s < w;c+=s)
+		{
+			const uint8_t quad = hdu_triangle(top[c], top[c + s], bottom[c], threshold) |
+				hdu_triangle(top[c + s], bottom[c + s], bottom[c], threshold) << 1;
+
+			changed |= quads[r * w + c] != quad;
+			quads[r * w + c] = quad;
+		}
+	}
+
+	if(changed)
+		++h->mesh_version;
+
+	if(pc->topology == h->mesh_version)
+		return;
+
+	uint32_t *indices = pc->indices;
+	int n = 0;
+
+	for(int r=0;r + s < depth->height;r+=s)
+		for(int c=0;c + s < w;c+=s)
+		{
+			const uint8_t quad = quads[r * w + c];
+			const uint32_t a = r * w + c, b = a + s, cc = a + s * w, d = cc + s;
+
+			if(quad & 1)
+			{
+				indices[n++] = a;
+				indices[n++] = b;
+				indices[n++] = cc;
+			}
+			if(quad & 2)
+			{
+				indices[n++] = b;
+				indices[n++] = d;
+				indices[n++] = cc;
+			}
+		}
+
+	pc->indices_used = n;
+	pc->topology = h->mesh_version;
+}
+
+//whole cloud bookkeeping after (parallel) unprojection
+static int hdu_unproject_finish(struct hdu *h, const struct hdu_depth *depth, struct hdu_point_cloud *pc, int valid, int kept)
+{
+	pc->decimated = valid - kept;
+
+	if(pc->dirty)
+		hdu_dirty_ranges(h, depth, pc);
+
+	if(h->organized && pc->indices)
+		hdu_mesh(h, depth, pc);
+
+	pc->frame = h->frame;
+
+	if(h->background_sample && ++h->background_sampled == h->background_frames)
+		hdu_background_finish(h, depth);
+
+	h->background_sample = NULL;
+
+	return HDU_OK;
+}
+
+//voxel set sized for the resolution and new stamp for the frame, entries from previous frames have older stamp
+static int hdu_voxel_prepare(struct hdu *h, int pixels)
+{
+	int log2 = 1;
+
+	while( (1 << log2) < pixels )
+		++log2;
+
+	if(h->voxels_log2 != log2)
+	{
+		free(h->voxels);
+		h->voxels_log2 = 0;
+
+		if( (h->voxels = (uint64_t*)calloc((size_t)1 << log2, sizeof(uint64_t))) == NULL )
+		{
+			LOGI("hdu: not enough memory for voxel grid");
+			return HDU_ERROR;
+		}
+
+		h->voxels_log2 = log2;
+		h->voxel_stamp = 0;
+	}
+
+	//stamp has 22 bits, clear the set when it wraps
+	if(++h->voxel_stamp == ((uint64_t)1 << (64 - 3 * HDU_VOXEL_KEY_BITS)))
+	{
+		memset(h->voxels, 0, ((size_t)1 << log2) * sizeof(uint64_t));
+		h->voxel_stamp = 1;
+	}
+
+	return HDU_OK;
+}
+
+//history sized for the resolution, cleared on resolution, format or filter change
+static int hdu_temporal_prepare(struct hdu *h, int pixels)
+{
+	if(h->temporal_pixels != pixels)
+	{
+		free(h->temporal_depth);
+		free(h->temporal_age);
+		h->temporal_pixels = 0;
+
+		h->temporal_depth = (uint16_t*)malloc(pixels * sizeof(uint16_t));
+		h->temporal_age = (uint8_t*)malloc(pixels * sizeof(uint8_t));
+
+		if(!h->temporal_depth || !h->temporal_age)
+		{
+			LOGI("hdu: not enough memory for temporal filter");
+			return HDU_ERROR;
+		}
+
+		h->temporal_pixels = pixels;
+		h->temporal_reset = 1;
+	}
+
+	if(h->temporal_reset)
+	{
+		memset(h->temporal_depth, 0, pixels * sizeof(uint16_t));
+		memset(h->temporal_age, 0, pixels * sizeof(uint8_t));
+		h->temporal_reset = 0;
+	}
+
+	h->temporal_threshold_raw = (int)(h->temporal_threshold / h->depth_unit);
+
+	return HDU_OK;
+}
+
+//reference depth sized for the resolution, all tiles are dirty on resolution, format or configuration change
+static int hdu_delta_prepare(struct hdu *h, int width, int height)
+{
+	const int pixels = width * height;
+
+	if(h->delta_pixels != pixels)
+	{
+		free(h->delta_depth);
+		free(h->delta_frame);
+		h->delta_pixels = 0;
+
+		h->delta_depth = (uint16_t*)calloc(pixels, sizeof(uint16_t));
+		h->delta_frame = (int*)calloc(hdu_dirty_capacity(width, height), sizeof(int));
+
+		if(!h->delta_depth || !h->delta_frame)
+		{
+			free(h->delta_depth);
+			free(h->delta_frame);
+			h->delta_depth = NULL;
+			h->delta_frame = NULL;
+			LOGI("hdu: not enough memory for delta mode");
+			return HDU_ERROR;
+		}
+
+		h->delta_pixels = pixels;
+		h->delta_reset = 1;
+	}
+
+	if(h->delta_reset)
+	{
+		h->delta_reset_frame = h->frame;
+		h->delta_reset = 0;
+	}
+
+	h->delta_threshold_raw = (int)(h->delta_threshold / h->depth_unit);
+
+	return HDU_OK;
+}
+
+//roi clipped to resolution, frustum planes moved to sensor frame with pose (plane * pose)
+static void hdu_cull_prepare(struct hdu *h, const struct hdu_depth *depth)
+{
+	const int *roi = h->roi;
+	const int whole = roi[2] == 0;
+
+	h->roi_left = whole || roi[0] < 0 ? 0 : roi[0];
+	h->roi_top = whole || roi[1] < 0 ? 0 : roi[1];
+	h->roi_right = whole || roi[0] + roi[2] > depth->width ? depth->width : roi[0] + roi[2];
+	h->roi_bottom = whole || roi[1] + roi[3] > depth->height ? depth->height : roi[1] + roi[3];
+
+	if(!h->frustum)
+		return;
+
+	for(int p=0;p<6;++p)
+	{
+		const float *P = h->frustum_world[p];
+
+		if(!h->posed)
+		{
+			memcpy(h->frustum_planes[p], P, sizeof(h->frustum_planes[p]));
+			continue;
+		}
+
+		for(int j=0;j<4;++j)
+			h->frustum_planes[p][j] = P[0] * h->pose[0][j] + P[1] * h->pose[1][j] + P[2] * h->pose[2][j];
+		h->frustum_planes[p][3] += P[3];
+	}
+}
+
+//mesh state sized for the resolution, topology is new after resize
+static int hdu_mesh_prepare(struct hdu *h, int pixels)
+{
+	if(h->mesh_pixels == pixels)
+		return HDU_OK;
+
+	free(h->mesh_z);
+	free(h->mesh_quads);
+	h->mesh_pixels = 0;
+
+	h->mesh_z = (float*)calloc(pixels, sizeof(float));
+	h->mesh_quads = (uint8_t*)calloc(pixels, sizeof(uint8_t));
+
+	if(!h->mesh_z || !h->mesh_quads)
+	{
+		free(h->mesh_z);
+		free(h->mesh_quads);
+		h->mesh_z = NULL;
+		h->mesh_quads = NULL;
+		LOGI("hdu: not enough memory for mesh");
+		return HDU_ERROR;
+	}
+
+	h->mesh_pixels = pixels;
+	h->mesh_step = 0;
+	++h->mesh_version;
+
+	return HDU_OK;
+}
+
+//samples sized for the resolution and frames, learning restarted on resolution change
+static int hdu_background_prepare(struct hdu *h, int pixels)
+{
+	const int size = h->background_frames * pixels;
+
+	if(h->background_samples_size != size)
+	{
+		free(h->background_samples);
+		h->background_samples_size = 0;
+		h->background_sampled = 0;
+
+		if( (h->background_samples = (uint16_t*)malloc(size * sizeof(uint16_t))) == NULL )
+		{
+			LOGI("hdu: not enough memory for background model samples");
+			return HDU_ERROR;
+		}
+
+		h->background_samples_size = size;
+	}
+
+	h->background_sample = h->background_samples + (size_t)h->background_sampled * pixels;
+
+	return HDU_OK;
+}
+
+//median or min of valid samples per pixel, samples are released
+static void hdu_background_finish(struct hdu *h, const struct hdu_depth *depth)
+{
+	const int pixels = depth->width * depth->height, frames = h->background_frames;
+	float *background;
+
+	if( (background = (float*)malloc(pixels * sizeof(float))) == NULL )
+	{
+		LOGI("hdu: not enough memory for background model");
+		return;
+	}
+
+	for(int p=0;p<pixels;++p)
+	{
+		float sorted[HDU_BACKGROUND_MAX_FRAMES];
+		int n = 0;
+
+		//insertion sort of the few valid samples
+		for(int f=0;f<frames;++f)
+		{
+			const float d = h->background_samples[(size_t)f * pixels + p] * h->depth_unit;
+
+			if(d <= h->min_depth || d > h->max_depth)
+				continue;
+
+			int i = n++;
+			for(;i > 0 && sorted[i - 1] > d;--i)
+				sorted[i] = sorted[i - 1];
+			sorted[i] = d;
+		}
+
+		if(2 * n < frames)
+			background[p] = 0.0f;
+		else
+			background[p] = h->background_mode == HDU_BACKGROUND_MIN ? sorted[0] : sorted[n / 2];
+	}
+
+	free(h->background);
+	free(h->background_samples);
+	h->background = background;
+	h->background_width = depth->width;
+	h->background_height = depth->height;
+	h->background_samples = NULL;
+	h->background_samples_size = 0;
+	h->background_frames = 0;
+	h->delta_reset = 1;
+
+	LOGI("hdu: background model learned for %dx%d", depth->width, depth->height);
+}
+
+//floor without libm call, for voxel coordinates
+static inline int hdu_floor(float x)
+{
+	const int i = (int)x;
+	return i - (x < i);
+}
+
+//keeps the first point in each voxel, safe to call from concurrent bands
+static uint64_t hdu_voxel_mask(const struct hdu *h, const struct hdu_block *b, int n)
+{
+	const uint64_t key_mask = (1 << HDU_VOXEL_KEY_BITS) - 1;
+	const uint64_t stamp = h->voxel_stamp << (3 * HDU_VOXEL_KEY_BITS);
+	const uint64_t stamp_mask = ~(uint64_t)0 << (3 * HDU_VOXEL_KEY_BITS);
+	const uint64_t slot_mask = ((uint64_t)1 << h->voxels_log2) - 1;
+	const float inv = 1.0f / h->voxel_size;
+	uint64_t last = ~(uint64_t)0; //neighbouring pixels often share voxel, skip the lookup
+	uint64_t mask = 0;
+
+	for(int i=0;i<n;++i)
+	{
+		if(!((b->valid >> i) & 1))
+			continue;
+
+		const uint64_t key =
+			(uint64_t)(hdu_floor(b->x[i] * inv) & key_mask) |
+			(uint64_t)(hdu_floor(b->y[i] * inv) & key_mask) << HDU_VOXEL_KEY_BITS |
+			(uint64_t)(hdu_floor(b->z[i] * inv) & key_mask) << (2 * HDU_VOXEL_KEY_BITS);
+		const uint64_t entry = stamp | key;
+		uint64_t slot = (key * 0x9E3779B97F4A7C15ULL) >> (64 - h->voxels_log2);
+		int keep = key != last;
+
+		last = key;
+
+		//current frame entries are never removed, first stale slot means voxel is new
+		for(int probe=0;keep && probe<HDU_VOXEL_MAX_PROBES;++probe, slot = (slot + 1) & slot_mask)
+		{
+			uint64_t e = __atomic_load_n(&h->voxels[slot], __ATOMIC_RELAXED);
+
+			if( (e & stamp_mask) != stamp &&
+				__atomic_compare_exchange_n(&h->voxels[slot], &e, entry, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+				break; //claimed
+
+			//e holds current value if another band claimed the slot meanwhile
+			if(e == entry)
+				keep = 0;
+			else if( (e & stamp_mask) != stamp )
+				--probe, slot = (slot - 1) & slot_mask; //lost race to stale update, retry the slot
+		}
+
+		mask |= (uint64_t)keep << i;
+	}
+
+	return mask;
+}
+
+//undistorts normalized image coordinates in place
+static void hdu_undistort(const struct hdu *h, double *x, double *y)
+{
+	const double *k = h->distortion_coeffs;
+	const double xd = *x, yd = *y;
+
+	if(h->distortion_model == HDU_DISTORTION_BROWN_CONRADY)
+	{	//k1, k2, p1, p2, k3 - fixed point iteration inverting the model
+		double xu = xd, yu = yd;
+
+		for(int i=0;i<20;++i)
+		{
+			const double r2 = xu * xu + yu * yu;
+			const double radial = 1 + r2 * (k[0] + r2 * (k[1] + r2 * k[4]));
+			const double dx = 2 * k[2] * xu * yu + k[3] * (r2 + 2 * xu * xu);
+			const double dy = k[2] * (r2 + 2 * yu * yu) + 2 * k[3] * xu * yu;
+
+			xu = (xd - dx) / radial;
+			yu = (yd - dy) / radial;
+		}
+
+		*x = xu;
+		*y = yu;
+	}
+	else if(h->distortion_model == HDU_DISTORTION_KANNALA_BRANDT)
+	{	//k1, k2, k3, k4 - Newton iteration for theta from distorted theta_d
+		const double theta_d = sqrt(xd * xd + yd * yd);
+		double theta = theta_d;
+
+		if(theta_d < 1e-8)
+			return;
+
+		for(int i=0;i<20;++i)
+		{
+			const double t2 = theta * theta;
+			const double f = theta * (1 + t2 * (k[0] + t2 * (k[1] + t2 * (k[2] + t2 * k[3])))) - theta_d;
+			const double df = 1 + t2 * (3 * k[0] + t2 * (5 * k[1] + t2 * (7 * k[2] + t2 * 9 * k[3])));
+
+			theta -= f / df;
+		}
+
+		*x = xd * tan(theta) / theta_d;
+		*y = yd * tan(theta) / theta_d;
+	}
+}
+
+//ray table maps pixel to point at unit depth, rebuilt only on resolution change
+static int hdu_rays(struct hdu *h, int width, int height)
+{
+	if(h->ray_width == width && h->ray_height == height)
+		return HDU_OK;
+
+	free(h->ray_x);
+	free(h->ray_y);
+	free(h->ray_bounds);
+	h->ray_width = h->ray_height = 0;
+
+	const int tiles = (width + HDU_BLOCK - 1) / HDU_BLOCK;
+
+	h->ray_x = (float*)malloc(width * height * sizeof(float));
+	h->ray_y = (float*)malloc(width * height * sizeof(float));
+	h->ray_bounds = (float(*)[4])malloc(tiles * height * sizeof(float[4]));
+
+	if(!h->ray_x || !h->ray_y || !h->ray_bounds)
+	{
+		LOGI("hdu: not enough memory for ray table");
+		return HDU_ERROR;
+	}
+
+	for(int r=0;r<height;++r)
+		for(int c=0;c<width;++c)
+		{
+			double x = (c - h->ppx) / h->fx;
+			double y = (r - h->ppy) / h->fy;
+
+			hdu_undistort(h, &x, &y);
+
+			//y is up in the output
+			h->ray_x[r * width + c] = (float)x;
+			h->ray_y[r * width + c] = (float)-y;
+		}
+
+	//with lens distortion rays are not linear along the row, tile is bounded by all its rays
+	for(int r=0;r<height;++r)
+		for(int t=0;t<tiles;++t)
+		{
+			const float *x = h->ray_x + r * width, *y = h->ray_y + r * width;
+			float *b = h->ray_bounds[r * tiles + t];
+
+			b[0] = b[1] = x[t * HDU_BLOCK];
+			b[2] = b[3] = y[t * HDU_BLOCK];
+
+			for(int c=t * HDU_BLOCK + 1;c<width && c<(t + 1) * HDU_BLOCK;++c)
+			{
+				b[0] = x[c] < b[0] ? x[c] : b[0];
+				b[1] = x[c] > b[1] ? x[c] : b[1];
+				b[2] = y[c] < b[2] ? y[c] : b[2];
+				b[3] = y[c] > b[3] ? y[c] : b[3];
+			}
+		}
+
+	h->ray_width = width;
+	h->ray_height = height;
+
+	LOGI("hdu: ray table for %dx%d", width, height);
+
+	return HDU_OK;
+}
+
+static void *hdu_pool_worker(void *arg)
+{
+	struct hdu_pool *p = (struct hdu_pool*)arg;
+	int generation = 0;
+
+	if(p->pin && sched_setaffinity(0, sizeof(p->big_cores), &p->big_cores) != 0)
+		LOGI("hdu: failed to pin worker thread to big cores");
+
+	while(1)
+	{
+		pthread_mutex_lock(&p->mutex);
+		while(!p->stop && p->generation == generation)
+			pthread_cond_wait(&p->work_cond, &p->mutex);
+
+		if(p->stop)
+		{
+			pthread_mutex_unlock(&p->mutex);
+			break;
+		}
+
+		generation = p->generation;
+		pthread_mutex_unlock(&p->mutex);
+
+		hdu_pool_run_bands(p);
+
+		pthread_mutex_lock(&p->mutex);
+		if(--p->active == 0)
+			pthread_cond_signal(&p->done_cond);
+		pthread_mutex_unlock(&p->mutex);
+	}
+
+	return NULL;
+}
+
+static struct hdu_pool *hdu_pool_init(int threads)
+{
+	struct hdu_pool *p;
+
+	if( (p = (struct hdu_pool*)calloc(1, sizeof(struct hdu_pool))) == NULL )
+		return NULL;
+
+	pthread_mutex_init(&p->mutex, NULL);
+	pthread_cond_init(&p->work_cond, NULL);
+	pthread_cond_init(&p->done_cond, NULL);
+
+	//pin only if there is a distinct set of big cores
+	p->pin = hdu_big_cores(&p->big_cores) < sysconf(_SC_NPROCESSORS_CONF);
+
+	for(int i=0;i<threads-1;++i)
+	{
+		if(pthread_create(&p->threads[i], NULL, hdu_pool_worker, p) != 0)
+		{
+			hdu_pool_close(p);
+			return NULL;
+		}
+		++p->workers;
+	}
+
+	return p;
+}
+
+static void hdu_pool_close(struct hdu_pool *p)
+{
+	if(p == NULL)
+		return;
+
+	pthread_mutex_lock(&p->mutex);
+	p->stop = 1;
+	pthread_cond_broadcast(&p->work_cond);
+	pthread_mutex_unlock(&p->mutex);
+
+	for(int i=0;i<p->workers;++i)
+		pthread_join(p->threads[i], NULL);
+
+	pthread_cond_destroy(&p->done_cond);
+	pthread_cond_destroy(&p->work_cond);
+	pthread_mutex_destroy(&p->mutex);
+
+	free(p);
+}
+
+//big cores are the ones above the slowest cluster, returns their count
+//falls back to all the cores if cpufreq is unavailable or cores are symmetric
+static int hdu_big_cores(cpu_set_t *set)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_CONF);
+	long freq[HDU_MAX_THREADS * 2] = {0};
+	long min_freq = 0;
+	int big = 0;
+
+	if(cpus < 1)
+		cpus = 1;
+	if(cpus > HDU_MAX_THREADS * 2)
+		cpus = HDU_MAX_THREADS * 2;
+
+	CPU_ZERO(set);
+
+	for(int i=0;i<cpus;++i)
+	{
+		char path[128];
+		FILE *f;
+
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", i);
+
+		if( (f = fopen(path, "r")) != NULL )
+		{
+			if(fscanf(f, "%ld", &freq[i]) != 1)
+				freq[i] = 0;
+			fclose(f);
+		}
+
+		//offline (hotplugged) cores have no readable cpufreq, leave them out
+		if(freq[i] > 0 && (min_freq == 0 || freq[i] < min_freq))
+			min_freq = freq[i];
+	}
+
+	for(int i=0;i<cpus;++i)
+		if(min_freq > 0 && freq[i] > min_freq)
+		{
+			CPU_SET(i, set);
+			++big;
+		}
+
+	if(big == 0)
+	{
+		for(int i=0;i<cpus;++i)
+			CPU_SET(i, set);
+		big = cpus;
+	}
+
+	return big;
+}
+
+int hdu_velocity(const struct hdu_point_cloud *previous, struct hdu_point_cloud *pc, float seconds, float max_distance)
+{
+	if(!pc->velocities || previous->size != pc->size || previous->used != pc->used || seconds <= 0.0f)
+		return HDU_ERROR;
+
+	const float max_d2 = max_distance > 0.0f ? max_distance * max_distance : INFINITY;
+	const float inverse = 1.0f / seconds;
+
+	for(int i=0;i<pc->used;++i)
+	{
+		const float *a = previous->data[i], *b = pc->data[i];
+		float *v = pc->velocities[i];
+		const float d[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+		//organized points not stored are at position 0
+		const int stored = (a[0] != 0.0f || a[1] != 0.0f || a[2] != 0.0f) && (b[0] != 0.0f || b[1] != 0.0f || b[2] != 0.0f);
+		const float scale = stored && d[0] * d[0] + d[1] * d[1] + d[2] * d[2] <= max_d2 ? inverse : 0.0f;
+
+		v[0] = d[0] * scale;
+		v[1] = d[1] * scale;
+		v[2] = d[2] * scale;
+	}
+
+	return HDU_OK;
+}
+
+int hdu_predict(const struct hdu_point_cloud *base, struct hdu_point_cloud *pc, float seconds, const float *transform)
+{
+	if(!base->velocities || !pc->velocities || base->size != pc->size || (!base->normals != !pc->normals))
+		return HDU_ERROR;
+
+	static const float identity[12] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0};
+	const float *m = transform ? transform : identity;
+
+	for(int i=0;i<base->used;++i)
+	{
+		const float *p = base->data[i], *v = base->velocities[i];
+		float *o = pc->data[i], *ov = pc->velocities[i];
+
+		if(p[0] == 0.0f && p[1] == 0.0f && p[2] == 0.0f)
+		{
+			o[0] = o[1] = o[2] = 0.0f;
+			ov[0] = ov[1] = ov[2] = 0.0f;
+			continue;
+		}
+
+		const float q[3] = {p[0] + v[0] * seconds, p[1] + v[1] * seconds, p[2] + v[2] * seconds};
+
+		for(int r=0;r<3;++r)
+		{
+			o[r] = m[4 * r] * q[0] + m[4 * r + 1] * q[1] + m[4 * r + 2] * q[2] + m[4 * r + 3];
+			ov[r] = m[4 * r] * v[0] + m[4 * r + 1] * v[1] + m[4 * r + 2] * v[2];
+		}
+	}
+
+	for(int i=0;transform && base->normals && i<base->used;++i)
+	{
+		const float *n = base->normals[i];
+
+		for(int r=0;r<3;++r)
+			pc->normals[i][r] = m[4 * r] * n[0] + m[4 * r + 1] * n[1] + m[4 * r + 2] * n[2];
+	}
+
+	if(!transform && base->normals)
+		memcpy(pc->normals, base->normals, base->used * sizeof(float3));
+
+	pc->used = base->used;
+
+	return HDU_OK;
+}
+
+//spatial index, points counting sorted by hashed grid cell
+
+struct hdu_index
+{
+	float cell_size;
+	float cell_inv;
+	int count; //indexed points
+	float3 *positions; //sorted by bucket
+	int *points; //point cloud index of sorted positions
+	int capacity;
+	uint32_t *keys; //bucket of each point cloud point while building, UINT32_MAX if not indexed
+	int keys_capacity;
+	int *buckets; //start of each bucket in sorted arrays, 2^buckets_log2 + 1 entries
+	int buckets_log2;
+	int bounds[2][3]; //min and max cell of indexed points
+};
+
+struct hdu_index *hdu_index_init(float cell_size)
+{
+	struct hdu_index *index, zero_index = {0};
+
+	if(cell_size <= 0.0f)
+	{
+		LOGI("hdu: invalid index cell size");
+		return NULL;
+	}
+
+	if( (index = (struct hdu_index*)malloc(sizeof(struct hdu_index))) == NULL )
+	{
+		LOGI("hdu: not enough memory for index");
+		return NULL;
+	}
+
+	*index = zero_index;
+
+	index->cell_size = cell_size;
+	index->cell_inv = 1.0f / cell_size;
+
+	return index;
+}
+
+void hdu_index_close(struct hdu_index *index)
+{
+	if(index == NULL)
+		return;
+
+	free(index->positions);
+	free(index->points);
+	free(index->keys);
+	free(index->buckets);
+	free(index);
+}
+
+static inline float hdu_half_to_float(uint16_t h)
+{
+	const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	const uint32_t exponent = (h >> 10) & 0x1F, mantissa = h & 0x3FF;
+	uint32_t x;
+	float f;
+
+	if(exponent == 0) //zero or subnormal, never written by hdu_half
+		x = sign;
+	else if(exponent == 0x1F)
+		x = sign | 0x7F800000 | (mantissa << 13);
+	else
+		x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+	memcpy(&f, &x, sizeof(f));
+	return f;
+}
+
+//position of point i in vertex format of h
+static inline void hdu_index_position(const struct hdu *h, const struct hdu_point_cloud *pc, int i, float *p)
+{
+	switch(h->vertex_format)
+	{
+		case HDU_VERTEX_HALF4:
+		{
+			const uint16_t *v = (const uint16_t*)pc->data + 4 * i;
+			p[0] = hdu_half_to_float(v[0]);
+			p[1] = hdu_half_to_float(v[1]);
+			p[2] = hdu_half_to_float(v[2]);
+			return;
+		}
+		case HDU_VERTEX_SHORT4:
+		{
+			const int16_t *v = (const int16_t*)pc->data + 4 * i;
+			for(int j=0;j<3;++j)
+				p[j] = v[j] / h->position_scale_inv + h->position_offset[j];
+			return;
+		}
+		case HDU_VERTEX_FLOAT3_COLOR32:
+			memcpy(p, ((const struct hdu_vertex*)pc->data)[i].position, sizeof(float3));
+			return;
+		case HDU_VERTEX_SOA:
+		{
+			const float *x = (const float*)pc->data;
+			p[0] = x[i];
+			p[1] = x[pc->size + i];
+			p[2] = x[2 * pc->size + i];
+			return;
+		}
+		default:
+			memcpy(p, pc->data[i], sizeof(float3));
+	}
+}
+
+//position read back from organized cloud slot not stored, 0 in vertex format (quantized with offset for short4)
+static inline void hdu_unstored_position(const struct hdu *h, float *zero)
+{
+	for(int j=0;j<3;++j)
+		zero[j] = h->vertex_format == HDU_VERTEX_SHORT4 ?
+			hdu_short((0.0f - h->position_offset[j]) * h->position_scale_inv) / h->position_scale_inv + h->position_offset[j] : 0.0f;
+}
+
+static inline int hdu_index_cell(const struct hdu_index *index, float x)
+{
+	return hdu_floor(x * index->cell_inv);
+}
+
+static inline uint32_t hdu_index_bucket(const struct hdu_index *index, int x, int y, int z)
+{
+	const uint32_t hash = (uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u ^ (uint32_t)z * 83492791u;
+	return hash & (((uint32_t)1 << index->buckets_log2) - 1);
+}
+
+//grows buffer to hold count elements, contents are not kept
+static int hdu_index_reserve(void **buffer, int *capacity, int count, size_t element)
+{
+	if(*capacity >= count)
+		return HDU_OK;
+
+	free(*buffer);
+	*capacity = 0;
+
+	if( (*buffer = malloc(count * element)) == NULL )
+		return HDU_ERROR;
+
+	*capacity = count;
+	return HDU_OK;
+}
+
+int hdu_index_build(struct hdu_index *index, const struct hdu *h, const struct hdu_point_cloud *pc)
+{
+	const int n = pc->used;
+	int log2 = 10, capacity = index->capacity, keys_capacity = index->keys_capacity;
+	float zero[3];
+
+	index->count = 0;
+
+	//about 2 points per bucket
+	while( (1 << log2) < n / 2 )
+		++log2;
+
+	if(hdu_index_reserve((void**)&index->keys, &keys_capacity, n, sizeof(uint32_t)) != HDU_OK ||
+		hdu_index_reserve((void**)&index->positions, &capacity, n, sizeof(float3)) != HDU_OK ||
+		hdu_index_reserve((void**)&index->points, &index->capacity, n, sizeof(int)) != HDU_OK)
+	{
+		index->keys_capacity = index->capacity = 0;
+		LOGI("hdu: not enough memory for index");
+		return HDU_ERROR;
+	}
+
+	index->keys_capacity = keys_capacity;
+
+	if(index->buckets_log2 != log2)
+	{
+		free(index->buckets);
+		index->buckets_log2 = 0;
+
+		if( (index->buckets = (int*)malloc((((size_t)1 << log2) + 1) * sizeof(int))) == NULL )
+		{
+			LOGI("hdu: not enough memory for index");
+			return HDU_ERROR;
+		}
+		index->buckets_log2 = log2;
+	}
+
+	hdu_unstored_position(h, zero);
+
+	int *buckets = index->buckets;
+	const int size = 1 << log2;
+
+	memset(buckets, 0, (size + 1) * sizeof(int));
+
+	//count points of bucket b in buckets[b + 1]
+	for(int i=0;i<n;++i)
+	{
+		float p[3];
+		hdu_index_position(h, pc, i, p);
+
+		if(h->organized && p[0] == zero[0] && p[1] == zero[1] && p[2] == zero[2])
+		{
+			index->keys[i] = UINT32_MAX;
+			continue;
+		}
+
+		index->keys[i] = hdu_index_bucket(index, hdu_index_cell(index, p[0]), hdu_index_cell(index, p[1]), hdu_index_cell(index, p[2]));
+		++buckets[index->keys[i] + 1];
+	}
+
+	//exclusive prefix in buckets[b + 1] is start of b, incremented while scattering it becomes end of b
+	for(int b=0, start=0;b<size;++b)
+	{
+		const int count = buckets[b + 1];
+		buckets[b + 1] = start;
+		start += count;
+	}
+
+	for(int i=0;i<n;++i)
+	{
+		if(index->keys[i] == UINT32_MAX)
+			continue;
+
+		const int slot = buckets[index->keys[i] + 1]++;
+		hdu_index_position(h, pc, i, index->positions[slot]);
+		index->points[slot] = i;
+	}
+
+	index->count = buckets[size];
+
+	for(int j=0;j<3;++j)
+		index->bounds[0][j] = INT_MAX, index->bounds[1][j] = INT_MIN;
+
+	for(int i=0;i<index->count;++i)
+		for(int j=0;j<3;++j)
+		{
+			const int c = hdu_index_cell(index, index->positions[i][j]);
+			index->bounds[0][j] = c < index->bounds[0][j] ? c : index->bounds[0][j];
+			index->bounds[1][j] = c > index->bounds[1][j] ? c : index->bounds[1][j];
+		}
+
+	return HDU_OK;
+}
+
+//inserts into sorted k best, returns new number of best
+static inline int hdu_index_insert(int *best, float *best_d2, int found, int k, int point, float d2)
+{
+	if(found == k && d2 >= best_d2[k - 1])
+		return found;
+
+	int i = found < k ? found++ : k - 1;
+
+	for(;i > 0 && best_d2[i - 1] > d2;--i)
+	{
+		best[i] = best[i - 1];
+		best_d2[i] = best_d2[i - 1];
+	}
+
+	best[i] = point;
+	best_d2[i] = d2;
+
+	return found;
+}
+
+int hdu_index_nearest(const struct hdu_index *index, const float *q, int k, float max_distance,
+	int *indices, float3 *positions, float *distances)
+{
+	int best[HDU_INDEX_MAX_K];
+	float best_d2[HDU_INDEX_MAX_K];
+	const float max_d2 = max_distance * max_distance;
+	const int (*bounds)[3] = index->bounds;
+	int found = 0, c[3], first = 0, last = 0;
+
+	if(k > HDU_INDEX_MAX_K)
+		k = HDU_INDEX_MAX_K;
+
+	if(index->count == 0 || k <= 0 || !(max_distance >= 0.0f))
+		return 0;
+
+	//shells intersecting bounds of indexed points, from the nearest to the farthest bound
+	for(int j=0;j<3;++j)
+	{
+		c[j] = hdu_index_cell(index, q[j]);
+
+		const int gap = bounds[0][j] - c[j] > c[j] - bounds[1][j] ? bounds[0][j] - c[j] : c[j] - bounds[1][j];
+		const int span = c[j] - bounds[0][j] > bounds[1][j] - c[j] ? c[j] - bounds[0][j] : bounds[1][j] - c[j];
+
+		first = gap > first ? gap : first;
+		last = span > last ? span : last;
+	}
+
+	//also limited by max_distance (possibly infinite)
+	if(max_distance * index->cell_inv < last)
+		last = (int)(max_distance * index->cell_inv) + 1;
+
+	const int cx = c[0], cy = c[1], cz = c[2];
+
+	//cube shells of cells around query cell, points beyond shell s are at least s cells away
+	for(int s=first;s<=last;++s)
+	{
+		const float reached = (s - 1) * index->cell_size;
+
+		if(s > 0 && found == k && best_d2[k - 1] <= reached * reached)
+			break;
+
+		//shell clipped to bounds, rows inside the shell have only its two side cells
+		const int z0 = cz - s > bounds[0][2] ? cz - s : bounds[0][2], z1 = cz + s < bounds[1][2] ? cz + s : bounds[1][2];
+		const int y0 = cy - s > bounds[0][1] ? cy - s : bounds[0][1], y1 = cy + s < bounds[1][1] ? cy + s : bounds[1][1];
+		const int x0 = cx - s > bounds[0][0] ? cx - s : bounds[0][0], x1 = cx + s < bounds[1][0] ? cx + s : bounds[1][0];
+
+		for(int z=z0;z<=z1;++z)
+			for(int y=y0;y<=y1;++y)
+			{
+				const int face = s == 0 || abs(z - cz) == s || abs(y - cy) == s;
+
+				for(int x=face ? x0 : cx-s;x<=(face ? x1 : cx+s);x+=face ? 1 : 2 * s)
+				{
+					if(x < bounds[0][0] || x > bounds[1][0])
+						continue;
+
+					const uint32_t b = hdu_index_bucket(index, x, y, z);
+
+					for(int j=index->buckets[b];j<index->buckets[b + 1];++j)
+					{
+						const float *p = index->positions[j];
+						const float d[3] = {p[0] - q[0], p[1] - q[1], p[2] - q[2]};
+						const float d2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+
+						//buckets are shared by colliding cells
+						if(d2 > max_d2 || hdu_index_cell(index, p[0]) != x || hdu_index_cell(index, p[1]) != y || hdu_index_cell(index, p[2]) != z)
+							continue;
+
+						found = hdu_index_insert(best, best_d2, found, k, j, d2);
+					}
+				}
+			}
+	}
+
+	for(int i=0;i<found;++i)
+	{
+		if(indices)
+			indices[i] = index->points[best[i]];
+		if(positions)
+			memcpy(positions[i], index->positions[best[i]], sizeof(float3));
+		if(distances)
+			distances[i] = sqrtf(best_d2[i]);
+	}
+
+	return found;
+}
+
+int hdu_index_raycast(const struct hdu_index *index, const float *origin, const float *direction, float max_distance,
+	float radius, float3 position, float *distance)
+{
+	const float length = sqrtf(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+	const float r2 = radius * radius;
+	float dir[3], t_next[3], t_delta[3], best_t = INFINITY, t_start = 0.0f, t_exit = max_distance;
+	int cell[3], step[3], best = -1;
+
+	if(index->count == 0 || length == 0.0f || radius > index->cell_size)
+		return -1;
+
+	//skip to bounds of indexed points extended by neighbours (slab test)
+	for(int i=0;i<3;++i)
+	{
+		const float lo = (index->bounds[0][i] - 1) * index->cell_size, hi = (index->bounds[1][i] + 2) * index->cell_size;
+
+		dir[i] = direction[i] / length;
+
+		if(dir[i] == 0.0f)
+		{
+			if(origin[i] < lo || origin[i] > hi)
+				return -1;
+			continue;
+		}
+
+		const float t_lo = (lo - origin[i]) / dir[i], t_hi = (hi - origin[i]) / dir[i];
+		const float t_min = t_lo < t_hi ? t_lo : t_hi, t_max = t_lo < t_hi ? t_hi : t_lo;
+
+		t_start = t_min > t_start ? t_min : t_start;
+		t_exit = t_max < t_exit ? t_max : t_exit;
+	}
+
+	if(t_start > t_exit)
+		return -1;
+
+	//3D DDA over cells along the ray
+	for(int i=0;i<3;++i)
+	{
+		cell[i] = hdu_index_cell(index, origin[i] + t_start * dir[i]);
+		step[i] = dir[i] >= 0.0f ? 1 : -1;
+
+		const float boundary = (cell[i] + (step[i] > 0)) * index->cell_size;
+		t_next[i] = dir[i] != 0.0f ? (boundary - origin[i]) / dir[i] : INFINITY;
+		t_delta[i] = dir[i] != 0.0f ? index->cell_size / fabsf(dir[i]) : INFINITY;
+	}
+
+	for(float t_enter = t_start;t_enter <= max_distance;)
+	{
+		//point within radius of the ray at t lies in neighbour of cell the ray passes at t
+		if(best_t < t_enter)
+			break;
+
+		//the ray left bounds of indexed points (extended by neighbours)
+		if( (step[0] > 0 ? cell[0] > index->bounds[1][0] + 1 : cell[0] < index->bounds[0][0] - 1) ||
+			(step[1] > 0 ? cell[1] > index->bounds[1][1] + 1 : cell[1] < index->bounds[0][1] - 1) ||
+			(step[2] > 0 ? cell[2] > index->bounds[1][2] + 1 : cell[2] < index->bounds[0][2] - 1) )
+			break;
+
+		for(int z=cell[2]-1;z<=cell[2]+1;++z)
+			for(int y=cell[1]-1;y<=cell[1]+1;++y)
+				for(int x=cell[0]-1;x<=cell[0]+1;++x)
+				{
+					const uint32_t b = hdu_index_bucket(index, x, y, z);
+
+					for(int j=index->buckets[b];j<index->buckets[b + 1];++j)
+					{
+						const float *p = index->positions[j];
+						const float d[3] = {p[0] - origin[0], p[1] - origin[1], p[2] - origin[2]};
+						const float t = d[0] * dir[0] + d[1] * dir[1] + d[2] * dir[2];
+
+						if(t < 0.0f || t > max_distance || t >= best_t)
+							continue;
+						if(d[0] * d[0] + d[1] * d[1] + d[2] * d[2] - t * t > r2)
+							continue;
+
+						best_t = t;
+						best = j;
+					}
+				}
+
+		const int axis = t_next[0] < t_next[1] ? (t_next[0] < t_next[2] ? 0 : 2) : (t_next[1] < t_next[2] ? 1 : 2);
+
+		t_enter = t_next[axis];
+		t_next[axis] += t_delta[axis];
+		cell[axis] += step[axis];
+	}
+
+	if(best < 0)
+		return -1;
+
+	if(position)
+		memcpy(position, index->positions[best], sizeof(float3));
+	if(distance)
+		*distance = best_t;
+
+	return index->points[best];
+}
+
+//voxel volume, blocks of voxels in hash table with LRU list for eviction
+
+struct hdu_voxel
+{
+	int16_t sdf; //signed distance / truncation in [-32767, 32767], positive in front of surface
+	uint8_t weight; //observations, saturates at HDU_VOLUME_MAX_WEIGHT
+	uint8_t exported; //voxel was surface in the last export of its block
+	uint8_t color[4]; //running average RGBA
+};
+
+enum {HDU_VOLUME_MAX_WEIGHT = 64};
+
+struct hdu_volume
+{
+	float voxel_size;
+	float voxel_inv;
+	float truncation;
+	int min_weight;
+
+	int max_blocks;
+	int blocks; //slots in use, slots are taken in order and then reused by eviction
+	struct hdu_voxel *voxels; //HDU_VOLUME_BLOCK_VOXELS per slot, x fastest
+	int (*coords)[3]; //block coordinates of slot
+	int *prev; //LRU list of slots, head is the most recently updated
+	int *next;
+	int lru_head;
+	int lru_tail;
+	uint8_t *changed; //slot changed since last export
+	uint8_t *touched; //slot surface may differ from export, resolved at the end of integration
+
+	int *table; //slot or -1, linear probing
+	uint32_t table_mask;
+};
+
+static struct hdu_volume *hdu_volume_close_and_return_null(struct hdu_volume *v, const char *msg)
+{
+	LOGI("%s", msg);
+	hdu_volume_close(v);
+	return NULL;
+}
+
+struct hdu_volume *hdu_volume_init(const struct hdu_volume_config *c)
+{
+	struct hdu_volume *v, zero_volume = {0};
+	uint32_t table_size = 1;
+
+	if(c->voxel_size <= 0.0f || c->truncation < 0.0f || c->max_blocks <= 0 || c->min_weight < 0 ||
+		c->min_weight > HDU_VOLUME_MAX_WEIGHT || c->max_blocks > INT_MAX / HDU_VOLUME_BLOCK_VOXELS)
+	{
+		LOGI("hdu: invalid volume configuration");
+		return NULL;
+	}
+
+	if( (v = (struct hdu_volume*)malloc(sizeof(struct hdu_volume))) == NULL )
+		return hdu_volume_close_and_return_null(NULL, "hdu: not enough memory for volume");
+
+	*v = zero_volume;
+
+	v->voxel_size = c->voxel_size;
+	v->voxel_inv = 1.0f / c->voxel_size;
+	v->truncation = c->truncation;
+	v->min_weight = c->min_weight > 0 ? c->min_weight : 1;
+	v->max_blocks = c->max_blocks;
+
+	//at most half full table
+	while(table_size < 2 * (uint32_t)c->max_blocks)
+		table_size <<= 1;
+
+	v->table_mask = table_size - 1;
+
+	if( (v->voxels = (struct hdu_voxel*)malloc((size_t)c->max_blocks * HDU_VOLUME_BLOCK_VOXELS * sizeof(struct hdu_voxel))) == NULL ||
+		(v->coords = (int(*)[3])malloc(c->max_blocks * sizeof(int[3]))) == NULL ||
+		(v->prev = (int*)malloc(c->max_blocks * sizeof(int))) == NULL ||
+		(v->next = (int*)malloc(c->max_blocks * sizeof(int))) == NULL ||
+		(v->changed = (uint8_t*)malloc(c->max_blocks)) == NULL ||
+		(v->touched = (uint8_t*)calloc(c->max_blocks, 1)) == NULL ||
+		(v->table = (int*)malloc(table_size * sizeof(int))) == NULL )
+		return hdu_volume_close_and_return_null(v, "hdu: not enough memory for volume");
+
+	//initial export covers all slots
+	v->blocks = v->max_blocks;
+	hdu_volume_reset(v);
+
+	LOGI("hdu: volume of %d blocks (%d KB)", c->max_blocks,
+		(int)((size_t)c->max_blocks * HDU_VOLUME_BLOCK_VOXELS * sizeof(struct hdu_voxel) / 1024));
+
+	return v;
+}
+
+void hdu_volume_close(struct hdu_volume *v)
+{
+	if(v == NULL)
+		return;
+
+	free(v->voxels);
+	free(v->coords);
+	free(v->prev);
+	free(v->next);
+	free(v->changed);
+	free(v->touched);
+	free(v->table);
+	free(v);
+}
+
+int hdu_volume_capacity(const struct hdu_volume *v)
+{
+	return v->max_blocks * HDU_VOLUME_BLOCK_VOXELS;
+}
+
+void hdu_volume_reset(struct hdu_volume *v)
+{
+	//slots that held blocks have to be cleared by the next export
+	memset(v->changed, 1, v->blocks);
+	memset(v->touched, 0, v->blocks);
+	memset(v->table, 0xFF, (v->table_mask + 1) * sizeof(int));
+	v->blocks = 0;
+	v->lru_head = v->lru_tail = -1;
+}
+
+static inline uint32_t hdu_volume_hash(const struct hdu_volume *v, const int *b)
+{
+	return ((uint32_t)b[0] * 73856093u ^ (uint32_t)b[1] * 19349663u ^ (uint32_t)b[2] * 83492791u) & v->table_mask;
+}
+
+static inline void hdu_volume_unlink(struct hdu_volume *v, int slot)
+{
+	if(v->prev[slot] >= 0)
+		v->next[v->prev[slot]] = v->next[slot];
+	else
+		v->lru_head = v->next[slot];
+
+	if(v->next[slot] >= 0)
+		v->prev[v->next[slot]] = v->prev[slot];
+	else
+		v->lru_tail = v->prev[slot];
+}
+
+static inline void hdu_volume_link_head(struct hdu_volume *v, int slot)
+{
+	v->prev[slot] = -1;
+	v->next[slot] = v->lru_head;
+
+	if(v->lru_head >= 0)
+		v->prev[v->lru_head] = slot;
+	else
+		v->lru_tail = slot;
+
+	v->lru_head = slot;
+}
+
+//removes slot from table, entries after it are shifted back so that probing needs no tombstones
+static void hdu_volume_unhash(struct hdu_volume *v, int slot)
+{
+	uint32_t hole = hdu_volume_hash(v, v->coords[slot]);
+
+	while(v->table[hole] != slot)
+		hole = (hole + 1) & v->table_mask;
+
+	v->table[hole] = -1;
+
+	for(uint32_t j = (hole + 1) & v->table_mask; v->table[j] != -1; j = (j + 1) & v->table_mask)
+	{
+		const uint32_t home = hdu_volume_hash(v, v->coords[v->table[j]]);
+
+		//entry may move to the hole if the hole is not before its home position
+		if( ((j - home) & v->table_mask) >= ((j - hole) & v->table_mask) )
+		{
+			v->table[hole] = v->table[j];
+			v->table[j] = -1;
+			hole = j;
+		}
+	}
+}
+
+//slot of block, allocated (evicting the least recently updated) if not resident, moved to LRU head
+static int hdu_volume_block(struct hdu_volume *v, const int *b)
+{
+	uint32_t i = hdu_volume_hash(v, b);
+	int slot;
+
+	for(;v->table[i] != -1;i = (i + 1) & v->table_mask)
+	{
+		slot = v->table[i];
+
+		if(v->coords[slot][0] != b[0] || v->coords[slot][1] != b[1] || v->coords[slot][2] != b[2])
+			continue;
+
+		if(v->lru_head != slot)
+		{
+			hdu_volume_unlink(v, slot);
+			hdu_volume_link_head(v, slot);
+		}
+		return slot;
+	}
+
+	if(v->blocks < v->max_blocks)
+		slot = v->blocks++;
+	else
+	{
+		slot = v->lru_tail;
+		hdu_volume_unlink(v, slot);
+		hdu_volume_unhash(v, slot);
+
+		//eviction may have shifted entries, probe again for free position
+		for(i = hdu_volume_hash(v, b);v->table[i] != -1;i = (i + 1) & v->table_mask)
+			;
+	}
+
+	memset(v->voxels + (size_t)slot * HDU_VOLUME_BLOCK_VOXELS, 0, HDU_VOLUME_BLOCK_VOXELS * sizeof(struct hdu_voxel));
+	memcpy(v->coords[slot], b, sizeof(v->coords[slot]));
+	v->table[i] = slot;
+	v->changed[slot] = 1;
+	hdu_volume_link_head(v, slot);
+
+	return slot;
+}
+
+//RGBA color32 of point i or NULL
+static inline const uint8_t *hdu_volume_color(const struct hdu *h, const struct hdu_point_cloud *pc, int i)
+{
+	if(h->color_output != HDU_COLOR_RGBA)
+		return NULL;
+	if(h->vertex_format == HDU_VERTEX_FLOAT3_COLOR32)
+		return (const uint8_t*)&((const struct hdu_vertex*)pc->data)[i].color;
+
+	return pc->colors ? (const uint8_t*)&pc->colors[i] : NULL;
+}
+
+//surface voxels are within half voxel of zero crossing, in sdf units
+static inline int hdu_volume_max_sdf(const struct hdu_volume *v)
+{
+	return v->truncation > 0.0f ? (int)(0.5f * v->voxel_size / v->truncation * 32767.0f) : 32767;
+}
+
+//voxel is exported as point (block still has to be resident)
+static inline int hdu_volume_surface(const struct hdu_volume *v, const struct hdu_voxel *x, int max_sdf)
+{
+	return x->weight >= v->min_weight && abs(x->sdf) <= max_sdf;
+}
+
+int hdu_volume_integrate(struct hdu_volume *v, const struct hdu *h, const struct hdu_point_cloud *pc)
+{
+	const float origin[3] = {h->posed ? h->pose[0][3] : 0.0f, h->posed ? h->pose[1][3] : 0.0f, h->posed ? h->pose[2][3] : 0.0f};
+	//samples along the ray each side of the point, about one per voxel
+	const int samples = v->truncation > 0.0f ? (int)ceilf(v->truncation * v->voxel_inv) : 0;
+	const float sdf_scale = v->truncation > 0.0f ? 32767.0f / v->truncation : 0.0f;
+	const int max_sdf = hdu_volume_max_sdf(v);
+	float zero[3];
+	int cached[3] = {0}, cached_slot = -1;
+
+	hdu_unstored_position(h, zero);
+
+	for(int i=0;i<pc->used;++i)
+	{
+		float p[3], d[3];
+
+		hdu_index_position(h, pc, i, p);
+
+		if(h->organized && p[0] == zero[0] && p[1] == zero[1] && p[2] == zero[2])
+			continue;
+
+		d[0] = origin[0] - p[0], d[1] = origin[1] - p[1], d[2] = origin[2] - p[2];
+
+		const float length = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+		const uint8_t *color = hdu_volume_color(h, pc, i);
+
+		if(length == 0.0f)
+			continue;
+
+		for(int j=0;j<3;++j)
+			d[j] /= length;
+
+		for(int k=-samples;k<=samples;++k)
+		{
+			//t is signed distance from the point towards sensor
+			const float t = k * v->voxel_size;
+			//outermost samples may be past truncation, saturate instead of wrapping int16
+			const float s = t * sdf_scale;
+			const int sdf = s > 32767.0f ? 32767 : s < -32767.0f ? -32767 : (int)s;
+			int voxel[3], block[3];
+
+			if(t >= length)
+				break;
+
+			for(int j=0;j<3;++j)
+			{
+				voxel[j] = hdu_floor((p[j] + d[j] * t) * v->voxel_inv);
+				block[j] = voxel[j] >> 3; //floor division by HDU_VOLUME_BLOCK
+			}
+
+			if(cached_slot < 0 || block[0] != cached[0] || block[1] != cached[1] || block[2] != cached[2])
+			{
+				cached_slot = hdu_volume_block(v, block);
+				memcpy(cached, block, sizeof(cached));
+			}
+
+			struct hdu_voxel *x = v->voxels + (size_t)cached_slot * HDU_VOLUME_BLOCK_VOXELS +
+				(((voxel[2] & 7) * HDU_VOLUME_BLOCK + (voxel[1] & 7)) * HDU_VOLUME_BLOCK + (voxel[0] & 7));
+			const int w = x->weight;
+			uint8_t was_color[4];
+
+			memcpy(was_color, x->color, sizeof(was_color));
+
+			x->sdf = (int16_t)((x->sdf * w + sdf) / (w + 1));
+
+			if(k == 0 && color)
+				for(int j=0;j<4;++j)
+					x->color[j] = (uint8_t)((x->color[j] * w + color[j]) / (w + 1));
+
+			x->weight = w < HDU_VOLUME_MAX_WEIGHT ? w + 1 : w;
+
+			//only what export shows, rays through free space mostly leave blocks as they were
+			const int surface = hdu_volume_surface(v, x, max_sdf);
+
+			if(surface && memcmp(was_color, x->color, sizeof(was_color)))
+				v->changed[cached_slot] = 1;
+			else if(surface != x->exported)
+				v->touched[cached_slot] = 1;
+		}
+	}
+
+	//voxels updated by several rays may leave and rejoin surface within frame
+	for(int slot=0;slot<v->blocks;++slot)
+	{
+		if(!v->touched[slot])
+			continue;
+
+		const struct hdu_voxel *x = v->voxels + (size_t)slot * HDU_VOLUME_BLOCK_VOXELS;
+
+		for(int i=0;i<HDU_VOLUME_BLOCK_VOXELS && !v->changed[slot];++i)
+			v->changed[slot] = hdu_volume_surface(v, x + i, max_sdf) != x[i].exported;
+
+		v->touched[slot] = 0;
+	}
+
+	return HDU_OK;
+}
+
+int hdu_volume_export(struct hdu_volume *v, struct hdu_point_cloud *pc, int all)
+{
+	const int max_sdf = hdu_volume_max_sdf(v);
+	const uint8_t none[4] = {0, 0, 0, 0};
+	int *d = pc->dirty, n = 0;
+
+	if(pc->size < hdu_volume_capacity(v))
+	{
+		LOGI("hdu: point cloud smaller than volume capacity");
+		return HDU_ERROR;
+	}
+
+	for(int slot=0;slot<v->max_blocks;++slot)
+	{
+		if(!all && !v->changed[slot])
+			continue;
+
+		struct hdu_voxel *x = v->voxels + (size_t)slot * HDU_VOLUME_BLOCK_VOXELS;
+		float3 *data = pc->data + (size_t)slot * HDU_VOLUME_BLOCK_VOXELS;
+		color32 *colors = pc->colors ? pc->colors + (size_t)slot * HDU_VOLUME_BLOCK_VOXELS : NULL;
+		const int resident = slot < v->blocks;
+		const int *b = v->coords[slot];
+
+		for(int i=0;i<HDU_VOLUME_BLOCK_VOXELS;++i)
+		{
+			const int surface = resident && hdu_volume_surface(v, x + i, max_sdf);
+
+			if(resident)
+				x[i].exported = surface;
+
+			if(colors)
+				memcpy(colors + i, surface ? x[i].color : none, sizeof(color32));
+
+			if(!surface)
+			{
+				data[i][0] = data[i][1] = data[i][2] = 0.0f;
+				continue;
+			}
+
+			//voxel center
+			data[i][0] = (b[0] * HDU_VOLUME_BLOCK + (i & 7) + 0.5f) * v->voxel_size;
+			data[i][1] = (b[1] * HDU_VOLUME_BLOCK + ((i >> 3) & 7) + 0.5f) * v->voxel_size;
+			data[i][2] = (b[2] * HDU_VOLUME_BLOCK + (i >> 6) + 0.5f) * v->voxel_size;
+		}
+
+		const int first = slot * HDU_VOLUME_BLOCK_VOXELS;
+
+		if(n > 0 && d[2 * n - 2] + d[2 * n - 1] == first)
+			d[2 * n - 1] += HDU_VOLUME_BLOCK_VOXELS;
+		else
+		{
+			d[2 * n] = first;
+			d[2 * n + 1] = HDU_VOLUME_BLOCK_VOXELS;
+			++n;
+		}
+
+		v->changed[slot] = 0;
+	}
+
+	pc->used = v->blocks * HDU_VOLUME_BLOCK_VOXELS;
+	pc->dirty_ranges = n;
+	++pc->frame;
+
+	return HDU_OK;
 }
@@ -35,7 +35,130 @@ extern "C" {
  *  @{
  */
 
+enum HDU_COMPILE_TIME_CONSTANTS
+{
+	HDU_MAX_THREADS = 16, //!< max number of threads unprojecting in parallel
+	HDU_DISTORTION_COEFFS = 5, //!< number of lens distortion coefficients
+	HDU_TILE = 64, //!< delta mode tile width in pixels, tiles are single row
+	HDU_BACKGROUND_MAX_FRAMES = 15, //!< max number of frames background model is learned from
+	HDU_INDEX_MAX_K = 64, //!< max number of neighbours in nearest query
+	HDU_VOLUME_BLOCK = 8, //!< volume block edge in voxels
+	HDU_VOLUME_BLOCK_VOXELS = HDU_VOLUME_BLOCK * HDU_VOLUME_BLOCK * HDU_VOLUME_BLOCK, //!< voxels (exported points) per block
+};
+
+/**
+ * @brief Lens distortion models.
+ *
+ * - HDU_DISTORTION_BROWN_CONRADY coefficients k1, k2, p1, p2, k3 (OpenCV plumb bob)
+ * - HDU_DISTORTION_KANNALA_BRANDT coefficients k1, k2, k3, k4 (OpenCV fisheye)
+ */
+enum hdu_distortion_model
+{
+	HDU_DISTORTION_NONE = 0, //!< rectified or distortion free images
+	HDU_DISTORTION_BROWN_CONRADY = 1, //!< radial and tangential distortion
+	HDU_DISTORTION_KANNALA_BRANDT = 2, //!< equidistant fisheye distortion
+};
+
+/**
+ * @brief Point cloud decimation modes.
+ *
+ * - HDU_DECIMATION_STRIDE keeps every stride-th pixel in every stride-th row
+ * - HDU_DECIMATION_DEPTH_ADAPTIVE keeps pixels roughly voxel_size apart (power of two stride from depth)
+ * - HDU_DECIMATION_VOXEL_GRID keeps single (first) point per voxel_size voxel
+ */
+enum hdu_decimation_mode
+{
+	HDU_DECIMATION_NONE = 0, //!< all valid points
+	HDU_DECIMATION_STRIDE = 1, //!< fixed image space subsampling
+	HDU_DECIMATION_DEPTH_ADAPTIVE = 2, //!< image space subsampling with stride from depth
+	HDU_DECIMATION_VOXEL_GRID = 3, //!< world space downsampling
+};
+
+/**
+ * @brief Point cloud vertex formats.
+ *
+ * - HDU_VERTEX_FLOAT3 x, y, z floats in data, colors separate
+ * - HDU_VERTEX_HALF4 x, y, z, 1 IEEE half floats in data, colors separate
+ * - HDU_VERTEX_SHORT4 x, y, z, 0 int16 in data, colors separate, position = value * position_scale + position_offset
+ * - HDU_VERTEX_FLOAT3_COLOR32 interleaved hdu_vertex in data (color as in hdu_color_output), colors unused (may be NULL)
+ * - HDU_VERTEX_SOA x[size], y[size], z[size] floats in data, colors separate
+ *
+ * @see hdu_vertex_size
+ */
+enum hdu_vertex_format
+{
+	HDU_VERTEX_FLOAT3 = 0, //!< 12 bytes per point
+	HDU_VERTEX_HALF4 = 1, //!< 8 bytes per point
+	HDU_VERTEX_SHORT4 = 2, //!< 8 bytes per point, quantized
+	HDU_VERTEX_FLOAT3_COLOR32 = 3, //!< 16 bytes per point with color
+	HDU_VERTEX_SOA = 4, //!< 12 bytes per point in 3 planes
+};
+
+/**
+ * @brief Per point color output.
+ *
+ * - HDU_COLOR_RGBA color32 converted from YUV texture on CPU
+ * - HDU_COLOR_UV texture coordinates of point in texture frame, unorm16 u in low and v in high 16 bits of color32
+ * - HDU_COLOR_NONE nothing written, colors unused (may be NULL)
+ *
+ * With HDU_COLOR_UV and HDU_COLOR_NONE color lookup is left to the shader
+ * (for organized clouds point index already implies texture coordinates).
+ */
+enum hdu_color_output
+{
+	HDU_COLOR_RGBA = 0, //!< CPU YUV to RGBA conversion
+	HDU_COLOR_UV = 1, //!< per point texture coordinates
+	HDU_COLOR_NONE = 2, //!< no per point color data
+};
+
+/**
+ * @brief Depth pixel formats.
+ *
+ * All formats are 16 bit per pixel, depth_unit scales raw value of the format
+ * (masked to its bits but not shifted, e.g. 0 - 1023 for YUV420P10).
+ */
+enum hdu_depth_format
+{
+	HDU_DEPTH_P010 = 0, //!< 10 most significant bits
+	HDU_DEPTH_P016 = 1, //!< 16 bits
+	HDU_DEPTH_YUV420P10 = 2, //!< 10 least significant bits
+	HDU_DEPTH_GRAY16 = 3, //!< 16 bits
+	HDU_DEPTH_GRAY12 = 4, //!< 12 least significant bits
+};
+
+/**
+ * @brief Color (texture) pixel formats.
+ */
+enum hdu_color_format
+{
+	HDU_COLOR_FORMAT_NV12 = 0, //!< Y plane and interleaved UV plane
+	HDU_COLOR_FORMAT_YUV420P = 1, //!< Y, U and V planes
+	HDU_COLOR_FORMAT_NONE = 2, //!< no color, colors are ignored
+};
+
+/**
+ * @brief Background model statistics of learned frames per pixel.
+ *
+ * Pixels valid in less than half of the frames have no background.
+ */
+enum hdu_background_mode
+{
+	HDU_BACKGROUND_MEDIAN = 0, //!< median depth, robust to foreground moving through
+	HDU_BACKGROUND_MIN = 1, //!< nearest depth, for empty scene with noisy depth
+};
+
+/**
+  * @brief Constants returned by most of library functions
+  */
+enum hdu_retval_enum
+{
+	HDU_ERROR=-1, //!< error occured
+	HDU_OK=0, //!< succesfull execution
+};
+
 struct hdu;
+struct hdu_index;
+struct hdu_volume;
 
 struct hdu_depth
 {
@@ -45,17 +168,42 @@ struct hdu_depth
 	int height;
 	int depth_stride;
 	int color_stride;
+	int color_width; //color frame resolution with registration, 0 if the same as depth
+	int color_height;
+	uint8_t *color_u; //NV12 UV plane or YUV420P U plane, NULL if contiguous after Y plane
+	uint8_t *color_v; //YUV420P V plane, NULL if contiguous after U plane
+	int color_uv_stride; //0 for color_stride (NV12) or color_stride / 2 (YUV420P)
 };
 
 typedef float float3[3];
 typedef uint32_t color32;
 
+//HDU_VERTEX_FLOAT3_COLOR32 layout (Unity friendly)
+struct hdu_vertex
+{
+	float3 position;
+	color32 color;
+};
+
+//data is hdu_vertex_format specific, size * hdu_vertex_size bytes
+//frame and topology have to be 0 for new, reallocated or other hdu point cloud, hdu sets them afterwards
+//if dirty is not NULL it receives (first point, count) pairs changed since the previous frame
+//organized cloud may also have mesh, indices are rewritten only when topology changes
 struct hdu_point_cloud
 {
 	float3 *data;
 	color32 *colors;
 	int size;
 	int used;
+	int decimated; //valid points removed by decimation (in recomputed tiles with delta)
+	int frame; //number of unprojected frame
+	int *dirty; //NULL or hdu_dirty_capacity pairs
+	int dirty_ranges; //number of pairs in dirty
+	float3 *normals; //NULL or size normals facing sensor, organized only
+	uint32_t *indices; //NULL or hdu_mesh_capacity clockwise triangle indices, organized only
+	int indices_used;
+	int topology; //version of mesh topology in indices
+	float3 *velocities; //NULL or size per second velocities, organized only (hdu_velocity)
 };
 
 
@@ -68,6 +216,51 @@ struct hdu_point_cloud
  * - > max representable depth - max_margin
  *
  * max representable depth is calculated as P010LE_MAX * depth_unit
+ * (or format maximum * depth_unit, see hdu_depth_format)
+ *
+ * Pixels are mapped to rays through table built once per depth resolution.
+ * Lens distortion (if any) is removed while building the table so it costs nothing per frame.
+ *
+ * With non-zero color_fx and color_fy colors are registered, each point is
+ * transformed to color camera (color_rotation, color_translation) and projected
+ * with color intrinsics. Color frame may then have different resolution than depth.
+ * Extrinsics and intrinsics are folded into single projection at init.
+ * Camera convention is x right, y down, z forward (unprojected points have y up).
+ *
+ * Vertex format is fixed at init, point cloud data has to be allocated for it.
+ * With HDU_VERTEX_SHORT4 position_scale is quantization step, position_offset is subtracted first.
+ *
+ * Optional temporal filter smooths depth exponentially with temporal_alpha weight of the new depth.
+ * Differences above temporal_threshold are treated as motion and taken as they are.
+ * Holes keep the last depth for up to temporal_persistence frames.
+ * The filter keeps its history in hdu, decoded depth frame is not modified.
+ *
+ * Optional spatial filter compares depth with 4 neighbours in decoded depth.
+ * Points with jump to any neighbour above spatial_threshold * depth (flying pixels) are not stored.
+ * With spatial_sigma depth is averaged with neighbours closer than spatial_sigma, weighted by closeness.
+ *
+ * Optional background model has per pixel depth learned over a few frames (see hdu_background_learn).
+ * Points no further than background_threshold in front of the background are not stored,
+ * points behind the background neither. The model may be saved and loaded for the same resolution.
+ *
+ * Optional culling skips tiles outside region of interest (depth image rectangle, see hdu_set_roi)
+ * or view frustum (see hdu_set_frustum), points outside are not stored.
+ *
+ * Organized point cloud has point per pixel (index is row * width + column),
+ * invalid and decimated points are at position 0, point cloud size has to match resolution.
+ * In delta mode (organized with delta_threshold) hdu keeps reference depth of HDU_TILE pixel tiles
+ * and recomputes only tiles changed above delta_threshold since the point cloud's frame.
+ * Changing configuration, culling or pose recomputes all tiles. Points of unchanged tiles keep their
+ * colors and spatial filter result, HDU_COLOR_UV or HDU_COLOR_NONE keep up with the texture.
+ *
+ * Organized point cloud with indices is also triangle mesh of the depth grid (every stride-th pixel
+ * with stride decimation, which reduces mesh resolution). Triangles with relative depth jump between
+ * vertices above mesh_threshold (discontinuities) or with not stored vertex are skipped.
+ * Normals are estimated from neighbours (at stride distance) in decoded depth.
+ *
+ * Unprojection is split into row bands processed by persistent worker threads.
+ * With threads 0 the number of threads matches the number of big cores
+ * (or all cores on symmetric devices) and the workers are pinned to them.
  *
  * @see hdu_init
  */
@@ -77,16 +270,174 @@ struct hdu_config
 	float ppy; //!< principal point y pixel coordinates (center of projection)
 	float fx; //!< focal length in pixel width unit
 	float fy; //!< focal length in pixel height unit
-	float depth_unit; //!< multiplier for raw depth data;
+	float depth_unit; //!< multiplier for raw depth data (LSB aligned formats like yuv420p10le are not shifted);
 	float min_margin; //!< minimal margin to treat as valid in result unit (raw data * depth_unit);
 	float max_margin; //!< maximal margin to treat as valid in result unit (raw data * depth_unit);
+	int threads; //!< 0 for automatic (big cores), 1 for single threaded or number of threads
+	int distortion_model; //!< hdu_distortion_model, HDU_DISTORTION_NONE (0) if images are not distorted
+	float distortion_coeffs[HDU_DISTORTION_COEFFS]; //!< coefficients of distortion_model, unused are ignored
+	int decimation; //!< hdu_decimation_mode, HDU_DECIMATION_NONE (0) for full resolution
+	int stride; //!< HDU_DECIMATION_STRIDE pixel stride
+	float voxel_size; //!< HDU_DECIMATION_DEPTH_ADAPTIVE point spacing or HDU_DECIMATION_VOXEL_GRID voxel size in result unit
+	int vertex_format; //!< hdu_vertex_format, HDU_VERTEX_FLOAT3 (0) by default
+	float position_scale; //!< HDU_VERTEX_SHORT4 quantization step in result unit
+	float position_offset[3]; //!< HDU_VERTEX_SHORT4 position of zero value in result unit
+	int color_output; //!< hdu_color_output, HDU_COLOR_RGBA (0) by default
+	float color_ppx; //!< color camera principal point x, registration only
+	float color_ppy; //!< color camera principal point y, registration only
+	float color_fx; //!< color camera focal length, 0 if color is aligned with depth (no registration)
+	float color_fy; //!< color camera focal length, 0 if color is aligned with depth (no registration)
+	float color_rotation[9]; //!< depth to color camera rotation, row major
+	float color_translation[3]; //!< depth to color camera translation in result unit
+	int depth_format; //!< hdu_depth_format, HDU_DEPTH_P010 (0) by default
+	int color_format; //!< hdu_color_format, HDU_COLOR_FORMAT_NV12 (0) by default
+	float temporal_alpha; //!< temporal filter weight of new depth in (0, 1], 0 disables the filter
+	float temporal_threshold; //!< temporal filter difference in result unit treated as motion (no smoothing)
+	int temporal_persistence; //!< temporal filter frames to fill hole with last depth, 0 - 255
+	float spatial_threshold; //!< relative depth jump to neighbour (e.g. 0.05) rejecting flying pixel, 0 disables
+	float spatial_sigma; //!< edge aware (bilateral) smoothing depth range in result unit, 0 disables
+	int organized; //!< 1 for point per pixel, 0 (default) packs points at the beginning
+	float delta_threshold; //!< organized only, tile depth change in result unit to recompute, 0 recomputes all
+	float background_threshold; //!< margin in front of background model in result unit, 0 disables suppression
+	float mesh_threshold; //!< relative depth jump (e.g. 0.05) between triangle vertices treated as discontinuity, 0 for none
 };
 
 //NULL on ERROR
 struct hdu *hdu_init(const struct hdu_config *cfg);
 void hdu_close(struct hdu *h);
 
-void hdu_unproject(const struct hdu *h, const struct hdu_depth *depth, struct hdu_point_cloud *pc);
+//HDU_OK on success, HDU_ERROR on invalid arguments, see hdu_config for arguments
+int hdu_set_decimation(struct hdu *h, int mode, int stride, float voxel_size);
+
+//temporal depth filter applied before unprojection, see hdu_config for arguments
+//HDU_OK on success, HDU_ERROR on invalid arguments
+int hdu_set_temporal(struct hdu *h, float alpha, float threshold, int persistence);
+
+//spatial depth filter (flying pixel rejection, bilateral smoothing), see hdu_config for arguments
+//HDU_OK on success, HDU_ERROR on invalid arguments
+int hdu_set_spatial(struct hdu *h, float threshold, float sigma);
+
+//selects kernels for stream formats (once at stream start), see hdu_config for arguments
+//HDU_OK on success, HDU_ERROR on invalid arguments
+int hdu_set_formats(struct hdu *h, int depth_format, int color_format);
+
+//sensor to world 4x4 row major transform (last row ignored) applied to the next frames, NULL for none
+//transformed are unprojected points (y up), HDU_OK on success
+int hdu_set_pose(struct hdu *h, const float *pose);
+
+//depth image rectangle to unproject (clipped to image) applied to the next frames, 0 width or height for whole image
+//HDU_OK on success, HDU_ERROR on invalid arguments
+int hdu_set_roi(struct hdu *h, int x, int y, int width, int height);
+
+//4x4 row major view projection (OpenGL clip space -w <= x, y, z <= w) of unprojected points, NULL for none
+//applied to the next frames (in world frame if hdu_set_pose is set), HDU_OK on success
+int hdu_set_frustum(struct hdu *h, const float *view_projection);
+
+//learns background model from the next frames (1 - HDU_BACKGROUND_MAX_FRAMES) with hdu_background_mode
+//0 frames cancels learning, the previous model (if any) is used until the new one is learned
+//HDU_OK on success, HDU_ERROR on invalid arguments
+int hdu_background_learn(struct hdu *h, int frames, int mode);
+
+//background suppression margin, see hdu_config, HDU_OK on success, HDU_ERROR on invalid arguments
+int hdu_set_background(struct hdu *h, float threshold);
+
+//background model file, HDU_OK on success, HDU_ERROR on failure (or no model for save)
+int hdu_background_save(const struct hdu *h, const char *file);
+int hdu_background_load(struct hdu *h, const char *file);
+
+//bytes per point in point cloud data for hdu_vertex_format, 0 for invalid format
+int hdu_vertex_size(int format);
+
+//number of (first point, count) pairs point cloud dirty has to hold for resolution
+int hdu_dirty_capacity(int width, int height);
+
+//number of indices point cloud indices have to hold for resolution
+int hdu_mesh_capacity(int width, int height);
+
+//HDU_OK on success, HDU_ERROR on failure
+int hdu_unproject(struct hdu *h, const struct hdu_depth *depth, struct hdu_point_cloud *pc);
+
+//motion of organized HDU_VERTEX_FLOAT3 point clouds of the same size (normals may be NULL)
+
+//velocities of pc points since previous point cloud (seconds earlier) into pc velocities, 0 for points
+//not stored in either cloud or moved further than max_distance (e.g. different surface), 0 for no limit
+//HDU_OK on success, HDU_ERROR on invalid arguments
+int hdu_velocity(const struct hdu_point_cloud *previous, struct hdu_point_cloud *pc, float seconds, float max_distance);
+
+//pc predicted seconds after base by base velocities and transformed by 4x4 row major transform (NULL for none)
+//positions, normals and velocities are written, points not stored stay at 0
+//HDU_OK on success, HDU_ERROR on invalid arguments
+int hdu_predict(const struct hdu_point_cloud *base, struct hdu_point_cloud *pc, float seconds, const float *transform);
+
+/**
+ * Spatial index of point cloud positions (any vertex format) in uniform grid of cell_size cells.
+ * Built from scratch per frame in O(n), buffers are reused. Queries don't modify the index
+ * and may run concurrently with each other, but not with hdu_index_build.
+ * Points at position 0 of organized point cloud (not stored) are not indexed.
+ * Query results are point cloud indices with positions (may be NULL) and distances (may be NULL).
+ */
+
+//NULL on ERROR, cell_size in result unit (e.g. 0.05)
+struct hdu_index *hdu_index_init(float cell_size);
+void hdu_index_close(struct hdu_index *index);
+
+//h is hdu that unprojected pc (vertex format), HDU_OK on success, HDU_ERROR on failure
+int hdu_index_build(struct hdu_index *index, const struct hdu *h, const struct hdu_point_cloud *pc);
+
+//up to k (<= HDU_INDEX_MAX_K) nearest points not further than max_distance, nearest first, returns number found
+int hdu_index_nearest(const struct hdu_index *index, const float *point, int k, float max_distance,
+	int *indices, float3 *positions, float *distances);
+
+//first point along ray closer than radius (<= cell_size) to the ray, within max_distance from origin
+//returns point index or -1 if there is no hit, distance is along the ray
+int hdu_index_raycast(const struct hdu_index *index, const float *origin, const float *direction, float max_distance,
+	float radius, float3 position, float *distance);
+
+/**
+ * @struct hdu_volume_config
+ * @brief Voxel volume configuration.
+ *
+ * Memory is bounded by max_blocks blocks of HDU_VOLUME_BLOCK_VOXELS voxels (8 bytes each),
+ * when full the least recently updated block is evicted.
+ *
+ * @see hdu_volume_init
+ */
+struct hdu_volume_config
+{
+	float voxel_size; //!< voxel edge in result unit (e.g. 0.02)
+	float truncation; //!< signed distance truncation in result unit (e.g. 0.06), 0 for occupancy only
+	int max_blocks; //!< memory limit in blocks
+	int min_weight; //!< observations needed to export voxel, 0 is treated as 1
+};
+
+/**
+ * Persistent voxel hash volume fusing point clouds over time (TSDF-lite).
+ * Each point updates voxels along its sensor ray within truncation with signed distance
+ * (free space in front of the point, occupied behind) and averages RGBA color of its voxel.
+ * Without truncation voxels only count observations (occupancy).
+ * Sensor position is taken from hdu pose.
+ *
+ * Block is changed when any of its voxels becomes or stops being surface or surface color changes.
+ * Export writes surface voxels of changed blocks into organized point cloud of hdu_volume_capacity
+ * float3 positions and color32 colors, block slot after slot (HDU_VOLUME_BLOCK_VOXELS points each),
+ * position 0 for voxels without surface. Dirty ranges list written blocks (capacity of max_blocks pairs).
+ */
+
+//NULL on ERROR
+struct hdu_volume *hdu_volume_init(const struct hdu_volume_config *config);
+void hdu_volume_close(struct hdu_volume *v);
+
+//points of point cloud pc to export (size) and its dirty pairs (max_blocks)
+int hdu_volume_capacity(const struct hdu_volume *v);
+
+//empties volume, all blocks are exported as changed
+void hdu_volume_reset(struct hdu_volume *v);
+
+//h is hdu that unprojected pc (vertex format, colors and pose), HDU_OK on success, HDU_ERROR on failure
+int hdu_volume_integrate(struct hdu_volume *v, const struct hdu *h, const struct hdu_point_cloud *pc);
+
+//exports blocks changed since last export (or all blocks), HDU_OK on success, HDU_ERROR on failure
+int hdu_volume_export(struct hdu_volume *v, struct hdu_point_cloud *pc, int all);
 
 /** @}*/
 
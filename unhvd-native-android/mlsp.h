@@ -20,7 +20,7 @@ extern "C" {
 
 enum MLSP_COMPILE_TIME_CONSTANTS
 {
-	MLSP_MAX_SUBFRAMES = 3, //!< max number of logical subframes in a single MLSP frame
+	MLSP_MAX_SUBFRAMES = 8, //!< max number of logical subframes in a single MLSP frame
 };
 
 struct mlsp;
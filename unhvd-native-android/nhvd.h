@@ -40,7 +40,7 @@ extern "C" {
 
 enum NHVD_COMPILE_TIME_CONSTANTS
 {
-	NHVD_MAX_DECODERS = 3, //!< max number of decoders in multi decoding
+	NHVD_MAX_DECODERS = 6, //!< max number of decoders in multi decoding
 };
 
 /**
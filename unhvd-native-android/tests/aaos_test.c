@@ -0,0 +1,284 @@
+/*
+ * AAOS jitter buffer test
+ *
+ * Writes tone through aaos_write and aaos_write_timestamped of the host backend
+ * and checks aaos_get_stats after steady playback, clock drift, stalls, bursts
+ * and timestamp gaps. Device bursts are rendered by the test instead of the
+ * backend thread so that timing is deterministic.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+// render and ring are internal to aaos
+#include "../aaos.c"
+
+#include <math.h>
+#include <stdlib.h>
+
+enum
+{
+	SAMPLE_RATE = 24000,
+	CHUNK = SAMPLE_RATE / 100, // 10 ms, also device burst
+	MAX_STEP = 400, // 100 Hz tone of amplitude 8000 changes less than 210 per sample
+};
+
+// continuous output state of the instance under test
+struct output
+{
+	struct aaos* a;
+	int64_t sent; // frames of tone written so far
+	int16_t last; // last rendered sample
+	int32_t max_step; // largest difference of consecutive samples while playing
+};
+
+static int16_t tone(int64_t n)
+{
+	return (int16_t)(8000.0 * sin(2.0 * M_PI * 100.0 * n / SAMPLE_RATE));
+}
+
+// default configuration (24 kHz mono, 60 ms target, 500 ms capacity) driven by the test
+static int open_output(struct output* o)
+{
+	struct aaos_config config = { 0 };
+	struct output zero_output = { 0 };
+
+	*o = zero_output;
+
+	if ((o->a = aaos_init_config(&config)) == NULL)
+		return -1;
+
+	atomic_store(&o->a->stop, 1);
+	pthread_join(o->a->thread, NULL);
+	o->a->thread_started = 0;
+
+	return 0;
+}
+
+static int32_t write_tone(struct output* o, int32_t frames, int64_t timestamp_us)
+{
+	int16_t* buffer = (int16_t*)malloc(frames * sizeof(int16_t));
+
+	for (int32_t i = 0; i < frames; ++i)
+		buffer[i] = tone(o->sent + i);
+
+	const int32_t written = timestamp_us ? aaos_write_timestamped(o->a, buffer, frames, timestamp_us) : aaos_write(o->a, buffer, frames);
+
+	o->sent += frames;
+	free(buffer);
+
+	return written;
+}
+
+// device pulls bursts of 10 ms
+static void play(struct output* o, int32_t bursts)
+{
+	int16_t buffer[CHUNK];
+
+	for (int32_t b = 0; b < bursts; ++b)
+	{
+		aaos_render(o->a, buffer, CHUNK);
+
+		for (int32_t i = 0; i < CHUNK; ++i)
+		{
+			const int32_t step = abs(buffer[i] - o->last);
+
+			o->max_step = step > o->max_step ? step : o->max_step;
+			o->last = buffer[i];
+		}
+	}
+}
+
+static int check(const char* name, int ok, struct output* o)
+{
+	struct aaos_stats s;
+
+	ok = aaos_get_stats(o->a, &s) == 0 && ok;
+
+	printf("%-28s %s (underruns %d, overruns %d, dropped %d, buffered %d ms, target %d ms, ratio %d ppm, concealed %d)\n",
+		name, ok ? "ok" : "FAILED", s.underruns, s.overruns, s.dropped, s.buffered_ms, s.target_ms, s.ratio_ppm, s.concealed);
+
+	return ok ? 0 : 1;
+}
+
+// writer and device at the same rate, ring wraps many times
+static int test_steady(void)
+{
+	struct output o;
+	struct aaos_stats s;
+
+	if (open_output(&o) != 0)
+		return 1;
+
+	for (int i = 0; i < 6; ++i)
+		write_tone(&o, CHUNK, 0);
+
+	for (int i = 0; i < 6000; ++i)
+	{
+		write_tone(&o, CHUNK, 0);
+		play(&o, 1);
+	}
+
+	aaos_get_stats(o.a, &s);
+
+	const int ok = s.underruns == 0 && s.overruns == 0 && s.dropped == 0 && s.concealed == 0 &&
+		o.sent > 4 * (o.a->mask + 1) && o.max_step < MAX_STEP && abs(s.ratio_ppm) < 100 &&
+		s.target_ms == 60 && s.latency_ms == s.buffered_ms + AAOS_BURST_MS;
+	const int failed = check("steady, ring wrap", ok, &o);
+
+	aaos_close(o.a);
+	return failed;
+}
+
+// sender clock faster or slower by 1/2400 (417 ppm), playback rate follows it
+static int test_drift(int direction)
+{
+	struct output o;
+	struct aaos_stats s;
+
+	if (open_output(&o) != 0)
+		return 1;
+
+	for (int i = 0; i < 6; ++i)
+		write_tone(&o, CHUNK, 0);
+
+	// the controller settles with time constant about 12 s
+	for (int i = 0; i < 9000; ++i)
+	{
+		write_tone(&o, i % 10 ? CHUNK : CHUNK + direction, 0);
+		play(&o, 1);
+	}
+
+	aaos_get_stats(o.a, &s);
+
+	const int ok = s.underruns == 0 && s.overruns == 0 && s.dropped == 0 && o.max_step < MAX_STEP &&
+		direction * s.ratio_ppm > 300 && direction * s.ratio_ppm < 550;
+	const int failed = check(direction > 0 ? "drift, fast sender" : "drift, slow sender", ok, &o);
+
+	aaos_close(o.a);
+	return failed;
+}
+
+// network stall drains the buffer, delayed audio then arrives in a burst
+static int test_stall_burst(void)
+{
+	struct output o;
+	struct aaos_stats s;
+	int failed = 0;
+
+	if (open_output(&o) != 0)
+		return 1;
+
+	for (int i = 0; i < 6; ++i)
+		write_tone(&o, CHUNK, 0);
+
+	for (int i = 0; i < 200; ++i)
+	{
+		write_tone(&o, CHUNK, 0);
+		play(&o, 1);
+	}
+
+	// 600 ms without audio, single underrun concealed with 60 ms fade out, target grows by 20 ms
+	play(&o, 60);
+	aaos_get_stats(o.a, &s);
+	failed += check("stall underrun", s.underruns == 1 && s.concealed == SAMPLE_RATE * AAOS_PLC_FADE_MS / 1000 &&
+		s.target_ms == 80 && s.buffered_ms == 0 && s.dropped == 0, &o);
+
+	// stalled audio at once is latency above target, trimmed to target by the next burst
+	const int32_t burst = 60 * CHUNK;
+	const int32_t depth = SAMPLE_RATE * 80 / 1000;
+
+	failed += check("burst write", write_tone(&o, burst, 0) == burst, &o);
+
+	// a frame may be left from before the stall
+	int32_t buffered = (int32_t)(atomic_load(&o.a->head) - atomic_load(&o.a->tail));
+
+	play(&o, 1);
+	aaos_get_stats(o.a, &s);
+	failed += check("burst latency trim", buffered >= burst && s.dropped == buffered - depth && s.buffered_ms < 80 &&
+		s.underruns == 1, &o);
+
+	// more than the ring holds
+	buffered = (int32_t)(atomic_load(&o.a->head) - atomic_load(&o.a->tail));
+	const int32_t second = SAMPLE_RATE;
+	const int32_t written = write_tone(&o, second, 0);
+	const int32_t dropped = s.dropped;
+
+	aaos_get_stats(o.a, &s);
+	failed += check("ring overrun", s.overruns == 1 && written == (int32_t)(o.a->mask + 1) - buffered &&
+		s.dropped == dropped + second - written, &o);
+
+	aaos_close(o.a);
+	return failed;
+}
+
+// chunks of 10 ms stamped with sender clock, lost, duplicated, overlapping and after discontinuity
+static int test_timestamps(void)
+{
+	struct output o;
+	struct aaos_stats s;
+	int64_t t = 1000000;
+	int failed = 0;
+
+	if (open_output(&o) != 0)
+		return 1;
+
+	for (int i = 0; i < 100; ++i, t += 10000)
+	{
+		write_tone(&o, CHUNK, t);
+		play(&o, i >= 6);
+	}
+
+	aaos_get_stats(o.a, &s);
+	failed += check("timestamped steady", s.underruns == 0 && s.concealed == 0 && s.dropped == 0, &o);
+
+	// lost chunk is concealed in its place, the written one follows
+	uint32_t head = atomic_load(&o.a->head);
+
+	o.sent += CHUNK;
+	t += 10000;
+	failed += check("lost chunk concealed", write_tone(&o, CHUNK, t) == CHUNK && aaos_get_stats(o.a, &s) == 0 &&
+		s.concealed == CHUNK && atomic_load(&o.a->head) - head == 2 * CHUNK, &o);
+
+	// retransmitted chunk is nothing new, half overlapping one adds its second half
+	head = atomic_load(&o.a->head);
+	o.sent -= CHUNK;
+	failed += check("duplicate chunk dropped", write_tone(&o, CHUNK, t) == 0 && atomic_load(&o.a->head) == head, &o);
+
+	t += 5000;
+	o.sent -= CHUNK / 2;
+	failed += check("overlapping chunk trimmed", write_tone(&o, CHUNK, t) == CHUNK / 2 &&
+		atomic_load(&o.a->head) - head == CHUNK / 2, &o);
+
+	// gap longer than AAOS_PLC_MAX_GAP_MS is new stream, not loss
+	head = atomic_load(&o.a->head);
+	t += 10000 + 300000;
+	failed += check("discontinuity not concealed", write_tone(&o, CHUNK, t) == CHUNK && aaos_get_stats(o.a, &s) == 0 &&
+		s.concealed == CHUNK && atomic_load(&o.a->head) - head == CHUNK, &o);
+
+	// restarted sender timestamps start over lower, new stream continues from there
+	head = atomic_load(&o.a->head);
+	t = 1000;
+	failed += check("sender restart", write_tone(&o, CHUNK, t) == CHUNK && write_tone(&o, CHUNK, t + 10000) == CHUNK &&
+		aaos_get_stats(o.a, &s) == 0 && s.concealed == CHUNK && atomic_load(&o.a->head) - head == 2 * CHUNK, &o);
+
+	aaos_close(o.a);
+	return failed;
+}
+
+int main(int argc, char** argv)
+{
+	int failed = 0;
+
+	failed += test_steady();
+	failed += test_drift(1);
+	failed += test_drift(-1);
+	failed += test_stall_burst();
+	failed += test_timestamps();
+
+	printf("%d failed\n", failed);
+
+	return failed != 0;
+}
@@ -0,0 +1,303 @@
+/*
+ * HDU SIMD kernels test
+ *
+ * Unprojects random depth and color with every kernel supported by the CPU
+ * and checks that the point clouds are bit-exact with the scalar kernel.
+ * Unprojects known colors with every kernel and checks the RGBA values.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+//kernels are internal to hdu
+#include "../hdu.c"
+
+enum { WIDTH = 101, HEIGHT = 37, FRAMES = 3 }; //width not multiple of any block size
+static const float DEPTH_UNIT = 0.0001f;
+
+struct test_case
+{
+	int depth_format;
+	int color_format;
+	int organized;
+	float temporal_alpha;
+	float spatial_threshold;
+};
+
+static const char *DEPTH_FORMATS[] = {"P010", "P016", "YUV420P10", "GRAY16", "GRAY12"};
+static const char *COLOR_FORMATS[] = {"NV12", "YUV420P"};
+
+//LSB aligned formats need larger unit for the same depth range
+static float depth_unit(int depth_format)
+{
+	return DEPTH_UNIT * (P010LE_MAX + 1) / (HDU_DEPTH_MASK[depth_format] + 1);
+}
+
+//smooth random surface of the format with invalid (0), saturated and jump (flying pixel) values
+static void random_depth(uint16_t *depth, int depth_format)
+{
+	const float unit = depth_unit(depth_format);
+
+	for(int y=0;y<HEIGHT;++y)
+		for(int x=0;x<WIDTH;++x)
+		{
+			const int r = rand() % 20;
+			float meters = 1.0f + 0.5f * sinf(x * 0.1f) + 0.3f * cosf(y * 0.15f) + 0.002f * (rand() % 16);
+
+			if(r == 0)
+				meters = 0.0f;
+			else if(r == 1)
+				meters += 1.0f;
+
+			const float raw = meters / unit;
+
+			depth[y * WIDTH + x] = r == 2 ? HDU_DEPTH_MASK[depth_format] :
+				(uint16_t)(raw > HDU_DEPTH_MASK[depth_format] ? HDU_DEPTH_MASK[depth_format] : raw) & HDU_DEPTH_MASK[depth_format];
+		}
+}
+
+static void random_bytes(uint8_t *data, int n)
+{
+	for(int i=0;i<n;++i)
+		data[i] = (uint8_t)rand();
+}
+
+static int unproject(const struct hdu_kernel *kernel, const struct test_case *t, const struct hdu_depth *depth,
+	struct hdu_point_cloud *pc)
+{
+	struct hdu_config config = {0};
+
+	config.ppx = WIDTH / 2.0f + 0.3f;
+	config.ppy = HEIGHT / 2.0f - 0.2f;
+	config.fx = 60.1f;
+	config.fy = 59.7f;
+	config.depth_unit = depth_unit(t->depth_format);
+	config.min_margin = 0.1f;
+	config.max_margin = 0.1f;
+	config.threads = 1;
+	config.depth_format = t->depth_format;
+	config.color_format = t->color_format;
+	config.organized = t->organized;
+	config.temporal_alpha = t->temporal_alpha;
+	config.temporal_threshold = 0.05f;
+	config.temporal_persistence = 2;
+	config.spatial_threshold = t->spatial_threshold;
+
+	struct hdu *h = hdu_init(&config);
+
+	if(h == NULL)
+		return HDU_ERROR;
+
+	h->kernel = kernel;
+
+	//several frames for temporal filter history
+	for(int f=0;f<FRAMES;++f)
+		if(hdu_unproject(h, depth + f, pc) != HDU_OK)
+		{
+			hdu_close(h);
+			return HDU_ERROR;
+		}
+
+	hdu_close(h);
+	return HDU_OK;
+}
+
+static int test_kernel(const struct hdu_kernel *kernel, const struct test_case *t)
+{
+	const int n = WIDTH * HEIGHT;
+	struct hdu_depth depth[FRAMES] = { {0} };
+	struct hdu_point_cloud pc[2] = { {0} };
+	int result = HDU_ERROR;
+
+	for(int f=0;f<FRAMES;++f)
+	{
+		depth[f].data = (uint16_t*)malloc(n * sizeof(uint16_t));
+		depth[f].colors = (uint8_t*)malloc(n * 3 / 2 + WIDTH); //Y, UV or U and V planes
+		depth[f].width = WIDTH;
+		depth[f].height = HEIGHT;
+		depth[f].depth_stride = WIDTH * sizeof(uint16_t);
+		depth[f].color_stride = WIDTH;
+
+		random_depth(depth[f].data, t->depth_format);
+		random_bytes(depth[f].colors, n * 3 / 2 + WIDTH);
+	}
+
+	for(int k=0;k<2;++k)
+	{
+		pc[k].data = (float3*)malloc(n * sizeof(float3));
+		pc[k].colors = (color32*)malloc(n * sizeof(color32));
+		pc[k].size = n;
+	}
+
+	if(unproject(&HDU_KERNEL_SCALAR, t, depth, &pc[0]) == HDU_OK &&
+		unproject(kernel, t, depth, &pc[1]) == HDU_OK)
+		result = pc[0].used == pc[1].used && pc[0].used > 0 &&
+			memcmp(pc[0].data, pc[1].data, pc[0].used * sizeof(float3)) == 0 &&
+			memcmp(pc[0].colors, pc[1].colors, pc[0].used * sizeof(color32)) == 0 ? HDU_OK : HDU_ERROR;
+
+	printf("%s %-9s %-7s organized %d temporal %d spatial %d: %s (%d points)\n", kernel->name,
+		DEPTH_FORMATS[t->depth_format], COLOR_FORMATS[t->color_format], t->organized,
+		t->temporal_alpha > 0.0f, t->spatial_threshold > 0.0f, result == HDU_OK ? "ok" : "FAILED", pc[0].used);
+
+	for(int f=0;f<FRAMES;++f)
+	{
+		free(depth[f].data);
+		free(depth[f].colors);
+	}
+
+	for(int k=0;k<2;++k)
+	{
+		free(pc[k].data);
+		free(pc[k].colors);
+	}
+
+	return result;
+}
+
+//BT.601 limited range Y, Cb, Cr and expected RGBA (little-endian color32)
+struct known_color
+{
+	const char *name;
+	uint8_t y, u, v;
+	color32 rgba;
+};
+
+static const struct known_color KNOWN_COLORS[] = {
+	{"red", 81, 90, 240, 0xFF0000FF},
+	{"blue", 41, 240, 110, 0xFFFF0000},
+};
+
+//uniform color frame in NV12 or YUV420P, optionally through registration with identity extrinsics
+static int test_known_color(const struct hdu_kernel *kernel, int color_format, int registration, const struct known_color *k)
+{
+	const int n = WIDTH * HEIGHT, chroma = (WIDTH + 1) / 2 * ((HEIGHT + 1) / 2);
+	struct hdu_config config = {0};
+	struct hdu_depth depth = {0};
+	struct hdu_point_cloud pc = {0};
+	int result = HDU_ERROR;
+
+	config.ppx = WIDTH / 2.0f;
+	config.ppy = HEIGHT / 2.0f;
+	config.fx = config.fy = 60.0f;
+	config.depth_unit = DEPTH_UNIT;
+	config.threads = 1;
+	config.color_format = color_format;
+
+	if(registration)
+	{
+		config.color_ppx = config.ppx;
+		config.color_ppy = config.ppy;
+		config.color_fx = config.fx;
+		config.color_fy = config.fy;
+		config.color_rotation[0] = config.color_rotation[4] = config.color_rotation[8] = 1.0f;
+	}
+
+	depth.data = (uint16_t*)malloc(n * sizeof(uint16_t));
+	depth.colors = (uint8_t*)malloc(n);
+	depth.color_u = (uint8_t*)malloc(2 * chroma * 2);
+	depth.width = WIDTH;
+	depth.height = HEIGHT;
+	depth.depth_stride = WIDTH * sizeof(uint16_t);
+	depth.color_stride = WIDTH;
+
+	for(int i=0;i<n;++i)
+		depth.data[i] = (uint16_t)(1.0f / DEPTH_UNIT) & HDU_DEPTH_MASK[HDU_DEPTH_P010];
+
+	memset(depth.colors, k->y, n);
+
+	if(color_format == HDU_COLOR_FORMAT_NV12)
+	{
+		depth.color_uv_stride = (WIDTH + 1) / 2 * 2;
+		for(int i=0;i<2 * chroma;i+=2)
+		{
+			depth.color_u[i] = k->u;
+			depth.color_u[i + 1] = k->v;
+		}
+	}
+	else
+	{
+		depth.color_uv_stride = (WIDTH + 1) / 2;
+		depth.color_v = depth.color_u + chroma;
+		memset(depth.color_u, k->u, chroma);
+		memset(depth.color_v, k->v, chroma);
+	}
+
+	pc.data = (float3*)malloc(n * sizeof(float3));
+	pc.colors = (color32*)malloc(n * sizeof(color32));
+	pc.size = n;
+
+	struct hdu *h = hdu_init(&config);
+
+	if(h != NULL)
+	{
+		h->kernel = kernel;
+
+		if(hdu_unproject(h, &depth, &pc) == HDU_OK && pc.used > 0)
+		{
+			result = HDU_OK;
+			for(int i=0;i<pc.used;++i)
+				if(pc.colors[i] != k->rgba)
+					result = HDU_ERROR;
+		}
+
+		hdu_close(h);
+	}
+
+	printf("%s %-7s %s %-4s: %s (%d points)\n", kernel->name, COLOR_FORMATS[color_format],
+		registration ? "registered" : "aligned   ", k->name, result == HDU_OK ? "ok" : "FAILED", pc.used);
+
+	free(depth.data);
+	free(depth.colors);
+	free(depth.color_u);
+	free(pc.data);
+	free(pc.colors);
+
+	return result;
+}
+
+int main(int argc, char **argv)
+{
+	const struct hdu_kernel *kernels[4];
+	int count = 0, failed = 0;
+
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+
+	if(__builtin_cpu_supports("sse4.1"))
+		kernels[count++] = &HDU_KERNEL_SSE41;
+	if(__builtin_cpu_supports("avx2"))
+		kernels[count++] = &HDU_KERNEL_AVX2;
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	if(hdu_select_kernel() == &HDU_KERNEL_NEON)
+		kernels[count++] = &HDU_KERNEL_NEON;
+#endif
+
+	if(count == 0)
+		printf("no SIMD kernels supported, nothing to test\n");
+
+	srand(1);
+
+	for(int k=0;k<count;++k)
+		for(int d=HDU_DEPTH_P010;d<=HDU_DEPTH_GRAY12;++d)
+			for(int c=HDU_COLOR_FORMAT_NV12;c<=HDU_COLOR_FORMAT_YUV420P;++c)
+				for(int o=0;o<2;++o)
+					for(int filters=0;filters<4;++filters)
+					{
+						const struct test_case t = {d, c, o, filters & 1 ? 0.5f : 0.0f, filters & 2 ? 0.05f : 0.0f};
+						failed += test_kernel(kernels[k], &t) != HDU_OK;
+					}
+
+	kernels[count++] = &HDU_KERNEL_SCALAR;
+
+	for(int k=0;k<count;++k)
+		for(int c=HDU_COLOR_FORMAT_NV12;c<=HDU_COLOR_FORMAT_YUV420P;++c)
+			for(int r=0;r<2;++r)
+				for(int i=0;i<(int)(sizeof(KNOWN_COLORS) / sizeof(KNOWN_COLORS[0]));++i)
+					failed += test_known_color(kernels[k], c, r, KNOWN_COLORS + i) != HDU_OK;
+
+	printf("%d failed\n", failed);
+
+	return failed != 0;
+}
@@ -0,0 +1,159 @@
+/*
+ * HDU temporal filter test
+ *
+ * Feeds depth steps up and down through the temporal filter of every kernel
+ * supported by the CPU and checks that smoothed depth moves monotonically
+ * towards the new depth without overshoot and reaches it exactly.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+//kernels are internal to hdu
+#include "../hdu.c"
+
+enum { WIDTH = 37, HEIGHT = 3, FRAMES = 300 }; //width not multiple of any block size
+static const float DEPTH_UNIT = 0.0001f;
+
+struct test_case
+{
+	int depth_format;
+	int from; //raw depth before step
+	int to; //raw depth after step
+	float alpha;
+};
+
+static const char *DEPTH_FORMATS[] = {"P010", "P016", "YUV420P10", "GRAY16", "GRAY12"};
+
+static int test_step(const struct hdu_kernel *kernel, const struct test_case *t)
+{
+	const int n = WIDTH * HEIGHT;
+	const float from = t->from * DEPTH_UNIT, to = t->to * DEPTH_UNIT;
+	struct hdu_config config = {0};
+	struct hdu_depth depth = {0};
+	struct hdu_point_cloud pc = {0};
+	float previous = from;
+	int result = HDU_OK, converged = -1;
+
+	config.ppx = WIDTH / 2.0f;
+	config.ppy = HEIGHT / 2.0f;
+	config.fx = 30.0f;
+	config.fy = 30.0f;
+	config.depth_unit = DEPTH_UNIT;
+	config.min_margin = 0.01f;
+	config.max_margin = 0.01f;
+	config.threads = 1;
+	config.depth_format = t->depth_format;
+	config.organized = 1;
+	config.temporal_alpha = t->alpha;
+	config.temporal_threshold = 1.0f; //step is never motion
+	config.temporal_persistence = 2;
+
+	struct hdu *h = hdu_init(&config);
+
+	depth.data = (uint16_t*)malloc(n * sizeof(uint16_t));
+	depth.colors = (uint8_t*)calloc(n * 3 / 2 + WIDTH, 1);
+	depth.width = WIDTH;
+	depth.height = HEIGHT;
+	depth.depth_stride = WIDTH * sizeof(uint16_t);
+	depth.color_stride = WIDTH;
+
+	pc.data = (float3*)malloc(n * sizeof(float3));
+	pc.colors = (color32*)malloc(n * sizeof(color32));
+	pc.size = n;
+
+	if(h == NULL || depth.data == NULL || depth.colors == NULL || pc.data == NULL || pc.colors == NULL)
+		result = HDU_ERROR;
+	else
+		h->kernel = kernel;
+
+	//first frame starts history at old depth
+	for(int f=0;f<FRAMES && result == HDU_OK;++f)
+	{
+		for(int i=0;i<n;++i)
+			depth.data[i] = f ? t->to : t->from;
+
+		if(hdu_unproject(h, &depth, &pc) != HDU_OK || pc.used != n)
+		{
+			result = HDU_ERROR;
+			break;
+		}
+
+		const float z = pc.data[0][2];
+
+		//all pixels filter the same, forward and never past new depth
+		for(int i=0;i<n;++i)
+			if(pc.data[i][2] != z)
+				result = HDU_ERROR;
+
+		if(f == 0 && z != from)
+			result = HDU_ERROR;
+
+		if(f && (to > from ? z < previous || z > to : z > previous || z < to))
+			result = HDU_ERROR;
+
+		if(z == to && converged < 0)
+			converged = f;
+
+		previous = z;
+	}
+
+	//new depth exactly, as unprojected without filter
+	if(converged < 0 || previous != to)
+		result = HDU_ERROR;
+
+	printf("%s %-9s %5d -> %5d alpha %.2f: %s (converged in %d frames)\n", kernel->name,
+		DEPTH_FORMATS[t->depth_format], t->from, t->to, t->alpha, result == HDU_OK ? "ok" : "FAILED", converged);
+
+	hdu_close(h);
+	free(depth.data);
+	free(depth.colors);
+	free(pc.data);
+	free(pc.colors);
+
+	return result;
+}
+
+int main(int argc, char **argv)
+{
+	const struct hdu_kernel *kernels[4];
+	int count = 0, failed = 0;
+
+	kernels[count++] = &HDU_KERNEL_SCALAR;
+
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+
+	if(__builtin_cpu_supports("sse4.1"))
+		kernels[count++] = &HDU_KERNEL_SSE41;
+	if(__builtin_cpu_supports("avx2"))
+		kernels[count++] = &HDU_KERNEL_AVX2;
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	if(hdu_select_kernel() == &HDU_KERNEL_NEON)
+		kernels[count++] = &HDU_KERNEL_NEON;
+#endif
+
+	//P010 steps by one 10 bit level (64), others by a few units where truncation stalls
+	const struct test_case cases[] =
+	{
+		{HDU_DEPTH_P010, 6400, 7040, 0.5f},
+		{HDU_DEPTH_P010, 7040, 6400, 0.5f},
+		{HDU_DEPTH_P010, 6400, 6464, 0.1f},
+		{HDU_DEPTH_P010, 6464, 6400, 0.1f},
+		{HDU_DEPTH_P016, 6400, 6403, 0.3f},
+		{HDU_DEPTH_P016, 6403, 6400, 0.3f},
+		{HDU_DEPTH_GRAY16, 5000, 5001, 0.05f},
+		{HDU_DEPTH_GRAY16, 5001, 5000, 0.05f},
+		{HDU_DEPTH_GRAY12, 3000, 3500, 1.0f},
+	};
+
+	for(int k=0;k<count;++k)
+		for(int c=0;c<(int)(sizeof(cases) / sizeof(cases[0]));++c)
+			failed += test_step(kernels[k], &cases[c]) != HDU_OK;
+
+	printf("%d failed\n", failed);
+
+	return failed != 0;
+}
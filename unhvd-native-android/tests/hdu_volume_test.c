@@ -0,0 +1,250 @@
+/*
+ * HDU voxel volume test
+ *
+ * Allocates blocks past volume capacity against reference LRU model and checks
+ * that evicted blocks are no longer found while survivors still are
+ * (hash table with backward shift deletion and LRU eviction).
+ * Integrates points into volume and checks changed block export.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+//volume internals are tested directly
+#include "../hdu.c"
+
+enum { MAX_BLOCKS = 16, OPERATIONS = 20000, EXPORT_BLOCKS = 3 };
+static const float VOXEL_SIZE = 0.1f;
+
+//slot of resident block or -1, without allocation and LRU update
+static int find_block(const struct hdu_volume *v, const int *b)
+{
+	for(uint32_t i = hdu_volume_hash(v, b);v->table[i] != -1;i = (i + 1) & v->table_mask)
+	{
+		const int slot = v->table[i];
+
+		if(v->coords[slot][0] == b[0] && v->coords[slot][1] == b[1] && v->coords[slot][2] == b[2])
+			return slot;
+	}
+
+	return -1;
+}
+
+//table holds exactly resident slots, LRU list matches model (most recent first)
+static int check_volume(const struct hdu_volume *v, int (*model)[3], int resident, int (*pool)[3], int pool_size)
+{
+	int entries = 0, slot = v->lru_head;
+
+	for(uint32_t i=0;i<=v->table_mask;++i)
+		entries += v->table[i] != -1;
+
+	if(entries != resident || v->blocks != resident)
+		return HDU_ERROR;
+
+	for(int m=0;m<resident;++m, slot = v->next[slot])
+		if(slot < 0 || find_block(v, model[m]) != slot)
+			return HDU_ERROR;
+
+	if(slot != -1)
+		return HDU_ERROR;
+
+	//evicted (or never allocated) blocks are not found
+	for(int p=0;p<pool_size;++p)
+	{
+		int in_model = 0;
+
+		for(int m=0;m<resident && !in_model;++m)
+			in_model = memcmp(model[m], pool[p], sizeof(pool[p])) == 0;
+
+		if(!in_model && find_block(v, pool[p]) != -1)
+			return HDU_ERROR;
+	}
+
+	return HDU_OK;
+}
+
+//random blocks from pool, colliding pool hashes to the last table positions to probe past table end
+static int test_eviction(int colliding)
+{
+	const struct hdu_volume_config config = {VOXEL_SIZE, 0.0f, MAX_BLOCKS, 0};
+	struct hdu_volume *v = hdu_volume_init(&config);
+	int pool[64][3], model[MAX_BLOCKS + 1][3];
+	int pool_size = 0, resident = 0, evictions = 0, result = HDU_OK;
+
+	if(v == NULL)
+		return HDU_ERROR;
+
+	for(int z=-8;z<8 && pool_size < 64;++z)
+		for(int y=-8;y<8 && pool_size < 64;++y)
+			for(int x=-8;x<8 && pool_size < 64;++x)
+			{
+				const int b[3] = {x, y, z};
+
+				if(colliding && hdu_volume_hash(v, b) < v->table_mask - 2)
+					continue;
+
+				memcpy(pool[pool_size++], b, sizeof(b));
+			}
+
+	for(int o=0;o<OPERATIONS && result == HDU_OK;++o)
+	{
+		const int *b = pool[rand() % pool_size];
+		int m = 0;
+
+		while(m < resident && memcmp(model[m], b, sizeof(model[m])))
+			++m;
+
+		//block moves to the front, the least recent falls off the end when full
+		if(m == resident)
+			++resident;
+
+		memmove(model + 1, model, m * sizeof(model[0]));
+		memcpy(model[0], b, sizeof(model[0]));
+
+		if(resident > MAX_BLOCKS)
+		{
+			--resident;
+			++evictions;
+		}
+
+		const int slot = hdu_volume_block(v, b);
+
+		if(slot < 0 || slot >= MAX_BLOCKS || memcmp(v->coords[slot], b, sizeof(v->coords[slot])))
+			result = HDU_ERROR;
+		else
+			result = check_volume(v, model, resident, pool, pool_size);
+	}
+
+	printf("eviction %-11s: %s (%d blocks in pool, %d evictions)\n", colliding ? "colliding" : "random",
+		result == HDU_OK ? "ok" : "FAILED", pool_size, evictions);
+
+	hdu_volume_close(v);
+	return result;
+}
+
+//one point (and RGBA color) at voxel 0 of blocks along x axis
+static int integrate(struct hdu_volume *v, const struct hdu *h, const int *blocks, const uint8_t *colors, int n)
+{
+	float3 data[EXPORT_BLOCKS + 1];
+	color32 rgba[EXPORT_BLOCKS + 1];
+	struct hdu_point_cloud pc = {0};
+
+	for(int i=0;i<n;++i)
+	{
+		data[i][0] = (blocks[i] * HDU_VOLUME_BLOCK + 0.5f) * VOXEL_SIZE;
+		data[i][1] = data[i][2] = 0.5f * VOXEL_SIZE;
+		rgba[i] = 0xFF000000 | colors[i];
+	}
+
+	pc.data = data;
+	pc.colors = rgba;
+	pc.size = pc.used = n;
+
+	return hdu_volume_integrate(v, h, &pc);
+}
+
+//dirty ranges of export are expected (first, count) pairs in voxels
+static int check_export(struct hdu_volume *v, struct hdu_point_cloud *pc, const int *expected, int ranges)
+{
+	if(hdu_volume_export(v, pc, 0) != HDU_OK || pc->dirty_ranges != ranges)
+		return HDU_ERROR;
+
+	for(int i=0;i<2 * ranges;++i)
+		if(pc->dirty[i] != expected[i])
+			return HDU_ERROR;
+
+	return HDU_OK;
+}
+
+//slot holds voxel 0 of block with color, all other voxels are empty
+static int check_slot(const struct hdu_point_cloud *pc, int slot, int block, uint8_t color)
+{
+	const float3 *data = pc->data + slot * HDU_VOLUME_BLOCK_VOXELS;
+	const color32 *colors = pc->colors + slot * HDU_VOLUME_BLOCK_VOXELS;
+
+	if(fabsf(data[0][0] - (block * HDU_VOLUME_BLOCK + 0.5f) * VOXEL_SIZE) > 1e-5f ||
+		fabsf(data[0][1] - 0.5f * VOXEL_SIZE) > 1e-5f || colors[0] != (0xFF000000 | color))
+		return HDU_ERROR;
+
+	for(int i=1;i<HDU_VOLUME_BLOCK_VOXELS;++i)
+		if(data[i][0] != 0.0f || data[i][1] != 0.0f || data[i][2] != 0.0f || colors[i] != 0)
+			return HDU_ERROR;
+
+	return HDU_OK;
+}
+
+static int test_export()
+{
+	const struct hdu_volume_config volume_config = {VOXEL_SIZE, 0.0f, EXPORT_BLOCKS, 0};
+	const int B = HDU_VOLUME_BLOCK_VOXELS;
+	struct hdu_config config = {0};
+	struct hdu_point_cloud pc = {0};
+	int dirty[2 * EXPORT_BLOCKS];
+	int result = HDU_ERROR;
+
+	config.ppx = config.ppy = 1.0f;
+	config.fx = config.fy = 1.0f;
+	config.depth_unit = 0.0001f;
+	config.threads = 1;
+
+	struct hdu *h = hdu_init(&config);
+	struct hdu_volume *v = hdu_volume_init(&volume_config);
+
+	pc.data = (float3*)malloc(EXPORT_BLOCKS * B * sizeof(float3));
+	pc.colors = (color32*)malloc(EXPORT_BLOCKS * B * sizeof(color32));
+	pc.size = EXPORT_BLOCKS * B;
+	pc.dirty = dirty;
+
+	//blocks 1, 2, 3 take slots 0, 1, 2, block 4 evicts the least recently updated
+	const int abc[3] = {1, 2, 3}, ac[2] = {1, 3}, c[1] = {3}, d[1] = {4};
+	const uint8_t grey[3] = {100, 100, 100}, darker[2] = {50, 50}, lighter[1] = {150};
+	const int all[2] = {0, EXPORT_BLOCKS * B}, first_three[2] = {0, 3 * B}, third[2] = {2 * B, B},
+		first_and_third[4] = {0, B, 2 * B, B}, second[2] = {B, B};
+
+	if(h != NULL && v != NULL && pc.data != NULL && pc.colors != NULL &&
+		//initial export clears all slots, nothing changes after
+		check_export(v, &pc, all, 1) == HDU_OK && pc.used == 0 &&
+		check_export(v, &pc, NULL, 0) == HDU_OK &&
+		//new blocks
+		integrate(v, h, abc, grey, 3) == HDU_OK && check_export(v, &pc, first_three, 1) == HDU_OK &&
+		pc.used == 3 * B && check_slot(&pc, 0, 1, 100) == HDU_OK && check_slot(&pc, 2, 3, 100) == HDU_OK &&
+		//same color again does not change export
+		integrate(v, h, abc, grey, 3) == HDU_OK && check_export(v, &pc, NULL, 0) == HDU_OK &&
+		//color change of single block
+		integrate(v, h, c, lighter, 1) == HDU_OK && check_export(v, &pc, third, 1) == HDU_OK &&
+		check_slot(&pc, 2, 3, (100 * 2 + 150) / 3) == HDU_OK &&
+		//ranges are not merged over unchanged block
+		integrate(v, h, ac, darker, 2) == HDU_OK && check_export(v, &pc, first_and_third, 2) == HDU_OK &&
+		//block 2 is the least recently updated, its slot is reused and exported without it
+		integrate(v, h, d, lighter, 1) == HDU_OK && check_export(v, &pc, second, 1) == HDU_OK &&
+		check_slot(&pc, 1, 4, 150) == HDU_OK && pc.used == 3 * B &&
+		hdu_volume_export(v, &pc, 1) == HDU_OK && pc.dirty_ranges == 1 && memcmp(dirty, all, sizeof(all)) == 0 &&
+		check_slot(&pc, 1, 4, 150) == HDU_OK)
+		result = HDU_OK;
+
+	printf("changed block export   : %s\n", result == HDU_OK ? "ok" : "FAILED");
+
+	hdu_close(h);
+	hdu_volume_close(v);
+	free(pc.data);
+	free(pc.colors);
+
+	return result;
+}
+
+int main(int argc, char **argv)
+{
+	int failed = 0;
+
+	srand(1);
+
+	failed += test_eviction(0) != HDU_OK;
+	failed += test_eviction(1) != HDU_OK;
+	failed += test_export() != HDU_OK;
+
+	printf("%d failed\n", failed);
+
+	return failed != 0;
+}
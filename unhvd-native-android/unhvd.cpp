@@ -18,11 +18,19 @@
 // Android Audio Output Stream
 #include "aaos.h"
 
+#include "aoc.h"
+
 #include <thread>
+#include <atomic>
 #include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include <fstream>
 #include <iostream>
-#include <string.h> //memset
+#include <string>
+#include <utility> //swap
+#include <string.h> //memcpy
+#include <math.h> //ceilf, sqrtf, isfinite
 #include <android/log.h>
 #include <libavutil/pixdesc.h>
 
@@ -32,7 +40,28 @@
 using namespace std;
 
 static void unhvd_network_decoder_thread(unhvd *n);
-static int unhvd_unproject_depth_frame(unhvd *n, const AVFrame *depth_frame, const AVFrame *texture_frame, hdu_point_cloud *pc);
+static void unhvd_unproject_thread(unhvd *u);
+static void unhvd_camera_thread(unhvd *u, int camera);
+static void unhvd_unproject_push(unhvd *u, AVFrame *frames[], const float *pose, int64_t timestamp);
+static void unhvd_unproject_stop(unhvd *u);
+static int unhvd_unproject_cameras(unhvd *u);
+static int unhvd_unproject_depth_frame(unhvd *n, int camera, const AVFrame *depth_frame, const AVFrame *texture_frame, hdu_point_cloud *pc);
+static int unhvd_unproject_camera(unhvd *u, int camera);
+static bool unhvd_camera_keep(unhvd *u, int camera);
+static void unhvd_set_camera_poses(unhvd *u, const float *pose);
+static void unhvd_point_cloud_layout(unhvd *u);
+static void unhvd_point_cloud_fuse(unhvd *u);
+static int unhvd_depth_format(int pix_fmt);
+static int unhvd_color_format(const AVFrame *texture_frame);
+static void unhvd_point_cloud_free(hdu_point_cloud *pc);
+static void unhvd_volume_update(unhvd *u, bool reset);
+static void unhvd_velocity_update(unhvd *u, std::chrono::steady_clock::time_point time);
+static void unhvd_predict_frame(unhvd *u, const float *pose, float seconds);
+static void unhvd_budget_update(unhvd *u, float ms, int points);
+static void unhvd_audio_write(unhvd *u, const nhvd_frame *raw);
+static void unhvd_audio_decode(unhvd *u, const uint8_t *packet, int size, int64_t timestamp);
+static void unhvd_video_presented(unhvd *u, int64_t timestamp);
+static int64_t unhvd_now_us();
 static unhvd *unhvd_close_and_return_null(unhvd *n, const char *msg);
 static int UNHVD_ERROR_MSG(const char *msg);
 
@@ -47,13 +76,138 @@ struct unhvd
 
 	std::mutex mutex; //guards frame and point_cloud_shared
 
-	hdu *hardware_unprojector;
+	hdu *hardware_unprojector[UNHVD_MAX_CAMERAS];
+	int cameras; //depth cameras, 0 if depth unprojection is not enabled
 	hdu_point_cloud point_cloud, point_cloud_shared;
+	bool point_cloud_new; //guarded by mutex, fresh point_cloud_shared
+	//views of cameras into point cloud arrays and their (first, count) in fused cloud, swapped with point clouds
+	hdu_point_cloud camera_cloud[UNHVD_MAX_CAMERAS], camera_cloud_shared[UNHVD_MAX_CAMERAS];
+	int camera_ranges[2 * UNHVD_MAX_CAMERAS], camera_ranges_shared[2 * UNHVD_MAX_CAMERAS];
+	int fused_frames; //number of fused point clouds
+	bool extrinsic[UNHVD_MAX_CAMERAS]; //camera with non identity extrinsics
+	float extrinsics[UNHVD_MAX_CAMERAS][16]; //camera to rig transform
+	int vertex_format; //hdu_vertex_format of point clouds
+	bool point_colors; //separate colors array in point clouds
+	bool organized; //point per pixel clouds
+	bool mesh; //organized clouds with indices
+	bool normals; //organized clouds with normals
+	int depth_format[UNHVD_MAX_CAMERAS]; //hdu_depth_format of camera stream, -1 before first frame
+	int color_format[UNHVD_MAX_CAMERAS]; //hdu_color_format of camera stream, -1 before first frame
+
+	//unprojection stage queue (ring of referenced depth/texture frame pairs)
+	std::mutex unproject_mutex; //guards the queue
+	std::condition_variable unproject_cv;
+	AVFrame *unproject_depth[UNHVD_UNPROJECT_QUEUE_SIZE][UNHVD_MAX_CAMERAS]; //empty if camera has no new frame
+	AVFrame *unproject_texture[UNHVD_UNPROJECT_QUEUE_SIZE][UNHVD_MAX_CAMERAS];
+	float unproject_pose[UNHVD_UNPROJECT_QUEUE_SIZE][16]; //pose received with the frame
+	bool unproject_posed[UNHVD_UNPROJECT_QUEUE_SIZE];
+	std::chrono::steady_clock::time_point unproject_time[UNHVD_UNPROJECT_QUEUE_SIZE]; //frame arrival
+	int64_t unproject_timestamp[UNHVD_UNPROJECT_QUEUE_SIZE]; //sender timestamp in microseconds, 0 if none
+	int pose_aux; //1 based aux channel with per frame pose, 0 if none
+	int unproject_head;
+	int unproject_size;
+	int unproject_dropped;
+
+	//settings applied by unprojection thread before next frame, guarded by unproject_mutex
+	bool decimation_pending;
+	int decimation_mode;
+	int decimation_stride;
+	float decimation_voxel_size;
+	bool temporal_pending;
+	float temporal_alpha;
+	float temporal_threshold;
+	int temporal_persistence;
+	bool spatial_pending;
+	float spatial_threshold;
+	float spatial_sigma;
+	bool pose_pending;
+	bool posed; //pose set with unhvd_set_pose
+	float pose[16];
+	bool roi_pending;
+	int roi[4];
+	bool frustum_pending;
+	bool frustum; //frustum set with unhvd_set_frustum
+	float view_projection[16];
+	bool background_learn_pending;
+	int background_frames;
+	int background_mode;
+	bool background_pending;
+	float background_threshold;
+
+	//point budget controller, budget guarded by unproject_mutex, state owned by unprojection thread
+	int budget_points; //0 for no point budget
+	float budget_ms; //0 for no time budget
+	int budget_stride; //stride applied by controller, 1 if not limiting
+	bool budget_stride_changed; //applied with pending settings
+	float budget_load; //smoothed budget fraction used at budget_stride, 0 after stride change
+	int budget_frames; //frames at budget_stride
+	float stats_ms; //guarded by mutex, last frame statistics
+	int stats_points;
+	int stats_stride;
+
+	//held by unprojection thread while using hardware_unprojector, background model file access takes it too
+	std::mutex unprojector_mutex;
+
+	//last frames of each camera owned by unprojection thread, kept until camera sends new one
+	AVFrame *camera_depth[UNHVD_MAX_CAMERAS];
+	AVFrame *camera_texture[UNHVD_MAX_CAMERAS];
+	bool camera_stale[UNHVD_MAX_CAMERAS]; //no new frame, view keeps last published points
+
+	//cameras other than the first are unprojected by their threads in parallel with unprojection thread
+	std::mutex camera_mutex; //guards camera_generation, camera_busy, camera_status and camera_stop
+	std::condition_variable camera_cv; //new generation or stop
+	std::condition_variable camera_done_cv; //camera_busy reached 0
+	int camera_generation; //incremented for each frame to unproject
+	int camera_busy; //camera threads still unprojecting current generation
+	int camera_status[UNHVD_MAX_CAMERAS];
+	bool camera_stop;
+	thread camera_thread[UNHVD_MAX_CAMERAS];
+
+	//spatial index of point_cloud_shared, back built by unprojection thread, front queried by user
+	std::mutex index_mutex; //guards index_front
+	hdu_index *index_front;
+	hdu_index *index_back;
+
+	//voxel volume fused by unprojection thread, volume_cloud mirrors its surface for user
+	hdu_volume *volume;
+	int volume_blocks;
+	std::mutex volume_mutex; //guards volume_cloud, volume_changed and volume_frames
+	hdu_point_cloud volume_cloud;
+	uint8_t *volume_changed; //blocks changed since the last retrieval
+	int volume_frames; //number of retrievals with changes
+	bool volume_reset_pending; //guarded by unproject_mutex
+
+	//prediction between decoded frames, request guarded by unproject_mutex, the rest owned by unprojection thread
+	bool predict; //organized clouds with velocities
+	float predict_max_speed;
+	bool predict_pending;
+	bool predict_posed;
+	float predict_pose[16];
+	float predict_seconds;
+	hdu_point_cloud predict_base; //positions, normals and velocities of the last decoded frame
+	std::chrono::steady_clock::time_point predict_time; //arrival of the last decoded frame
+	float predict_interval; //seconds between the last two decoded frames, 0 if unknown
+	int predicted; //predicted frames since the last decoded frame
+	int predicted_shared; //guarded by mutex, predicted of point_cloud_shared
 
 	aaos* audio;
+	int audio_aux; //1 based aux channel with audio, 0 if none
+	bool audio_timestamps; //audio chunks start with sender timestamp
+	int timestamp_aux; //1 based aux channel with video frame sender timestamp, 0 if none
+	aoc *audio_decoder; //NULL for int16 audio
+	int16_t *audio_pcm; //decoded packet
+	int audio_pcm_frames;
+	int64_t audio_next_timestamp; //sender timestamp following the last decoded packet, 0 if none
+	double audio_offset_us; //smoothed playback time minus sender timestamp of audio
+	bool audio_offset_valid;
+	int audio_delay_ms; //jitter buffer delay matching audio to video
+	double video_offset_us; //guarded by mutex, smoothed presentation time minus sender timestamp of video
+	bool video_offset_valid; //guarded by mutex
+	float av_offset_ms; //guarded by mutex, audio_offset_us - video_offset_us
 
 	thread network_thread;
-	bool keep_working;
+	thread unproject_thread;
+	atomic<bool> keep_working; //read by unprojection thread without lock
 
 	unhvd():
 			network_decoder(NULL),
@@ -61,10 +215,106 @@ struct unhvd
 			auxes(0),
 			frame(), //zero out
 			raws(),
-			hardware_unprojector(NULL),
+			hardware_unprojector(), //zero out
+			cameras(0),
 			point_cloud(),
 			point_cloud_shared(),
+			point_cloud_new(false),
+			camera_cloud(),
+			camera_cloud_shared(),
+			camera_ranges(),
+			camera_ranges_shared(),
+			fused_frames(0),
+			extrinsic(),
+			extrinsics(),
+			vertex_format(HDU_VERTEX_FLOAT3),
+			point_colors(true),
+			organized(false),
+			mesh(false),
+			normals(false),
+			depth_format(),
+			color_format(),
+			unproject_depth(),
+			unproject_texture(),
+			unproject_pose(),
+			unproject_posed(),
+			unproject_timestamp(),
+			pose_aux(0),
+			unproject_head(0),
+			unproject_size(0),
+			unproject_dropped(0),
+			decimation_pending(false),
+			decimation_mode(0),
+			decimation_stride(1),
+			decimation_voxel_size(0.0f),
+			temporal_pending(false),
+			temporal_alpha(0.0f),
+			temporal_threshold(0.0f),
+			temporal_persistence(0),
+			spatial_pending(false),
+			spatial_threshold(0.0f),
+			spatial_sigma(0.0f),
+			pose_pending(false),
+			posed(false),
+			pose(),
+			roi_pending(false),
+			roi(),
+			frustum_pending(false),
+			frustum(false),
+			view_projection(),
+			background_learn_pending(false),
+			background_frames(0),
+			background_mode(0),
+			background_pending(false),
+			background_threshold(0.0f),
+			budget_points(0),
+			budget_ms(0.0f),
+			budget_stride(1),
+			budget_stride_changed(false),
+			budget_load(0.0f),
+			budget_frames(0),
+			stats_ms(0.0f),
+			stats_points(0),
+			stats_stride(1),
+			camera_depth(),
+			camera_texture(),
+			camera_stale(),
+			camera_generation(0),
+			camera_busy(0),
+			camera_status(),
+			camera_stop(false),
+			index_front(NULL),
+			index_back(NULL),
+			volume(NULL),
+			volume_blocks(0),
+			volume_cloud(),
+			volume_changed(NULL),
+			volume_frames(0),
+			volume_reset_pending(false),
+			predict(false),
+			predict_max_speed(0.0f),
+			predict_pending(false),
+			predict_posed(false),
+			predict_pose(),
+			predict_seconds(0.0f),
+			predict_base(),
+			predict_interval(0.0f),
+			predicted(0),
+			predicted_shared(0),
 			audio(NULL),
+			audio_aux(0),
+			audio_timestamps(false),
+			timestamp_aux(0),
+			audio_decoder(NULL),
+			audio_pcm(NULL),
+			audio_pcm_frames(0),
+			audio_next_timestamp(0),
+			audio_offset_us(0.0),
+			audio_offset_valid(false),
+			audio_delay_ms(0),
+			video_offset_us(0.0),
+			video_offset_valid(false),
+			av_offset_ms(0.0f),
 			keep_working(true)
 	{}
 };
@@ -74,6 +324,14 @@ struct unhvd *unhvd_init(
 	const unhvd_hw_config *hw_config, int hw_size, int aux_size,
 	const unhvd_depth_config *depth_config)
 {
+	return unhvd_init_cameras(net_config, hw_config, hw_size, aux_size, depth_config, depth_config ? 1 : 0);
+}
+
+struct unhvd *unhvd_init_cameras(
+	const unhvd_net_config *net_config,
+	const unhvd_hw_config *hw_config, int hw_size, int aux_size,
+	const unhvd_depth_config *depth_configs, int cameras)
+{
 	
 	LOGI("starting unhvd_init()");
 	nhvd_net_config nhvd_net = {net_config->ip, net_config->port, net_config->timeout_ms};
@@ -82,6 +340,16 @@ struct unhvd *unhvd_init(
 	if(hw_size > UNHVD_MAX_DECODERS)
 		return unhvd_close_and_return_null(NULL, "the maximum number of decoders (compile time) exceeded");
 
+	if(aux_size < 0 || hw_size + aux_size > UNHVD_MAX_DECODERS + UNHVD_MAX_AUX_CHANNELS)
+		return unhvd_close_and_return_null(NULL, "the maximum number of decoders and aux channels (compile time) exceeded");
+
+	if(cameras < 0 || cameras > UNHVD_MAX_CAMERAS || (cameras && depth_configs == NULL))
+		return unhvd_close_and_return_null(NULL, "invalid number of cameras");
+
+	//depth of camera i in decoder 2 * i, texture (optional for the last) in 2 * i + 1
+	if(cameras && hw_size < 2 * cameras - 1)
+		return unhvd_close_and_return_null(NULL, "not enough decoders for depth cameras");
+
 	unhvd *u=new unhvd();
 
 	if(u == NULL)
@@ -110,20 +378,155 @@ struct unhvd *unhvd_init(
 		u->frame[i]->data[0] = NULL;
 	}
 
-	if(depth_config)
+	for(int c=0;c<cameras;++c)
 	{
-		const unhvd_depth_config *dc = depth_config;
-		const hdu_config hdu_cfg = {dc->ppx, dc->ppy, dc->fx, dc->fy, dc->depth_unit, dc->min_margin, dc->max_margin};
-		LOGI("Initializing HDU: %f, %f, %f, %f, %f, %f, %f", dc->ppx, dc->ppy, dc->fx, dc->fy, dc->depth_unit, dc->min_margin, dc->max_margin);
-
-		if( (u->hardware_unprojector = hdu_init(&hdu_cfg)) == NULL )
+		//output layout is common to all cameras
+		const unhvd_depth_config *dc = depth_configs + c, *lc = depth_configs;
+		hdu_config hdu_cfg = {dc->ppx, dc->ppy, dc->fx, dc->fy, dc->depth_unit, dc->min_margin, dc->max_margin, dc->threads, dc->distortion_model};
+		memcpy(hdu_cfg.distortion_coeffs, dc->distortion_coeffs, sizeof(hdu_cfg.distortion_coeffs));
+		hdu_cfg.vertex_format = lc->vertex_format;
+		hdu_cfg.position_scale = lc->position_scale;
+		memcpy(hdu_cfg.position_offset, lc->position_offset, sizeof(hdu_cfg.position_offset));
+		hdu_cfg.color_output = lc->color_output;
+		hdu_cfg.temporal_alpha = dc->temporal_alpha;
+		hdu_cfg.temporal_threshold = dc->temporal_threshold;
+		hdu_cfg.temporal_persistence = dc->temporal_persistence;
+		hdu_cfg.spatial_threshold = dc->spatial_threshold;
+		hdu_cfg.spatial_sigma = dc->spatial_sigma;
+		hdu_cfg.organized = lc->organized;
+		hdu_cfg.delta_threshold = dc->delta_threshold;
+		hdu_cfg.background_threshold = dc->background_threshold;
+		hdu_cfg.mesh_threshold = dc->mesh_threshold;
+		hdu_cfg.color_ppx = dc->color_ppx;
+		hdu_cfg.color_ppy = dc->color_ppy;
+		hdu_cfg.color_fx = dc->color_fx;
+		hdu_cfg.color_fy = dc->color_fy;
+		memcpy(hdu_cfg.color_rotation, dc->color_rotation, sizeof(hdu_cfg.color_rotation));
+		memcpy(hdu_cfg.color_translation, dc->color_translation, sizeof(hdu_cfg.color_translation));
+		u->vertex_format = lc->vertex_format;
+		u->organized = lc->organized != 0;
+		u->mesh = u->organized && lc->mesh;
+		u->normals = u->organized && lc->normals;
+		u->pose_aux = lc->pose_aux;
+		u->predict = lc->predict != 0;
+		u->predict_max_speed = lc->predict_max_speed;
+
+		if(u->pose_aux < 0 || u->pose_aux > aux_size)
+			return unhvd_close_and_return_null(u, "pose aux channel out of range");
+		if(u->mesh && cameras > 1)
+			return unhvd_close_and_return_null(u, "mesh output is supported only with single camera");
+		if(u->vertex_format == HDU_VERTEX_SOA && cameras > 1)
+			return unhvd_close_and_return_null(u, "SOA vertex format is supported only with single camera");
+		if(u->predict && (!u->organized || u->vertex_format != HDU_VERTEX_FLOAT3))
+			return unhvd_close_and_return_null(u, "prediction requires organized point cloud of float3 vertices");
+		if(u->predict_max_speed < 0.0f)
+			return unhvd_close_and_return_null(u, "invalid prediction speed limit");
+		u->point_colors = lc->vertex_format != HDU_VERTEX_FLOAT3_COLOR32 && lc->color_output != HDU_COLOR_NONE;
+		LOGI("Initializing HDU %d: %f, %f, %f, %f, %f, %f, %f, %d", c, dc->ppx, dc->ppy, dc->fx, dc->fy, dc->depth_unit, dc->min_margin, dc->max_margin, dc->threads);
+
+		if( (u->hardware_unprojector[c] = hdu_init(&hdu_cfg)) == NULL )
 			return unhvd_close_and_return_null(u, "failed to initialize hardware unprojector");
+
+		u->cameras = c + 1;
+		u->depth_format[c] = u->color_format[c] = -1;
+
+		//all zero extrinsics is identity
+		for(int i=0;i<16;++i)
+			u->extrinsic[c] = u->extrinsic[c] || dc->extrinsics[i] != 0.0f;
+
+		if(u->extrinsic[c])
+		{
+			memcpy(u->extrinsics[c], dc->extrinsics, sizeof(u->extrinsics[c]));
+			hdu_set_pose(u->hardware_unprojector[c], u->extrinsics[c]);
+		}
+
+		if( (u->camera_depth[c] = av_frame_alloc()) == NULL ||
+			(u->camera_texture[c] = av_frame_alloc()) == NULL )
+			return unhvd_close_and_return_null(u, "not enough memory for camera frames");
+
+		for(int i=0;i<UNHVD_UNPROJECT_QUEUE_SIZE;++i)
+			if( (u->unproject_depth[i][c] = av_frame_alloc()) == NULL ||
+				(u->unproject_texture[i][c] = av_frame_alloc()) == NULL )
+				return unhvd_close_and_return_null(u, "not enough memory for unprojection queue");
+	}
+
+	if(cameras)
+	{
+		const float cell_size = depth_configs->index_cell_size;
+
+		if(cell_size < 0.0f)
+			return unhvd_close_and_return_null(u, "invalid spatial index cell size");
+
+		if(cell_size > 0.0f &&
+			((u->index_front = hdu_index_init(cell_size)) == NULL ||
+			(u->index_back = hdu_index_init(cell_size)) == NULL) )
+			return unhvd_close_and_return_null(u, "failed to initialize spatial index");
+	}
+
+	if(cameras && depth_configs->volume_voxel_size > 0.0f)
+	{
+		const unhvd_depth_config *dc = depth_configs;
+		hdu_volume_config volume_cfg = {dc->volume_voxel_size, dc->volume_truncation, dc->volume_max_blocks, dc->volume_min_weight};
+
+		if( (u->volume = hdu_volume_init(&volume_cfg)) == NULL )
+			return unhvd_close_and_return_null(u, "failed to initialize voxel volume");
+
+		const int capacity = hdu_volume_capacity(u->volume);
+
+		u->volume_blocks = capacity / HDU_VOLUME_BLOCK_VOXELS;
+		u->volume_cloud.data = reinterpret_cast<float3*>(new uint8_t[capacity * sizeof(float3)]);
+		u->volume_cloud.colors = new color32[capacity];
+		u->volume_cloud.dirty = new int[2 * u->volume_blocks];
+		u->volume_cloud.size = capacity;
+		u->volume_changed = new uint8_t[u->volume_blocks];
+
+		//the first retrieval covers all blocks
+		hdu_volume_export(u->volume, &u->volume_cloud, 1);
+		memset(u->volume_changed, 1, u->volume_blocks);
 	}
 
+	//by default the only aux channel is audio unless it carries pose or timestamps
+	u->audio_aux = net_config->audio_aux;
+	u->audio_timestamps = net_config->audio_timestamps != 0;
+	u->timestamp_aux = net_config->timestamp_aux;
+
+	if(u->audio_aux == 0)
+		u->audio_aux = aux_size == 1 && u->pose_aux != 1 && u->timestamp_aux != 1;
+	else if(u->audio_aux == -1)
+		u->audio_aux = 0;
+
+	if(u->audio_aux < 0 || u->audio_aux > aux_size)
+		return unhvd_close_and_return_null(u, "audio aux channel out of range");
+	if(u->timestamp_aux < 0 || u->timestamp_aux > aux_size)
+		return unhvd_close_and_return_null(u, "timestamp aux channel out of range");
+	if(u->audio_aux && (u->audio_aux == u->pose_aux || u->audio_aux == u->timestamp_aux))
+		return unhvd_close_and_return_null(u, "audio aux channel used for pose or timestamps");
+	if(net_config->audio_codec != UNHVD_AUDIO_PCM && net_config->audio_codec != UNHVD_AUDIO_OPUS)
+		return unhvd_close_and_return_null(u, "unsupported audio codec");
+
 	// set up the native audio output
-	u->audio = aaos_init();
+	if(u->audio_aux && (u->audio = aaos_init()) == NULL)
+		return unhvd_close_and_return_null(u, "failed to initialize audio output");
+
+	//decoder defaults match audio output (24 kHz mono)
+	if(u->audio && net_config->audio_codec == UNHVD_AUDIO_OPUS)
+	{
+		aoc_config audio_config = {0};
+
+		if( (u->audio_decoder = aoc_init_decoder(&audio_config)) == NULL)
+			return unhvd_close_and_return_null(u, "failed to initialize audio decoder");
+
+		u->audio_pcm_frames = aoc_frame_size(u->audio_decoder);
+		u->audio_pcm = new int16_t[u->audio_pcm_frames];
+	}
 
 	u->network_thread = thread(unhvd_network_decoder_thread, u);
+
+	if(u->cameras)
+		u->unproject_thread = thread(unhvd_unproject_thread, u);
+
+	for(int c=1;c<u->cameras;++c)
+		u->camera_thread[c] = thread(unhvd_camera_thread, u, c);
 	
 	LOGI("unhvd: finishing unhvd_init()");
 	return u;
@@ -142,7 +545,7 @@ static void unhvd_network_decoder_thread(unhvd *u)
 
 	int status;
 
-	LOGI("Network decoder thread: %d decoders, hdu: %p", u->decoders, u->hardware_unprojector);
+	LOGI("Network decoder thread: %d decoders, %d cameras", u->decoders, u->cameras);
 
 
 	while( u->keep_working &&
@@ -158,17 +561,25 @@ static void unhvd_network_decoder_thread(unhvd *u)
 		//	LOGI("Center depth point: %d", depth_data[frames[0]->linesize[0] * frames[0]->height / 4 + frames[0]->width / 2]); // seems to report real data (e.g. 1..1000)
 		//}
 
-		if(u->hardware_unprojector && frames[0])
-			if(unhvd_unproject_depth_frame(u, frames[0], frames[1], &u->point_cloud) != UNHVD_OK)
-				break;
+		const nhvd_frame *stamp = u->timestamp_aux ? &u->raws[u->decoders + u->timestamp_aux - 1] : NULL;
+		int64_t timestamp = 0;
 
-		// TODO try writing the first aux channel to the audio device for frames that include audio
-		if (u->auxes == 1 && u->raws[u->decoders].size > 0)
+		if(stamp && stamp->data && stamp->size == sizeof(timestamp))
+			memcpy(&timestamp, stamp->data, sizeof(timestamp));
+
+		//unprojection happens on its own thread, overlapping decoding of the next frame
+		if(u->cameras)
 		{
-			// aux channel 1 is an array of bytes that are 2-byte int16_t encoded
-			aaos_write(u->audio, (int16_t*)u->raws[u->decoders].data, u->raws[u->decoders].size / 2);
+			const nhvd_frame *pose = u->pose_aux ? &u->raws[u->decoders + u->pose_aux - 1] : NULL;
+			const bool has_pose = pose && pose->data && pose->size == 16 * sizeof(float);
+
+			unhvd_unproject_push(u, frames, has_pose ? (const float*)pose->data : NULL, timestamp);
 		}
 
+		// audio is queued in the jitter buffer that the audio device callback plays
+		if(u->audio)
+			unhvd_audio_write(u, &u->raws[u->decoders + u->audio_aux - 1]);
+
 		//the next call to nhvd_receive will unref the current
 		//frames so we have to either consume set of frames or ref it
 		std::lock_guard<std::mutex> frame_guard(u->mutex);
@@ -180,12 +591,9 @@ static void unhvd_network_decoder_thread(unhvd *u)
 				av_frame_ref(u->frame[i], frames[i]);
 			}
 
-		if(u->hardware_unprojector && frames[0])
-		{	//swap internal and shared point cloud (copy 2 ints and 2 pointers)
-			hdu_point_cloud temp = u->point_cloud_shared;
-			u->point_cloud_shared = u->point_cloud;
-			u->point_cloud = temp;
-		}
+		//without unprojection frames are presented as soon as decoded
+		if(!u->cameras && timestamp)
+			unhvd_video_presented(u, timestamp);
 
 		// TODO remove after testing
 		//LOGI("Frame sizes: %d, %d, %d, %d", u->raws[0].size, u->raws[1].size, u->raws[2].size, u->raws[3].size);
@@ -194,41 +602,976 @@ static void unhvd_network_decoder_thread(unhvd *u)
 	if (u->keep_working)
 	{
 		LOGI("unhvd: network decoder fatal error");
-		u->keep_working = false; // signal the rest of the program that the network thread is finished
+		unhvd_unproject_stop(u); // signal the rest of the program that the network thread is finished
 	}
 
 	LOGI("unhvd: network decoder thread finished");
 }
 
-static int unhvd_unproject_depth_frame(unhvd *u, const AVFrame *depth_frame, const AVFrame *texture_frame, hdu_point_cloud *pc)
+//called from network decoder thread, references frames so that nhvd may reuse its own
+//frames hold depth of camera i at 2 * i and texture at 2 * i + 1 (NULL if not decoded)
+static void unhvd_unproject_push(unhvd *u, AVFrame *frames[], const float *pose, int64_t timestamp)
+{
+	bool depth = false;
+
+	for(int c=0;c<u->cameras;++c)
+		depth = depth || frames[2 * c];
+
+	if(!depth)
+		return;
+
+	std::lock_guard<std::mutex> queue_guard(u->unproject_mutex);
+
+	//unprojection is falling behind, drop the oldest frames rather than add latency
+	if(u->unproject_size == UNHVD_UNPROJECT_QUEUE_SIZE)
+	{
+		for(int c=0;c<u->cameras;++c)
+		{
+			av_frame_unref(u->unproject_depth[u->unproject_head][c]);
+			av_frame_unref(u->unproject_texture[u->unproject_head][c]);
+		}
+		u->unproject_head = (u->unproject_head + 1) % UNHVD_UNPROJECT_QUEUE_SIZE;
+		--u->unproject_size;
+		++u->unproject_dropped;
+	}
+
+	const int tail = (u->unproject_head + u->unproject_size) % UNHVD_UNPROJECT_QUEUE_SIZE;
+
+	for(int c=0;c<u->cameras;++c)
+	{
+		AVFrame *depth_frame = frames[2 * c], *texture_frame = 2 * c + 1 < u->decoders ? frames[2 * c + 1] : NULL;
+
+		//camera without new frame keeps its last one
+		if(!depth_frame)
+			continue;
+
+		if(av_frame_ref(u->unproject_depth[tail][c], depth_frame) != 0)
+		{
+			LOGI("unhvd: failed to reference depth frame for unprojection");
+			continue;
+		}
+
+		if(texture_frame && av_frame_ref(u->unproject_texture[tail][c], texture_frame) != 0)
+			LOGI("unhvd: failed to reference texture frame for unprojection");
+	}
+
+	if( (u->unproject_posed[tail] = pose != NULL) )
+		memcpy(u->unproject_pose[tail], pose, sizeof(u->unproject_pose[tail]));
+	u->unproject_time[tail] = std::chrono::steady_clock::now();
+	u->unproject_timestamp[tail] = timestamp;
+
+	++u->unproject_size;
+	u->unproject_cv.notify_one();
+}
+
+//wakes up unprojection thread so that it can notice keep_working change
+static void unhvd_unproject_stop(unhvd *u)
+{
+	u->keep_working = false;
+
+	{	//make sure unprojection thread is either waiting or will see the change
+		std::lock_guard<std::mutex> queue_guard(u->unproject_mutex);
+	}
+
+	u->unproject_cv.notify_all();
+}
+
+static void unhvd_unproject_thread(unhvd *u)
+{
+	while(u->keep_working)
+	{
+		std::unique_lock<std::mutex> unprojector_lock(u->unprojector_mutex, std::defer_lock);
+		bool volume_reset = false;
+		std::chrono::steady_clock::time_point frame_time;
+		int64_t frame_timestamp = 0;
+
+		{
+			std::unique_lock<std::mutex> queue_lock(u->unproject_mutex);
+			u->unproject_cv.wait(queue_lock, [u]{ return u->unproject_size > 0 || u->predict_pending || !u->keep_working; });
+
+			if(!u->keep_working)
+				break;
+
+			//decoded frame makes pending prediction obsolete
+			const bool predict = u->predict_pending && u->unproject_size == 0;
+			u->predict_pending = false;
+
+			if(predict)
+			{
+				float pose[16];
+				const bool posed = u->predict_posed;
+				const float seconds = u->predict_seconds;
+
+				memcpy(pose, u->predict_pose, sizeof(pose));
+				queue_lock.unlock();
+
+				unhvd_predict_frame(u, posed ? pose : NULL, seconds);
+				continue;
+			}
+
+			//not while waiting for frames, background model may be saved or loaded meanwhile
+			unprojector_lock.lock();
+
+			//take ownership of the oldest frames, the slot is left clean for next push
+			//camera without new frame keeps its last one
+			for(int c=0;c<u->cameras;++c)
+			{
+				u->camera_stale[c] = !u->unproject_depth[u->unproject_head][c]->data[0];
+
+				if(u->camera_stale[c])
+					continue;
+
+				av_frame_unref(u->camera_depth[c]);
+				av_frame_unref(u->camera_texture[c]);
+				av_frame_move_ref(u->camera_depth[c], u->unproject_depth[u->unproject_head][c]);
+				av_frame_move_ref(u->camera_texture[c], u->unproject_texture[u->unproject_head][c]);
+			}
+
+			//pose streamed with the frame takes precedence over the one set by user
+			if(u->unproject_posed[u->unproject_head])
+				unhvd_set_camera_poses(u, u->unproject_pose[u->unproject_head]);
+			else if(u->pose_pending)
+				unhvd_set_camera_poses(u, u->posed ? u->pose : NULL);
+			u->pose_pending = u->unproject_posed[u->unproject_head];
+			frame_time = u->unproject_time[u->unproject_head];
+			frame_timestamp = u->unproject_timestamp[u->unproject_head];
+
+			u->unproject_head = (u->unproject_head + 1) % UNHVD_UNPROJECT_QUEUE_SIZE;
+			--u->unproject_size;
+
+			//arguments were validated by the setter, settings apply to all cameras
+			//budget controller stride overrides user decimation while limiting
+			for(int c=0;c<u->cameras && (u->decimation_pending || u->budget_stride_changed);++c)
+				if(u->budget_stride > 1)
+					hdu_set_decimation(u->hardware_unprojector[c], HDU_DECIMATION_STRIDE, u->budget_stride, 0.0f);
+				else
+					hdu_set_decimation(u->hardware_unprojector[c], u->decimation_mode, u->decimation_stride, u->decimation_voxel_size);
+			u->decimation_pending = u->budget_stride_changed = false;
+
+			for(int c=0;c<u->cameras && u->temporal_pending;++c)
+				hdu_set_temporal(u->hardware_unprojector[c], u->temporal_alpha, u->temporal_threshold, u->temporal_persistence);
+			u->temporal_pending = false;
+
+			for(int c=0;c<u->cameras && u->spatial_pending;++c)
+				hdu_set_spatial(u->hardware_unprojector[c], u->spatial_threshold, u->spatial_sigma);
+			u->spatial_pending = false;
+
+			for(int c=0;c<u->cameras && u->roi_pending;++c)
+				hdu_set_roi(u->hardware_unprojector[c], u->roi[0], u->roi[1], u->roi[2], u->roi[3]);
+			u->roi_pending = false;
+
+			for(int c=0;c<u->cameras && u->frustum_pending;++c)
+				hdu_set_frustum(u->hardware_unprojector[c], u->frustum ? u->view_projection : NULL);
+			u->frustum_pending = false;
+
+			for(int c=0;c<u->cameras && u->background_learn_pending;++c)
+				hdu_background_learn(u->hardware_unprojector[c], u->background_frames, u->background_mode);
+			u->background_learn_pending = false;
+
+			for(int c=0;c<u->cameras && u->background_pending;++c)
+				hdu_set_background(u->hardware_unprojector[c], u->background_threshold);
+			u->background_pending = false;
+
+			volume_reset = u->volume_reset_pending;
+			u->volume_reset_pending = false;
+		}
+
+		const auto start = std::chrono::steady_clock::now();
+
+		if(unhvd_unproject_cameras(u) != UNHVD_OK)
+		{
+			LOGI("unhvd: unprojection fatal error");
+			unhvd_unproject_stop(u);
+		}
+		else
+		{
+			const float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+			const int stride = u->budget_stride;
+
+			unhvd_budget_update(u, ms, u->point_cloud.used);
+
+			if(u->predict)
+				unhvd_velocity_update(u, frame_time);
+
+			//consumer has seen predicted positions, all points differ from them
+			if(u->predicted)
+			{
+				u->point_cloud.dirty[0] = 0;
+				u->point_cloud.dirty[1] = u->point_cloud.used;
+				u->point_cloud.dirty_ranges = u->point_cloud.used > 0;
+			}
+
+			//swap internal and shared point cloud with camera views (copy ints and pointers)
+			std::lock_guard<std::mutex> frame_guard(u->mutex);
+			u->stats_ms = ms;
+			u->stats_points = u->point_cloud.used;
+			u->stats_stride = stride;
+			std::swap(u->point_cloud, u->point_cloud_shared);
+			std::swap(u->camera_cloud, u->camera_cloud_shared);
+			std::swap(u->camera_ranges, u->camera_ranges_shared);
+			u->predicted_shared = u->predicted = 0;
+			u->point_cloud_new = true;
+
+			if(frame_timestamp)
+				unhvd_video_presented(u, frame_timestamp);
+		}
+
+		//shared point cloud is only replaced by this thread, index it outside the lock
+		if(u->keep_working && u->index_back)
+		{
+			if(hdu_index_build(u->index_back, u->hardware_unprojector[0], &u->point_cloud_shared) != HDU_OK)
+				LOGI("unhvd: failed to build spatial index");
+			else
+			{
+				std::lock_guard<std::mutex> index_guard(u->index_mutex);
+				hdu_index *temp = u->index_front;
+				u->index_front = u->index_back;
+				u->index_back = temp;
+			}
+		}
+
+		if(u->keep_working && u->volume)
+			unhvd_volume_update(u, volume_reset);
+	}
+
+	LOGI("unhvd: unprojection thread finished, dropped %d frames", u->unproject_dropped);
+}
+
+//unprojects cameras other than the first for unprojection thread
+static void unhvd_camera_thread(unhvd *u, int camera)
+{
+	int generation = 0;
+
+	while(true)
+	{
+		{
+			std::unique_lock<std::mutex> camera_lock(u->camera_mutex);
+			u->camera_cv.wait(camera_lock, [u, generation]{ return u->camera_generation != generation || u->camera_stop; });
+
+			//unprojection thread waits for started generation
+			if(u->camera_generation == generation)
+				break;
+
+			generation = u->camera_generation;
+		}
+
+		const int status = unhvd_unproject_camera(u, camera);
+
+		{
+			std::lock_guard<std::mutex> camera_guard(u->camera_mutex);
+			u->camera_status[camera] = status;
+			--u->camera_busy;
+		}
+
+		u->camera_done_cv.notify_one();
+	}
+}
+
+//unprojects cameras in parallel into their views of point cloud and fuses them
+static int unhvd_unproject_cameras(unhvd *u)
+{
+	int status;
+
+	unhvd_point_cloud_layout(u);
+
+	if(u->cameras > 1)
+	{
+		{
+			std::lock_guard<std::mutex> camera_guard(u->camera_mutex);
+			u->camera_busy = u->cameras - 1;
+			++u->camera_generation;
+		}
+		u->camera_cv.notify_all();
+	}
+
+	status = unhvd_unproject_camera(u, 0);
+
+	if(u->cameras > 1)
+	{
+		std::unique_lock<std::mutex> camera_lock(u->camera_mutex);
+		u->camera_done_cv.wait(camera_lock, [u]{ return u->camera_busy == 0; });
+
+		for(int c=1;c<u->cameras;++c)
+			if(u->camera_status[c] != UNHVD_OK)
+				status = UNHVD_ERROR;
+	}
+
+	if(status != UNHVD_OK)
+		return status;
+
+	unhvd_point_cloud_fuse(u);
+
+	return UNHVD_OK;
+}
+
+//unprojects camera frame into its view, stale camera keeps its points if it can
+static int unhvd_unproject_camera(unhvd *u, int camera)
+{
+	u->camera_stale[camera] = u->camera_stale[camera] && unhvd_camera_keep(u, camera);
+
+	if(u->camera_stale[camera])
+		return UNHVD_OK;
+
+	return unhvd_unproject_depth_frame(u, camera, u->camera_depth[camera], u->camera_texture[camera], &u->camera_cloud[camera]);
+}
+
+//copies last published points of camera into its view with no dirty ranges, false if they are not available
+//unprojecting the same frame again would advance temporal filter and background learning
+static bool unhvd_camera_keep(unhvd *u, int camera)
+{
+	hdu_point_cloud *view = &u->camera_cloud[camera];
+	const hdu_point_cloud *shared = &u->point_cloud_shared, *last = &u->camera_cloud_shared[camera];
+	//published positions were predicted, the decoded ones are in prediction base (organized float3)
+	const hdu_point_cloud *positions = u->predicted ? &u->predict_base : shared;
+	const int vertex_size = hdu_vertex_size(u->vertex_format);
+	const int first = u->camera_ranges_shared[2 * camera], count = u->camera_ranges_shared[2 * camera + 1];
+
+	if(last->size != view->size || positions->size != shared->size)
+		return false;
+
+	memcpy(view->data, reinterpret_cast<const uint8_t*>(positions->data) + first * vertex_size, count * vertex_size);
+	if(view->colors)
+		memcpy(view->colors, shared->colors + first, count * sizeof(color32));
+	//normals and indices only in organized clouds, the view starts at first
+	if(view->normals)
+		memcpy(view->normals, positions->normals + first, count * sizeof(float3));
+	if(view->indices && view->topology != last->topology)
+		memcpy(view->indices, shared->indices, last->indices_used * sizeof(uint32_t));
+
+	view->used = count;
+	view->indices_used = last->indices_used;
+	view->topology = last->topology;
+	view->decimated = last->decimated;
+	view->dirty_ranges = 0;
+	view->frame = last->frame; //delta of the next frame is against kept points
+
+	return true;
+}
+
+//fuses cameras of shared point cloud into volume and exports changed blocks to volume cloud
+static void unhvd_volume_update(unhvd *u, bool reset)
+{
+	const hdu_point_cloud *pc = &u->point_cloud_shared;
+	const int vertex_size = hdu_vertex_size(u->vertex_format);
+
+	if(reset)
+		hdu_volume_reset(u->volume);
+
+	//stale cameras were integrated with their frame already
+	for(int c=0;c<u->cameras;++c)
+	{
+		if(u->camera_stale[c])
+			continue;
+
+		const int first = u->camera_ranges_shared[2 * c];
+		hdu_point_cloud part = {0}; //points of camera in fused cloud
+
+		part.data = reinterpret_cast<float3*>(reinterpret_cast<uint8_t*>(pc->data) + first * vertex_size);
+		part.colors = pc->colors ? pc->colors + first : NULL;
+		part.size = pc->size - first; //SOA planes with single camera
+		part.used = u->camera_ranges_shared[2 * c + 1];
+
+		hdu_volume_integrate(u->volume, u->hardware_unprojector[c], &part);
+	}
+
+	std::lock_guard<std::mutex> volume_guard(u->volume_mutex);
+	const int *dirty = u->volume_cloud.dirty;
+
+	if(hdu_volume_export(u->volume, &u->volume_cloud, 0) != HDU_OK)
+		return;
+
+	//accumulate until user retrieves them
+	for(int i=0;i<u->volume_cloud.dirty_ranges;++i)
+		memset(u->volume_changed + dirty[2 * i] / HDU_VOLUME_BLOCK_VOXELS, 1, dirty[2 * i + 1] / HDU_VOLUME_BLOCK_VOXELS);
+}
+
+//velocities of unprojected frame points since the previous decoded frame, the frame becomes prediction base
+static void unhvd_velocity_update(unhvd *u, std::chrono::steady_clock::time_point time)
+{
+	const hdu_point_cloud *pc = &u->point_cloud;
+	hdu_point_cloud *base = &u->predict_base;
+	const float seconds = std::chrono::duration<float>(time - u->predict_time).count();
+
+	//after layout change there is no previous frame to compare with
+	if(base->size != pc->size)
+	{
+		unhvd_point_cloud_free(base);
+		base->data = reinterpret_cast<float3*>(new uint8_t[pc->size * sizeof(float3)]);
+		base->normals = pc->normals ? new float3[pc->size] : NULL;
+		base->velocities = new float3[pc->size];
+		base->size = pc->size;
+		base->used = 0;
+	}
+
+	const bool moved = hdu_velocity(base, &u->point_cloud, seconds, u->predict_max_speed * seconds) == HDU_OK;
+
+	if(!moved)
+		memset(pc->velocities, 0, pc->used * sizeof(float3));
+
+	u->predict_interval = moved ? seconds : 0.0f;
+	u->predict_time = time;
+
+	memcpy(base->data, pc->data, pc->used * sizeof(float3));
+	memcpy(base->velocities, pc->velocities, pc->used * sizeof(float3));
+	if(pc->normals)
+		memcpy(base->normals, pc->normals, pc->used * sizeof(float3));
+	base->used = pc->used;
+}
+
+//publishes the last decoded frame extrapolated by point velocities and moved to predicted sensor pose
+static void unhvd_predict_frame(unhvd *u, const float *pose, float seconds)
+{
+	hdu_point_cloud *pc = &u->point_cloud;
+	const hdu_point_cloud *shared = &u->point_cloud_shared, *base = &u->predict_base;
+	float inverse[16] = {0};
+
+	//nothing decoded yet or internal point cloud not yet reallocated for the last decoded layout
+	if(base->used == 0 || pc->size != base->size)
+		return;
+
+	const float since = std::chrono::duration<float>(std::chrono::steady_clock::now() - u->predict_time).count();
+	const float t = fminf(fmaxf(since + seconds, 0.0f), 2.0f * u->predict_interval);
+
+	//points in predicted sensor frame, rigid inverse of sensor motion
+	for(int r=0;pose && r<3;++r)
+	{
+		for(int k=0;k<3;++k)
+			inverse[4 * r + k] = pose[4 * k + r];
+		inverse[4 * r + 3] = -(pose[r] * pose[3] + pose[4 + r] * pose[7] + pose[8 + r] * pose[11]);
+	}
+
+	hdu_predict(base, pc, t, pose ? inverse : NULL);
+
+	//the rest is the same as in the last decoded frame
+	if(pc->colors)
+		memcpy(pc->colors, shared->colors, pc->used * sizeof(color32));
+	if(pc->indices && pc->topology != shared->topology)
+		memcpy(pc->indices, shared->indices, shared->indices_used * sizeof(uint32_t));
+
+	pc->indices_used = shared->indices_used;
+	pc->topology = shared->topology;
+	pc->decimated = shared->decimated;
+	pc->dirty[0] = 0;
+	pc->dirty[1] = pc->used;
+	pc->dirty_ranges = pc->used > 0;
+	pc->frame = ++u->fused_frames;
+	memcpy(u->camera_ranges, u->camera_ranges_shared, sizeof(u->camera_ranges));
+
+	//camera views no longer hold their frames, the next decoded frame recomputes all tiles
+	for(int c=0;c<u->cameras;++c)
+	{
+		u->camera_cloud[c].frame = 0;
+		u->camera_cloud[c].indices_used = pc->indices_used;
+		u->camera_cloud[c].topology = pc->topology;
+	}
+
+	std::lock_guard<std::mutex> frame_guard(u->mutex);
+	std::swap(u->point_cloud, u->point_cloud_shared);
+	std::swap(u->camera_cloud, u->camera_cloud_shared);
+	std::swap(u->camera_ranges, u->camera_ranges_shared);
+	u->predicted_shared = ++u->predicted;
+	u->point_cloud_new = true;
+}
+
+//camera pose is rig pose (may be NULL) times camera extrinsics
+static void unhvd_set_camera_poses(unhvd *u, const float *pose)
+{
+	for(int c=0;c<u->cameras;++c)
+	{
+		const float *e = u->extrinsics[c];
+		float camera_pose[16];
+
+		if(!pose || !u->extrinsic[c])
+		{
+			hdu_set_pose(u->hardware_unprojector[c], pose ? pose : (u->extrinsic[c] ? e : NULL));
+			continue;
+		}
+
+		for(int r=0;r<4;++r)
+			for(int k=0;k<4;++k)
+				camera_pose[4 * r + k] = pose[4 * r] * e[k] + pose[4 * r + 1] * e[4 + k] + pose[4 * r + 2] * e[8 + k] + pose[4 * r + 3] * e[12 + k];
+
+		hdu_set_pose(u->hardware_unprojector[c], camera_pose);
+	}
+}
+
+int unhvd_set_decimation(unhvd *u, int mode, int stride, float voxel_size)
+{
+	if(u == NULL || u->cameras == 0)
+		return UNHVD_ERROR;
+
+	if(mode < UNHVD_DECIMATION_NONE || mode > UNHVD_DECIMATION_VOXEL_GRID ||
+		(mode == UNHVD_DECIMATION_STRIDE && stride < 1) ||
+		((mode == UNHVD_DECIMATION_DEPTH_ADAPTIVE || mode == UNHVD_DECIMATION_VOXEL_GRID) && voxel_size <= 0.0f))
+		return UNHVD_ERROR_MSG("unhvd: invalid decimation arguments");
+
+	std::lock_guard<std::mutex> queue_guard(u->unproject_mutex);
+
+	u->decimation_mode = mode;
+	u->decimation_stride = stride;
+	u->decimation_voxel_size = voxel_size;
+	u->decimation_pending = true;
+
+	return UNHVD_OK;
+}
+
+int unhvd_set_temporal_filter(unhvd *u, float alpha, float threshold, int persistence)
+{
+	if(u == NULL || u->cameras == 0)
+		return UNHVD_ERROR;
+
+	if(alpha < 0.0f || alpha > 1.0f || threshold < 0.0f || persistence < 0 || persistence > 255)
+		return UNHVD_ERROR_MSG("unhvd: invalid temporal filter arguments");
+
+	std::lock_guard<std::mutex> queue_guard(u->unproject_mutex);
+
+	u->temporal_alpha = alpha;
+	u->temporal_threshold = threshold;
+	u->temporal_persistence = persistence;
+	u->temporal_pending = true;
+
+	return UNHVD_OK;
+}
+
+int unhvd_set_spatial_filter(unhvd *u, float threshold, float sigma)
+{
+	if(u == NULL || u->cameras == 0)
+		return UNHVD_ERROR;
+
+	if(threshold < 0.0f || sigma < 0.0f)
+		return UNHVD_ERROR_MSG("unhvd: invalid spatial filter arguments");
+
+	std::lock_guard<std::mutex> queue_guard(u->unproject_mutex);
+
+	u->spatial_threshold = threshold;
+	u->spatial_sigma = sigma;
+	u->spatial_pending = true;
+
+	return UNHVD_OK;
+}
+
+int unhvd_set_pose(unhvd *u, const float *pose)
+{
+	if(u == NULL || !u->cameras)
+		return UNHVD_ERROR_MSG("unhvd: depth unprojection is not enabled");
+
+	std::lock_guard<std::mutex> queue_guard(u->unproject_mutex);
+
+	if( (u->posed = pose != NULL) )
+		memcpy(u->pose, pose, sizeof(u->pose));
+	u->pose_pending = true;
+
+	return UNHVD_OK;
+}
+
+int unhvd_predict(unhvd *u, const float *pose, float seconds)
+{
+	if(u == NULL || !u->predict)
+		return UNHVD_ERROR;
+
+	std::lock_guard<std::mutex> queue_guard(u->unproject_mutex);
+
+	if( (u->predict_posed = pose != NULL) )
+		memcpy(u->predict_pose, pose, sizeof(u->predict_pose));
+	u->predict_seconds = seconds;
+	u->predict_pending = true;
+	u->unproject_cv.notify_one();
+
+	return UNHVD_OK;
+}
+
+//stride for the next frame from point count and time at current stride (both about 1 / stride^2)
+static void unhvd_budget_update(unhvd *u, float ms, int points)
+{
+	const int max_stride = 16;
+	int budget_points, stride = u->budget_stride;
+	float budget_ms;
+
+	{
+		std::lock_guard<std::mutex> queue_guard(u->unproject_mutex);
+		budget_points = u->budget_points;
+		budget_ms = u->budget_ms;
+	}
+
+	//organized cloud has fixed point count
+	if(u->organized)
+		budget_points = 0;
+
+	if(budget_points == 0 && budget_ms <= 0.0f)
+		stride = 1;
+	else
+	{
+		const float points_load = budget_points ? (float)points / budget_points : 0.0f;
+		const float ms_load = budget_ms > 0.0f ? ms / budget_ms : 0.0f;
+		const float load = points_load > ms_load ? points_load : ms_load;
+
+		u->budget_load = u->budget_frames ? 0.75f * u->budget_load + 0.25f * load : load;
+		++u->budget_frames;
+
+		//react to overload at once, relax only after a few frames with margin
+		if(load > 1.0f)
+			stride = (int)ceilf(stride * sqrtf(load));
+		else if(stride > 1 && u->budget_frames >= 8 &&
+			u->budget_load * (stride * stride) / ((stride - 1) * (stride - 1)) < 0.8f)
+			stride = stride - 1;
+
+		if(stride > max_stride)
+			stride = max_stride;
+	}
+
+	if(stride != u->budget_stride)
+	{
+		std::lock_guard<std::mutex> queue_guard(u->unproject_mutex);
+		u->budget_stride = stride;
+		u->budget_stride_changed = true;
+		u->budget_frames = 0;
+	}
+}
+
+//called from network decoder thread with audio aux channel data (int16 samples or Opus packet, optionally after sender timestamp)
+static void unhvd_audio_write(unhvd *u, const nhvd_frame *raw)
+{
+	int64_t timestamp;
+	aaos_stats stats;
+	const double alpha = 0.05; //smoothing of arrival jitter
+
+	if(raw->data == NULL || raw->size <= 0)
+		return;
+
+	if(!u->audio_timestamps)
+	{
+		if(u->audio_decoder)
+			unhvd_audio_decode(u, raw->data, raw->size, 0);
+		else
+			aaos_write(u->audio, (const int16_t*)raw->data, raw->size / 2);
+		return;
+	}
+
+	if(raw->size <= (int)sizeof(timestamp) || aaos_get_stats(u->audio, &stats) != 0)
+		return;
+
+	memcpy(&timestamp, raw->data, sizeof(timestamp));
+
+	if(u->audio_decoder)
+		unhvd_audio_decode(u, raw->data + sizeof(timestamp), raw->size - sizeof(timestamp), timestamp);
+	else
+		aaos_write_timestamped(u->audio, (const int16_t*)(raw->data + sizeof(timestamp)), (raw->size - sizeof(timestamp)) / 2, timestamp);
+
+	//samples written now play after what is already buffered
+	const double offset = double(unhvd_now_us() - timestamp) + 1000.0 * stats.latency_ms;
+
+	u->audio_offset_us = u->audio_offset_valid ? u->audio_offset_us + alpha * (offset - u->audio_offset_us) : offset;
+	u->audio_offset_valid = true;
+
+	double video_offset_us;
+	{
+		std::lock_guard<std::mutex> frame_guard(u->mutex);
+
+		if(!u->video_offset_valid)
+			return;
+
+		video_offset_us = u->video_offset_us;
+		u->av_offset_ms = float((u->audio_offset_us - video_offset_us) / 1000.0);
+	}
+
+	//buffer relative to current depth (not delay) so that the offset converges without windup
+	int delay_ms = stats.buffered_ms + int((video_offset_us - u->audio_offset_us) / 1000.0);
+
+	if(delay_ms < 0)
+		delay_ms = 0;
+
+	if(delay_ms > u->audio_delay_ms + 5 || delay_ms < u->audio_delay_ms - 5)
+	{
+		u->audio_delay_ms = delay_ms;
+		aaos_set_delay(u->audio, delay_ms);
+	}
+}
+
+//decodes Opus packet with sender timestamp (0 if none) into audio output
+//the packet lost just before this one is recovered from its in-band FEC,
+//earlier losses of longer gap are concealed by aaos_write_timestamped
+static void unhvd_audio_decode(unhvd *u, const uint8_t *packet, int size, int64_t timestamp)
+{
+	const int sample_rate = 24000; //aoc and aaos defaults
+	const int64_t max_gap_us = 250000; //longer gaps restart audio rather than being losses
+	int frames;
+
+	if(timestamp && u->audio_next_timestamp)
+	{
+		const int64_t gap_us = timestamp - u->audio_next_timestamp;
+
+		//at least half a packet of 10 ms or longer is missing
+		if(gap_us >= 5000 && gap_us <= max_gap_us &&
+			(frames = aoc_decode_fec(u->audio_decoder, packet, size, u->audio_pcm, u->audio_pcm_frames)) > 0)
+			aaos_write_timestamped(u->audio, u->audio_pcm, frames, timestamp - int64_t(frames) * 1000000 / sample_rate);
+	}
+
+	if( (frames = aoc_decode(u->audio_decoder, packet, size, u->audio_pcm, u->audio_pcm_frames)) <= 0)
+		return;
+
+	if(!timestamp)
+	{
+		aaos_write(u->audio, u->audio_pcm, frames);
+		return;
+	}
+
+	aaos_write_timestamped(u->audio, u->audio_pcm, frames, timestamp);
+	u->audio_next_timestamp = timestamp + int64_t(frames) * 1000000 / sample_rate;
+}
+
+//called with mutex locked when frame with sender timestamp is published
+static void unhvd_video_presented(unhvd *u, int64_t timestamp)
+{
+	const double alpha = 0.05;
+	const double offset = double(unhvd_now_us() - timestamp);
+
+	u->video_offset_us = u->video_offset_valid ? u->video_offset_us + alpha * (offset - u->video_offset_us) : offset;
+	u->video_offset_valid = true;
+}
+
+static int64_t unhvd_now_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int unhvd_set_budget(unhvd *u, int max_points, float max_milliseconds)
+{
+	if(u == NULL || u->cameras == 0)
+		return UNHVD_ERROR;
+
+	if(max_points < 0 || max_milliseconds < 0.0f)
+		return UNHVD_ERROR_MSG("unhvd: invalid point budget");
+
+	std::lock_guard<std::mutex> queue_guard(u->unproject_mutex);
+
+	u->budget_points = max_points;
+	u->budget_ms = max_milliseconds;
+
+	return UNHVD_OK;
+}
+
+int unhvd_get_unproject_stats(unhvd *u, float *milliseconds, int *points, int *stride)
 {
+	if(u == NULL || u->cameras == 0)
+		return UNHVD_ERROR;
+
+	std::lock_guard<std::mutex> frame_guard(u->mutex);
+
+	if(milliseconds)
+		*milliseconds = u->stats_ms;
+	if(points)
+		*points = u->stats_points;
+	if(stride)
+		*stride = u->stats_stride;
+
+	return UNHVD_OK;
+}
+
+int unhvd_get_audio_stats(unhvd *u, unhvd_audio_stats *stats)
+{
+	aaos_stats as;
+
+	if(u == NULL || u->audio == NULL || stats == NULL)
+		return UNHVD_ERROR;
+
+	if(aaos_get_stats(u->audio, &as) != 0)
+		return UNHVD_ERROR_MSG("unhvd: failed to get audio stats");
+
+	stats->underruns = as.underruns;
+	stats->overruns = as.overruns;
+	stats->concealed = as.concealed;
+	stats->buffered_ms = as.buffered_ms;
+	stats->target_ms = as.target_ms;
+	stats->latency_ms = as.latency_ms;
+
+	std::lock_guard<std::mutex> frame_guard(u->mutex);
+	stats->av_offset_ms = u->av_offset_ms;
+
+	return UNHVD_OK;
+}
+
+int unhvd_set_roi(unhvd *u, int x, int y, int width, int height)
+{
+	if(u == NULL || u->cameras == 0)
+		return UNHVD_ERROR;
+
+	if(width < 0 || height < 0)
+		return UNHVD_ERROR_MSG("unhvd: invalid region of interest");
+
+	std::lock_guard<std::mutex> queue_guard(u->unproject_mutex);
+
+	u->roi[0] = x;
+	u->roi[1] = y;
+	u->roi[2] = width;
+	u->roi[3] = height;
+	u->roi_pending = true;
+
+	return UNHVD_OK;
+}
+
+int unhvd_set_frustum(unhvd *u, const float *view_projection)
+{
+	if(u == NULL || u->cameras == 0)
+		return UNHVD_ERROR;
+
+	std::lock_guard<std::mutex> queue_guard(u->unproject_mutex);
+
+	if( (u->frustum = view_projection != NULL) )
+		memcpy(u->view_projection, view_projection, sizeof(u->view_projection));
+	u->frustum_pending = true;
+
+	return UNHVD_OK;
+}
+
+int unhvd_background_learn(unhvd *u, int frames, int mode)
+{
+	if(u == NULL || u->cameras == 0)
+		return UNHVD_ERROR;
+
+	if(frames < 0 || frames > HDU_BACKGROUND_MAX_FRAMES || mode < UNHVD_BACKGROUND_MEDIAN || mode > UNHVD_BACKGROUND_MIN)
+		return UNHVD_ERROR_MSG("unhvd: invalid background learning arguments");
+
+	std::lock_guard<std::mutex> queue_guard(u->unproject_mutex);
+
+	u->background_frames = frames;
+	u->background_mode = mode;
+	u->background_learn_pending = true;
+
+	return UNHVD_OK;
+}
+
+int unhvd_set_background(unhvd *u, float threshold)
+{
+	if(u == NULL || u->cameras == 0)
+		return UNHVD_ERROR;
+
+	if(threshold < 0.0f)
+		return UNHVD_ERROR_MSG("unhvd: invalid background threshold");
+
+	std::lock_guard<std::mutex> queue_guard(u->unproject_mutex);
+
+	u->background_threshold = threshold;
+	u->background_pending = true;
+
+	return UNHVD_OK;
+}
+
+int unhvd_background_save(unhvd *u, const char *file)
+{
+	if(u == NULL || u->cameras == 0 || file == NULL)
+		return UNHVD_ERROR;
+
+	std::lock_guard<std::mutex> unprojector_guard(u->unprojector_mutex);
+
+	for(int c=0;c<u->cameras;++c)
+	{
+		const std::string path = c ? std::string(file) + "." + std::to_string(c) : std::string(file);
+
+		if(hdu_background_save(u->hardware_unprojector[c], path.c_str()) != HDU_OK)
+			return UNHVD_ERROR_MSG("unhvd: failed to save background model");
+	}
+
+	return UNHVD_OK;
+}
+
+int unhvd_background_load(unhvd *u, const char *file)
+{
+	if(u == NULL || u->cameras == 0 || file == NULL)
+		return UNHVD_ERROR;
+
+	std::lock_guard<std::mutex> unprojector_guard(u->unprojector_mutex);
+
+	for(int c=0;c<u->cameras;++c)
+	{
+		const std::string path = c ? std::string(file) + "." + std::to_string(c) : std::string(file);
+
+		if(hdu_background_load(u->hardware_unprojector[c], path.c_str()) != HDU_OK)
+			return UNHVD_ERROR_MSG("unhvd: failed to load background model");
+	}
+
+	return UNHVD_OK;
+}
+
+int unhvd_raycast(unhvd *u, const float *origin, const float *direction, float max_distance, float radius,
+	float *point, float *distance)
+{
+	if(u == NULL || u->index_front == NULL || origin == NULL || direction == NULL)
+		return UNHVD_ERROR;
+
+	//infinite max_distance is limited by indexed points bounds
+	if(!(max_distance >= 0.0f) || !(radius >= 0.0f) || !isfinite(radius) ||
+		!isfinite(origin[0]) || !isfinite(origin[1]) || !isfinite(origin[2]) ||
+		!isfinite(direction[0]) || !isfinite(direction[1]) || !isfinite(direction[2]))
+		return UNHVD_ERROR_MSG("unhvd: invalid raycast arguments");
+
+	std::lock_guard<std::mutex> index_guard(u->index_mutex);
+
+	return hdu_index_raycast(u->index_front, origin, direction, max_distance, radius, point, distance) >= 0;
+}
+
+int unhvd_nearest(unhvd *u, const float *point, int k, float max_distance, float *points, float *distances)
+{
+	if(u == NULL || u->index_front == NULL || point == NULL)
+		return UNHVD_ERROR;
+
+	if(k < 1 || k > UNHVD_NEAREST_MAX_K || !(max_distance >= 0.0f) || !isfinite(max_distance) ||
+		!isfinite(point[0]) || !isfinite(point[1]) || !isfinite(point[2]))
+		return UNHVD_ERROR_MSG("unhvd: invalid nearest query arguments");
+
+	std::lock_guard<std::mutex> index_guard(u->index_mutex);
+
+	return hdu_index_nearest(u->index_front, point, k, max_distance, NULL, (float3*)points, distances);
+}
+
+int unhvd_get_unproject_queue_size(unhvd *u)
+{
+	if(u == NULL || u->cameras == 0)
+		return 0;
+
+	std::lock_guard<std::mutex> queue_guard(u->unproject_mutex);
+
+	return u->unproject_size;
+}
+
+//camera without frame yet is skipped, texture without data is ignored
+static int unhvd_unproject_depth_frame(unhvd *u, int camera, const AVFrame *depth_frame, const AVFrame *texture_frame, hdu_point_cloud *pc)
+{
+	if(!depth_frame->data[0])
+		return UNHVD_OK;
+
+	if(texture_frame && !texture_frame->data[0])
+		texture_frame = NULL;
+
 	//LOGI("Unprojecting depth frame: linesize: %d, width: %d, format: %d", depth_frame->linesize[0], depth_frame->width, depth_frame->format);
-	if (depth_frame->linesize[0] / depth_frame->width != 2 ||
-		(depth_frame->format != AV_PIX_FMT_P010LE && depth_frame->format != AV_PIX_FMT_P016LE && depth_frame->format != AV_PIX_FMT_YUV420P10LE))
+	const int depth_format = unhvd_depth_format(depth_frame->format);
+
+	if (depth_frame->linesize[0] / depth_frame->width != 2 || depth_format == UNHVD_ERROR)
 	{
 		// seems to be matching AV_PIX_FMT_YUV420P10LE(64)
 		LOGI("Depth Linesize: %d,%d,%d, Depth Frame Width: %d, Depth Frame Format: %d", depth_frame->linesize[0], depth_frame->linesize[1], depth_frame->linesize[2], depth_frame->width, depth_frame->format);
-		return UNHVD_ERROR_MSG("unhvd_unproject_depth_frame expects uint16 p010le/p016le data");
+		return UNHVD_ERROR_MSG("unhvd_unproject_depth_frame expects uint16 p010le/p016le/yuv420p10le/gray16le/gray12le data");
 	}
 
 	//LOGI("texture frame data? %p", texture_frame ? texture_frame->data[0] : NULL);
-	if (texture_frame && texture_frame->data[0] &&
-		texture_frame->format != AV_PIX_FMT_YUV420P)
+	const int color_format = unhvd_color_format(texture_frame);
+
+	if (color_format == UNHVD_ERROR)
 	{
 		// seems to be matching AV_PIX_FMT_YUV420P
 		LOGI("Texture Frame Format: %d Linesize: %d,%d,%d", texture_frame->format, texture_frame->linesize[0], texture_frame->linesize[1], texture_frame->linesize[2]);
-		return UNHVD_ERROR_MSG("unhvd_unproject_depth_frame expects YUV420P texture data");
+		return UNHVD_ERROR_MSG("unhvd_unproject_depth_frame expects NV12 or YUV420P texture data");
 	}
 
-	int size = depth_frame->width * depth_frame->height;
-	if(size != pc->size)
+	//kernels are selected once for the stream, not per frame
+	if(depth_format != u->depth_format[camera] || color_format != u->color_format[camera])
 	{
-		delete [] pc->data;
-		delete [] pc->colors;
-		pc->data = new float3[size];
-		pc->colors = new color32[size];  // YUV420P uses 12bpp but hdu calculates RGBA from YUV
-		pc->size = size;
-		pc->used = 0;
+		LOGI("unhvd: unprojecting camera %d depth format %d, color format %d", camera, depth_frame->format, texture_frame ? texture_frame->format : -1);
+
+		if(hdu_set_formats(u->hardware_unprojector[camera], depth_format, color_format) != HDU_OK)
+			return UNHVD_ERROR_MSG("unhvd_unproject_depth_frame failed to set formats");
+
+		u->depth_format[camera] = depth_format;
+		u->color_format[camera] = color_format;
 	}
 
 	uint16_t *depth_data = (uint16_t*)depth_frame->data[0];
@@ -238,20 +1581,176 @@ static int unhvd_unproject_depth_frame(unhvd *u, const AVFrame *depth_frame, con
 	uint8_t *texture_data = texture_frame ? (uint8_t*)texture_frame->data[0] : NULL;
 	int texture_linesize = texture_frame ? texture_frame->linesize[0] : 0;
 
+	//chroma planes are passed explicitly, they don't have to follow Y plane
 	hdu_depth depth = {depth_data, texture_data, depth_frame->width, depth_frame->height,
-		depth_frame->linesize[0], texture_linesize};
+		depth_frame->linesize[0], texture_linesize,
+		texture_frame ? texture_frame->width : 0, texture_frame ? texture_frame->height : 0,
+		texture_frame ? texture_frame->data[1] : NULL, texture_frame ? texture_frame->data[2] : NULL,
+		texture_frame ? texture_frame->linesize[1] : 0};
 
-	//this could be moved to separate thread
-	hdu_unproject(u->hardware_unprojector, &depth, pc);
+	if(hdu_unproject(u->hardware_unprojector[camera], &depth, pc) != HDU_OK)
+		return UNHVD_ERROR_MSG("unhvd_unproject_depth_frame failed to unproject depth");
 	//LOGI("Sample projected point: %f, %f, %f", pc->data[320 * 120 + 160][0], pc->data[320 * 120 + 160][1], pc->data[320 * 120 + 160][2]);
 
-	//zero out unused point cloud entries
-	memset(pc->data + pc->used, 0, (pc->size-pc->used)*sizeof(pc->data[0]));
-	memset(pc->colors + pc->used, 0, (pc->size-pc->used)*sizeof(pc->colors[0]));
-
 	return UNHVD_OK;
 }
 
+//reallocates point cloud when camera resolutions change, camera views follow each other
+static void unhvd_point_cloud_layout(unhvd *u)
+{
+	hdu_point_cloud *pc = &u->point_cloud, *views = u->camera_cloud;
+	const int vertex_size = hdu_vertex_size(u->vertex_format);
+	int size = 0, dirty = 0, mesh = 0;
+	bool changed = false;
+
+	//camera without frame yet has empty view
+	for(int c=0;c<u->cameras;++c)
+	{
+		const AVFrame *f = u->camera_depth[c];
+		const int pixels = f->data[0] ? f->width * f->height : 0;
+
+		changed = changed || pixels != views[c].size;
+		size += pixels;
+		dirty += f->data[0] ? hdu_dirty_capacity(f->width, f->height) : 0;
+		mesh += f->data[0] && u->mesh ? hdu_mesh_capacity(f->width, f->height) : 0;
+	}
+
+	if(!changed && pc->data)
+		return;
+
+	unhvd_point_cloud_free(pc);
+	//vertex format specific layout, interleaved format keeps colors with positions
+	pc->data = reinterpret_cast<float3*>(new uint8_t[size * vertex_size]);
+	pc->colors = u->point_colors ? new color32[size] : NULL;  // YUV420P uses 12bpp but hdu calculates RGBA from YUV
+	pc->dirty = new int[2 * dirty];
+	pc->normals = u->normals ? new float3[size] : NULL;
+	pc->indices = u->mesh ? new uint32_t[mesh] : NULL;
+	pc->velocities = u->predict ? new float3[size] : NULL;
+	pc->size = size;
+	pc->used = 0;
+	pc->indices_used = 0;
+	pc->topology = 0;
+
+	for(int c=0, offset=0, dirty_offset=0;c<u->cameras;++c)
+	{
+		const AVFrame *f = u->camera_depth[c];
+		const int pixels = f->data[0] ? f->width * f->height : 0;
+		hdu_point_cloud view = {0}; //frame 0, nothing to keep from before reallocation
+
+		view.data = reinterpret_cast<float3*>(reinterpret_cast<uint8_t*>(pc->data) + offset * vertex_size);
+		view.colors = pc->colors ? pc->colors + offset : NULL;
+		view.normals = pc->normals ? pc->normals + offset : NULL;
+		view.dirty = pc->dirty + 2 * dirty_offset;
+		view.indices = pc->indices; //mesh only with single camera
+		view.size = pixels;
+		views[c] = view;
+
+		offset += pixels;
+		dirty_offset += f->data[0] ? hdu_dirty_capacity(f->width, f->height) : 0;
+	}
+}
+
+//packed cameras are moved after each other, dirty ranges of cameras are merged
+static void unhvd_point_cloud_fuse(unhvd *u)
+{
+	hdu_point_cloud *pc = &u->point_cloud;
+	const int vertex_size = hdu_vertex_size(u->vertex_format);
+	int *dirty = pc->dirty, ranges = 0, used = 0, offset = 0;
+
+	pc->decimated = 0;
+
+	for(int c=0;c<u->cameras;++c)
+	{
+		const hdu_point_cloud *view = &u->camera_cloud[c];
+		//organized camera stays at its pixels, packed follows points of previous cameras
+		const int first = u->organized ? offset : used;
+		const int count = view->used;
+		//stale camera has no dirty points unless packed points before it changed count
+		const int all[2] = {0, count};
+		const bool moved = u->camera_stale[c] && first != u->camera_ranges_shared[2 * c];
+		const int *view_dirty = moved ? all : view->dirty;
+		const int view_ranges = moved ? 1 : view->dirty_ranges;
+
+		if(first != offset && count)
+		{
+			uint8_t *data = reinterpret_cast<uint8_t*>(pc->data);
+			memmove(data + first * vertex_size, data + offset * vertex_size, count * vertex_size);
+			if(pc->colors)
+				memmove(pc->colors + first, pc->colors + offset, count * sizeof(color32));
+		}
+
+		u->camera_ranges[2 * c] = first;
+		u->camera_ranges[2 * c + 1] = count;
+		pc->decimated += view->decimated;
+
+		//merged list is never ahead of camera lists it is built from
+		for(int i=0;count && i<view_ranges;++i)
+		{
+			const int start = view_dirty[2 * i] + first, length = view_dirty[2 * i + 1];
+
+			if(ranges > 0 && dirty[2 * ranges - 2] + dirty[2 * ranges - 1] == start)
+				dirty[2 * ranges - 1] += length;
+			else
+			{
+				dirty[2 * ranges] = start;
+				dirty[2 * ranges + 1] = length;
+				++ranges;
+			}
+		}
+
+		used = first + count;
+		offset += view->size;
+	}
+
+	pc->used = used;
+	pc->dirty_ranges = ranges;
+	pc->frame = ++u->fused_frames;
+	pc->indices_used = u->camera_cloud[0].indices_used;
+	pc->topology = u->camera_cloud[0].topology;
+}
+
+static int unhvd_depth_format(int pix_fmt)
+{
+	switch(pix_fmt)
+	{
+		case AV_PIX_FMT_P010LE: return HDU_DEPTH_P010;
+		case AV_PIX_FMT_P016LE: return HDU_DEPTH_P016;
+		case AV_PIX_FMT_YUV420P10LE: return HDU_DEPTH_YUV420P10;
+		case AV_PIX_FMT_GRAY16LE: return HDU_DEPTH_GRAY16;
+		case AV_PIX_FMT_GRAY12LE: return HDU_DEPTH_GRAY12;
+	}
+	return UNHVD_ERROR;
+}
+
+static int unhvd_color_format(const AVFrame *texture_frame)
+{
+	if(!texture_frame || !texture_frame->data[0])
+		return HDU_COLOR_FORMAT_NONE;
+
+	switch(texture_frame->format)
+	{
+		case AV_PIX_FMT_NV12: return HDU_COLOR_FORMAT_NV12;
+		case AV_PIX_FMT_YUV420P: return HDU_COLOR_FORMAT_YUV420P;
+	}
+	return UNHVD_ERROR;
+}
+
+static void unhvd_point_cloud_free(hdu_point_cloud *pc)
+{
+	delete [] reinterpret_cast<uint8_t*>(pc->data);
+	delete [] pc->colors;
+	delete [] pc->dirty;
+	delete [] pc->normals;
+	delete [] pc->indices;
+	delete [] pc->velocities;
+	pc->data = NULL;
+	pc->colors = NULL;
+	pc->dirty = NULL;
+	pc->normals = NULL;
+	pc->indices = NULL;
+	pc->velocities = NULL;
+}
+
 //NULL if there is no fresh data, non NULL otherwise
 int unhvd_get_begin(unhvd *u, unhvd_frame *frame, unhvd_point_cloud *pc)
 {
@@ -270,6 +1769,10 @@ int unhvd_get_begin(unhvd *u, unhvd_frame *frame, unhvd_point_cloud *pc)
 			break;
 		}
 
+	// check for point cloud unprojected after the last retrieval
+	if (!new_data && pc && u->point_cloud_new)
+		new_data = true;
+
 	// check for new data in any auxilliary channel
 	if (!new_data)
 		for (int i = 0; i < u->auxes; ++i)
@@ -310,13 +1813,26 @@ int unhvd_get_begin(unhvd *u, unhvd_frame *frame, unhvd_point_cloud *pc)
 		}
 	}
 
-	if(pc && u->hardware_unprojector)
+	if(pc && u->cameras)
 	{
 		//copy just two pointers and ints
 		pc->data = u->point_cloud_shared.data;
 		pc->colors = u->point_cloud_shared.colors;
 		pc->size = u->point_cloud_shared.size;
 		pc->used = u->point_cloud_shared.used;
+		pc->decimated = u->point_cloud_shared.decimated;
+		pc->frame = u->point_cloud_shared.frame;
+		pc->dirty = u->point_cloud_shared.dirty;
+		pc->dirty_ranges = u->point_cloud_shared.dirty_ranges;
+		pc->normals = u->point_cloud_shared.normals;
+		pc->indices = u->point_cloud_shared.indices;
+		pc->indices_used = u->point_cloud_shared.indices_used;
+		pc->topology = u->point_cloud_shared.topology;
+		pc->cameras = u->cameras;
+		memcpy(pc->camera_ranges, u->camera_ranges_shared, sizeof(pc->camera_ranges));
+		pc->velocities = u->point_cloud_shared.velocities;
+		pc->predicted = u->predicted_shared;
+		u->point_cloud_new = false;
 	}
 
 	return UNHVD_OK;
@@ -361,6 +1877,78 @@ int unhvd_get_point_cloud_end(unhvd *u)
 	return unhvd_get_end(u);
 }
 
+int unhvd_get_volume_begin(unhvd *u, unhvd_point_cloud *pc)
+{
+	if(u == NULL || u->volume == NULL)
+		return UNHVD_ERROR;
+
+	//lock also on error, caller calls unhvd_get_volume_end anyway
+	u->volume_mutex.lock();
+
+	if(pc == NULL)
+		return UNHVD_ERROR;
+
+	int *d = u->volume_cloud.dirty, n = 0;
+
+	//merged ranges of blocks changed since the last retrieval
+	for(int b=0;b<u->volume_blocks;++b)
+	{
+		if(!u->volume_changed[b])
+			continue;
+
+		const int first = b * HDU_VOLUME_BLOCK_VOXELS;
+
+		if(n > 0 && d[2 * n - 2] + d[2 * n - 1] == first)
+			d[2 * n - 1] += HDU_VOLUME_BLOCK_VOXELS;
+		else
+		{
+			d[2 * n] = first;
+			d[2 * n + 1] = HDU_VOLUME_BLOCK_VOXELS;
+			++n;
+		}
+
+		u->volume_changed[b] = 0;
+	}
+
+	//for user convinience, return ERROR if there are no changes
+	if(n == 0)
+		return UNHVD_ERROR;
+
+	//copy just a few pointers and ints
+	*pc = unhvd_point_cloud();
+	pc->data = u->volume_cloud.data;
+	pc->colors = u->volume_cloud.colors;
+	pc->size = u->volume_cloud.size;
+	pc->used = u->volume_cloud.used;
+	pc->frame = ++u->volume_frames;
+	pc->dirty = d;
+	pc->dirty_ranges = n;
+
+	return UNHVD_OK;
+}
+
+int unhvd_get_volume_end(unhvd *u)
+{
+	if(u == NULL || u->volume == NULL)
+		return UNHVD_ERROR;
+
+	u->volume_mutex.unlock();
+
+	return UNHVD_OK;
+}
+
+int unhvd_volume_reset(unhvd *u)
+{
+	if(u == NULL || u->volume == NULL)
+		return UNHVD_ERROR;
+
+	std::lock_guard<std::mutex> queue_guard(u->unproject_mutex);
+
+	u->volume_reset_pending = true;
+
+	return UNHVD_OK;
+}
+
 static unhvd *unhvd_close_and_return_null(unhvd *u, const char *msg)
 {
 	if (msg)
@@ -378,21 +1966,51 @@ void unhvd_close(unhvd *u)
 	if(u == NULL)
 		return;
 
-	u->keep_working=false;
+	unhvd_unproject_stop(u);
 	if(u->network_thread.joinable())
 		u->network_thread.join();
+	if(u->unproject_thread.joinable())
+		u->unproject_thread.join();
+
+	{	//camera threads serve unprojection thread until it finishes
+		std::lock_guard<std::mutex> camera_guard(u->camera_mutex);
+		u->camera_stop = true;
+	}
+	u->camera_cv.notify_all();
+
+	for(int c=0;c<UNHVD_MAX_CAMERAS;++c)
+		if(u->camera_thread[c].joinable())
+			u->camera_thread[c].join();
 
 	nhvd_close(u->network_decoder);
 
 	for(int i=0;i<u->decoders;++i)
 		av_frame_free(&u->frame[i]);
 
-	hdu_close(u->hardware_unprojector);
-	delete [] u->point_cloud.data;
-	delete [] u->point_cloud.colors;
-	delete [] u->point_cloud_shared.data;
-	delete [] u->point_cloud_shared.colors;
+	for(int c=0;c<UNHVD_MAX_CAMERAS;++c)
+	{
+		for(int i=0;i<UNHVD_UNPROJECT_QUEUE_SIZE;++i)
+		{
+			av_frame_free(&u->unproject_depth[i][c]);
+			av_frame_free(&u->unproject_texture[i][c]);
+		}
+
+		av_frame_free(&u->camera_depth[c]);
+		av_frame_free(&u->camera_texture[c]);
+		hdu_close(u->hardware_unprojector[c]);
+	}
 
+	hdu_index_close(u->index_front);
+	hdu_index_close(u->index_back);
+	hdu_volume_close(u->volume);
+	unhvd_point_cloud_free(&u->volume_cloud);
+	unhvd_point_cloud_free(&u->predict_base);
+	delete [] u->volume_changed;
+	unhvd_point_cloud_free(&u->point_cloud);
+	unhvd_point_cloud_free(&u->point_cloud_shared);
+
+	aoc_close(u->audio_decoder);
+	delete [] u->audio_pcm;
 	aaos_close(u->audio);
 
 	delete u;
@@ -70,6 +70,10 @@ struct unhvd_net_config
 	const char *ip; //!< IP (to listen on) or NULL (listen on any)
 	uint16_t port; //!< server port
 	int timeout_ms; //!< 0 ar positive number
+	int audio_aux; //!< 1 based aux channel with int16 mono audio, 0 for the only aux channel (if single), -1 for none
+	int audio_timestamps; //!< 1 if audio chunks start with int64 sender timestamp in microseconds, see ::unhvd_get_audio_stats
+	int audio_codec; //!< audio aux channel content, see ::unhvd_audio_codec
+	int timestamp_aux; //!< 0 or 1 based aux channel with int64 sender timestamp of video frames in microseconds
 };
 
 /**
@@ -99,7 +103,14 @@ struct unhvd_hw_config
  * For more details see:
  * <a href="https://github.com/bmegli/hardware-depth-unprojector">HDU</a>
  *
- * @see unhvd_init
+ * With non-zero color_fx and color_fy the texture is registered to depth by projecting
+ * points to color camera, the texture may then be streamed at its native resolution.
+ *
+ * With multiple cameras (::unhvd_init_cameras) output layout fields (vertex_format, position_scale,
+ * position_offset, color_output, pose_aux, organized, mesh, normals, index_cell_size, volume_*, predict_*)
+ * are taken from the first camera config.
+ *
+ * @see unhvd_init, unhvd_init_cameras
  */
 struct unhvd_depth_config
 {
@@ -107,16 +118,52 @@ struct unhvd_depth_config
 	float ppy; //!< principal point y pixel coordinates (center of projection)
 	float fx; //!< focal length in pixel width unit
 	float fy; //!< focal length in pixel height unit
-	float depth_unit; //!< multiplier for raw depth data;
+	float depth_unit; //!< multiplier for raw depth data (LSB aligned formats like yuv420p10le are not shifted);
 	float min_margin; //!< minimal margin to treat as valid in result unit (raw data * depth_unit);
 	float max_margin; //!< maximal margin to treat as valid in result unit (raw data * depth_unit);
+	int threads; //!< unprojection threads, 0 for automatic (big cores), 1 for single threaded
+	int distortion_model; //!< 0 none, 1 Brown-Conrady (k1, k2, p1, p2, k3), 2 Kannala-Brandt (k1, k2, k3, k4)
+	float distortion_coeffs[5]; //!< lens distortion coefficients, unused are ignored
+	int vertex_format; //!< unhvd_vertex_format of point cloud data, UNHVD_VERTEX_FLOAT3 (0) by default
+	float position_scale; //!< UNHVD_VERTEX_SHORT4 quantization step in result unit
+	float position_offset[3]; //!< UNHVD_VERTEX_SHORT4 position of zero value in result unit
+	int color_output; //!< unhvd_color_output, UNHVD_COLOR_RGBA (0) by default
+	float color_ppx; //!< color camera principal point x (registration)
+	float color_ppy; //!< color camera principal point y (registration)
+	float color_fx; //!< color camera focal length, 0 if texture is aligned with depth
+	float color_fy; //!< color camera focal length, 0 if texture is aligned with depth
+	float color_rotation[9]; //!< depth to color camera rotation, row major
+	float color_translation[3]; //!< depth to color camera translation in result unit
+	int pose_aux; //!< 0 or 1 based aux channel with per frame 4x4 row major float sensor to world pose
+	float temporal_alpha; //!< temporal filter weight of new depth in (0, 1], 0 disables, see ::unhvd_set_temporal_filter
+	float temporal_threshold; //!< temporal filter depth difference treated as motion in result unit
+	int temporal_persistence; //!< temporal filter frames to fill holes with last depth (0 - 255)
+	float spatial_threshold; //!< flying pixel relative depth jump, 0 disables, see ::unhvd_set_spatial_filter
+	float spatial_sigma; //!< edge aware smoothing depth range in result unit, 0 disables
+	int organized; //!< 1 for point per depth pixel (invalid at position 0), 0 (default) packs valid points
+	float delta_threshold; //!< organized only, depth change in result unit to recompute 64 pixel tile, 0 recomputes all
+	float background_threshold; //!< margin in front of background model in result unit, 0 disables, see ::unhvd_background_learn
+	int mesh; //!< organized only, 1 for triangle indices of depth grid in point cloud
+	int normals; //!< organized only, 1 for per point normals in point cloud
+	float mesh_threshold; //!< relative depth jump (e.g. 0.05) breaking mesh triangle, 0 for none
+	float index_cell_size; //!< spatial index grid cell in result unit (e.g. 0.05), 0 disables, see ::unhvd_raycast
+	float extrinsics[16]; //!< camera to rig 4x4 row major transform, all zero for identity, see ::unhvd_init_cameras
+	float volume_voxel_size; //!< voxel volume voxel edge in result unit (e.g. 0.02), 0 disables, see ::unhvd_get_volume_begin
+	float volume_truncation; //!< voxel volume signed distance truncation in result unit (e.g. 0.06), 0 for occupancy only
+	int volume_max_blocks; //!< voxel volume memory limit in blocks of 512 voxels (about 14 KB each)
+	int volume_min_weight; //!< voxel volume observations needed to show voxel, 0 is treated as 1
+	int predict; //!< organized UNHVD_VERTEX_FLOAT3 only, 1 for point velocities and predicted frames, see ::unhvd_predict
+	float predict_max_speed; //!< point velocity limit in result unit per second (e.g. 5), faster is different surface, 0 for none
 };
 
 enum UNHVD_COMPILE_TIME_CONSTANTS
 {
-	UNHVD_MAX_DECODERS = 3, //!< max number of decoders in multi-frame decoding
+	UNHVD_MAX_DECODERS = 6, //!< max number of decoders in multi-frame decoding
+	UNHVD_MAX_CAMERAS = 3, //!< max number of depth cameras fused into point cloud
 	UNHVD_NUM_DATA_POINTERS = 3, //!< max number of planes for planar image formats
-	UNHVD_MAX_AUX_CHANNELS = 1 //!< max number of auxilliary raw channels
+	UNHVD_MAX_AUX_CHANNELS = 2, //!< max number of auxilliary raw channels, decoders + aux channels is MLSP max subframes
+	UNHVD_UNPROJECT_QUEUE_SIZE = 2, //!< max number of depth/texture frame pairs waiting for unprojection
+	UNHVD_NEAREST_MAX_K = 64 //!< max number of neighbours in ::unhvd_nearest
 };
 
 /**
@@ -153,7 +200,26 @@ typedef uint32_t color32;
  * @struct unhvd_point_cloud
  * @brief Point cloud abstraction.
  *
- * Array of float3 points and color32 colors. Only used points are non zero.
+ * Array of points (in unhvd_vertex_format layout) and color32 colors.
+ * Only valid depth points are unprojected and packed at the beginning of arrays.
+ * Only the first used elements are meaningful, the rest of the arrays is left as is.
+ *
+ * Organized point cloud has point per depth pixel (index is row * width + column).
+ * Dirty ranges list points changed since the previous frame, for partial vertex buffer uploads.
+ * If frame doesn't follow the last frame consumer has seen (frames were dropped) whole cloud has to be uploaded.
+ * With delta_threshold only changed tiles are recomputed and dirty.
+ *
+ * With multiple cameras all are fused into single rig aligned cloud, camera ranges give points of each camera.
+ * Organized cloud holds cameras one after another (first camera pixels, then second, ...),
+ * packed cloud holds valid points of cameras one after another.
+ *
+ * Organized point cloud may also be a mesh, clockwise triangles of the depth grid (every stride-th pixel
+ * with stride decimation) without triangles across depth discontinuities or with not stored vertices.
+ * Indices are rewritten only when topology changes, index buffer has to be uploaded when topology differs.
+ *
+ * With prediction organized point cloud has per point velocities between the last two decoded frames
+ * and predicted frames (see ::unhvd_predict) may follow decoded frames, all points of predicted frame
+ * and of the first decoded frame after it are dirty.
  *
  * @see unhvd_get_point_cloud_begin, unhvd_get_point_cloud_end, unhvd_get_begin, unhvd_get_end
  */
@@ -163,6 +229,90 @@ struct unhvd_point_cloud
 	color32 *colors; //!< array of point colors
 	int size; //!< size of array
 	int used; //!< number of elements used in array
+	int decimated; //!< number of valid points removed by decimation
+	int frame; //!< number of unprojected frame
+	int *dirty; //!< (first point, count) pairs of points changed since frame - 1
+	int dirty_ranges; //!< number of pairs in dirty
+	float3 *normals; //!< NULL or per point normals facing sensor
+	uint32_t *indices; //!< NULL or triangle indices of points
+	int indices_used; //!< number of indices used
+	int topology; //!< version of indices, changes with mesh topology
+	int cameras; //!< number of cameras in point cloud
+	int camera_ranges[2 * UNHVD_MAX_CAMERAS]; //!< (first point, count) pair of each camera, count is 0 before its first frame
+	float3 *velocities; //!< NULL or per point velocities in result unit per second
+	int predicted; //!< 0 for decoded frame, n for n-th predicted frame after it
+};
+
+/**
+  * @brief Point cloud vertex formats
+  *
+  * Point cloud data points to vertex format specific array.
+  * With UNHVD_VERTEX_FLOAT3_COLOR32 colors are interleaved with positions and point cloud colors are NULL.
+  * With UNHVD_VERTEX_SOA data holds size x coordinates, then size y and size z coordinates.
+  *
+  * @see unhvd_depth_config
+  */
+enum unhvd_vertex_format
+{
+	UNHVD_VERTEX_FLOAT3 = 0, //!< float x, y, z
+	UNHVD_VERTEX_HALF4 = 1, //!< half float x, y, z, 1
+	UNHVD_VERTEX_SHORT4 = 2, //!< int16 x, y, z, 0, position = value * position_scale + position_offset
+	UNHVD_VERTEX_FLOAT3_COLOR32 = 3, //!< float x, y, z and color32 interleaved
+	UNHVD_VERTEX_SOA = 4, //!< float x, y, z in separate planes
+};
+
+/**
+  * @brief Per point color output
+  *
+  * With UNHVD_COLOR_UV point colors hold texture frame coordinates (unorm16 u in low, v in high 16 bits),
+  * texture is sampled in shader and no CPU color conversion is done.
+  * With UNHVD_COLOR_NONE point cloud colors are NULL.
+  *
+  * @see unhvd_depth_config
+  */
+enum unhvd_color_output
+{
+	UNHVD_COLOR_RGBA = 0, //!< color32 RGBA converted on CPU
+	UNHVD_COLOR_UV = 1, //!< unorm16 texture coordinates
+	UNHVD_COLOR_NONE = 2, //!< no per point color
+};
+
+/**
+  * @brief Point cloud decimation modes
+  *
+  * @see unhvd_set_decimation
+  */
+enum unhvd_decimation_mode
+{
+	UNHVD_DECIMATION_NONE = 0, //!< all valid points
+	UNHVD_DECIMATION_STRIDE = 1, //!< every stride-th pixel in every stride-th row
+	UNHVD_DECIMATION_DEPTH_ADAPTIVE = 2, //!< pixels roughly voxel_size apart, power of two stride from depth
+	UNHVD_DECIMATION_VOXEL_GRID = 3, //!< single point per voxel of voxel_size
+};
+
+/**
+  * @brief Background model per pixel statistics
+  *
+  * @see unhvd_background_learn
+  */
+enum unhvd_background_mode
+{
+	UNHVD_BACKGROUND_MEDIAN = 0, //!< median depth of learned frames
+	UNHVD_BACKGROUND_MIN = 1, //!< nearest depth of learned frames
+};
+
+/**
+  * @brief Audio aux channel content
+  *
+  * Audio is 24 kHz mono, the content follows optional timestamp of each chunk.
+  * Opus packets may be produced by aoc_init_encoder/aoc_encode (aoc.h) on the sender side.
+  *
+  * @see unhvd_net_config
+  */
+enum unhvd_audio_codec
+{
+	UNHVD_AUDIO_PCM = 0, //!< int16 samples
+	UNHVD_AUDIO_OPUS = 1, //!< single Opus packet, lost packets are recovered from in-band FEC with audio_timestamps (needs UNHVD_OPUS build)
 };
 
 /**
@@ -198,6 +348,37 @@ UNHVD_EXPORT struct unhvd * UNHVD_API unhvd_init(
 	const unhvd_hw_config *hw_config, int hw_size, int aux_size,
 	const unhvd_depth_config *depth_config);
 
+/**
+ * @brief Initialize internal library data for multiple depth cameras.
+ *
+ * Camera i is streamed with depth in decoder 2 * i and optional texture in decoder 2 * i + 1
+ * (the texture of the last camera may be omitted).
+ * Each camera has its own intrinsics and extrinsics (camera to rig transform).
+ * Cameras are unprojected in parallel into single point cloud in rig frame
+ * (or world frame with ::unhvd_set_pose or pose aux channel) so that it is uploaded once,
+ * see unhvd_point_cloud::camera_ranges. Camera without new frame keeps its last points (not dirty, not filtered or fused into volume again).
+ *
+ * Settings (e.g. ::unhvd_set_decimation) apply to all cameras.
+ * Each camera unprojects with its own unhvd_depth_config::threads, set them so that cameras together don't exceed the cores.
+ * Mesh output and UNHVD_VERTEX_SOA are supported only with single camera.
+ *
+ * @param net_config network configuration
+ * @param hw_config hardware decoders configuration of hw_size size
+ * @param hw_size number of supplied hardware decoder configurations
+ * @param aux_size number of (raw, unencoded) auxilliary channels
+ * @param depth_configs unprojection configuration of each camera
+ * @param cameras number of cameras (up to UNHVD_MAX_CAMERAS), 0 for video streaming
+ * @return
+ * - pointer to internal library data
+ * - NULL on error, errors printed to stderr
+ *
+ * @see unhvd_init
+ */
+UNHVD_EXPORT struct unhvd * UNHVD_API unhvd_init_cameras(
+	const unhvd_net_config *net_config,
+	const unhvd_hw_config *hw_config, int hw_size, int aux_size,
+	const unhvd_depth_config *depth_configs, int cameras);
+
 /**
  * @brief Free library resources
  *
@@ -242,7 +423,8 @@ UNHVD_EXPORT void UNHVD_API unhvd_close(unhvd *u);
 /** @brief Retrieve depth frame and point cloud.
  *
  * Point cloud data may be only retrieved if non NULL ::unhvd_depth_config was passed to ::unhvd_init.
- * This function may retrieve both depth frame and unprojected point cloud at the same time
+ * This function may retrieve both depth frame and unprojected point cloud at the same time.
+ * Unprojection runs asynchronously so point cloud may lag behind the depth frame.
  */
 UNHVD_EXPORT int UNHVD_API unhvd_get_begin(unhvd *u, unhvd_frame *frame, unhvd_point_cloud *pc);
 /** @brief Finish retrieval. */
@@ -255,8 +437,342 @@ UNHVD_EXPORT int UNHVD_API unhvd_get_frame_end(unhvd *u);
 UNHVD_EXPORT int UNHVD_API unhvd_get_point_cloud_begin(unhvd *u, unhvd_point_cloud *pc);
 /** @brief Finish retrieval. */
 UNHVD_EXPORT int UNHVD_API unhvd_get_point_cloud_end(unhvd *u);
+
+/**
+ * @brief Retrieve blocks of voxel volume changed since the last retrieval.
+ *
+ * Requires unhvd_depth_config::volume_voxel_size (of the first camera). Unprojected point clouds
+ * are fused over time (posed with ::unhvd_set_pose or pose aux channel) into voxel volume
+ * of bounded memory, the least recently observed blocks are evicted when it is full.
+ *
+ * Volume is organized point cloud of float3 positions and color32 colors (UNHVD_COLOR_RGBA),
+ * 512 voxel slots per block, position 0 for voxels without surface.
+ * Dirty ranges list all blocks changed since the last retrieval (everything at the first),
+ * consumer keeping its copy of the cloud only has to upload them.
+ * Call ::unhvd_get_volume_end after begin (also on UNHVD_ERROR).
+ *
+ * @param u pointer to internal library data
+ * @param pc pointer to point cloud description data
+ * @return
+ * - UNHVD_OK sucessfully returned changed blocks
+ * - UNHVD_ERROR no changes or volume is not enabled
+ */
+UNHVD_EXPORT int UNHVD_API unhvd_get_volume_begin(unhvd *u, unhvd_point_cloud *pc);
+
+/** @brief Finish retrieval, see ::unhvd_get_volume_begin */
+UNHVD_EXPORT int UNHVD_API unhvd_get_volume_end(unhvd *u);
+
+/**
+ * @brief Empty voxel volume.
+ *
+ * The change takes effect with the next unprojected frame, cleared blocks are reported as changed.
+ *
+ * @param u pointer to internal library data
+ * @return
+ * - UNHVD_OK on success
+ * - UNHVD_ERROR if volume is not enabled
+ */
+UNHVD_EXPORT int UNHVD_API unhvd_volume_reset(unhvd *u);
 ///@}
 
+/**
+ * @brief Get the number of frames waiting for unprojection.
+ *
+ * Depth unprojection runs on its own thread, overlapping decoding of the next frame.
+ * Decoded depth/texture frame pairs are queued for it (up to ::UNHVD_UNPROJECT_QUEUE_SIZE).
+ * If unprojection falls behind the oldest pair is dropped.
+ *
+ * Persistent non zero value means unprojection is slower than the stream.
+ *
+ * @param u pointer to internal library data
+ * @return number of queued frame pairs (0 if depth unprojection is not enabled)
+ */
+UNHVD_EXPORT int UNHVD_API unhvd_get_unproject_queue_size(unhvd *u);
+
+/**
+ * @brief Set point budget of unprojection.
+ *
+ * Controller measures unprojection time and point count of each frame
+ * and adjusts sampling stride so that both stay within the budget.
+ * Stride is increased as soon as the budget is exceeded and decreased
+ * when lower stride is predicted to fit with margin.
+ * While controller limits the cloud (stride above 1) it overrides ::unhvd_set_decimation.
+ * With organized point cloud point count is fixed and only time budget applies.
+ *
+ * @param u pointer to internal library data
+ * @param max_points point budget, 0 for none
+ * @param max_milliseconds unprojection time budget, 0 for none
+ * @return
+ * - UNHVD_OK on success
+ * - UNHVD_ERROR on invalid arguments or if depth unprojection is not enabled
+ */
+UNHVD_EXPORT int UNHVD_API unhvd_set_budget(unhvd *u, int max_points, float max_milliseconds);
+
+/**
+ * @brief Get statistics of the last unprojected frame.
+ *
+ * @param u pointer to internal library data
+ * @param milliseconds unprojection time
+ * @param points point count
+ * @param stride current sampling stride of budget controller (1 if not limiting)
+ * @return
+ * - UNHVD_OK on success
+ * - UNHVD_ERROR if depth unprojection is not enabled
+ */
+UNHVD_EXPORT int UNHVD_API unhvd_get_unproject_stats(unhvd *u, float *milliseconds, int *points, int *stride);
+
+/**
+ * @struct unhvd_audio_stats
+ * @brief Audio playback statistics.
+ *
+ * Counters are since ::unhvd_init.
+ *
+ * @see unhvd_get_audio_stats
+ */
+struct unhvd_audio_stats
+{
+	int underruns; //!< audio device ran out of buffered samples
+	int overruns; //!< audio chunks that didn't fit in the jitter buffer
+	int concealed; //!< frames synthesized for lost audio chunks and underruns
+	int buffered_ms; //!< current jitter buffer depth
+	int target_ms; //!< current jitter buffer target (including delay for A/V sync)
+	int latency_ms; //!< time from audio chunk arrival to playback
+	float av_offset_ms; //!< audio playback behind video presentation, negative if ahead, 0 if unknown
+};
+
+/**
+ * @brief Retrieve audio playback statistics.
+ *
+ * With unhvd_net_config::audio_timestamps and unhvd_net_config::timestamp_aux
+ * audio is delayed in the jitter buffer to match video presentation.
+ * The remaining offset (e.g. when video is presented before the audio could be) is reported in
+ * unhvd_audio_stats::av_offset_ms.
+ *
+ * @param u pointer to internal library data
+ * @param stats statistics to fill
+ * @return
+ * - UNHVD_OK on success
+ * - UNHVD_ERROR if audio is not enabled
+ */
+UNHVD_EXPORT int UNHVD_API unhvd_get_audio_stats(unhvd *u, unhvd_audio_stats *stats);
+
+/**
+ * @brief Select point cloud decimation.
+ *
+ * Reduces the number of points to upload and render.
+ * The change takes effect with the next unprojected frame.
+ * The number of removed points is reported in unhvd_point_cloud::decimated.
+ *
+ * @param u pointer to internal library data
+ * @param mode one of ::unhvd_decimation_mode
+ * @param stride pixel stride for UNHVD_DECIMATION_STRIDE
+ * @param voxel_size point spacing (in depth_unit result unit) for UNHVD_DECIMATION_DEPTH_ADAPTIVE and UNHVD_DECIMATION_VOXEL_GRID
+ * @return
+ * - UNHVD_OK on success
+ * - UNHVD_ERROR on invalid arguments or if depth unprojection is not enabled
+ */
+UNHVD_EXPORT int UNHVD_API unhvd_set_decimation(unhvd *u, int mode, int stride, float voxel_size);
+
+/**
+ * @brief Configure temporal depth filter.
+ *
+ * Reduces flickering of lossy encoded depth before unprojection.
+ * Depth is smoothed exponentially, differences above threshold are treated as motion and taken as they are.
+ * Holes (no depth) keep the last depth for up to persistence frames.
+ * The change takes effect with the next unprojected frame.
+ *
+ * @param u pointer to internal library data
+ * @param alpha weight of new depth in (0, 1], 1 for no smoothing, 0 disables the filter
+ * @param threshold depth difference (in depth_unit result unit) treated as motion
+ * @param persistence number of frames to fill holes with last depth (0 - 255)
+ * @return
+ * - UNHVD_OK on success
+ * - UNHVD_ERROR on invalid arguments or if depth unprojection is not enabled
+ */
+UNHVD_EXPORT int UNHVD_API unhvd_set_temporal_filter(unhvd *u, float alpha, float threshold, int persistence);
+
+/**
+ * @brief Configure spatial depth filter.
+ *
+ * Removes flying pixels between foreground and background at depth edges.
+ * Point is rejected if depth jump to any of 4 neighbours exceeds threshold * depth.
+ * Optionally depth is smoothed with neighbours closer than sigma (edge aware).
+ * Rejected points are not stored in point cloud.
+ * The change takes effect with the next unprojected frame.
+ *
+ * @param u pointer to internal library data
+ * @param threshold relative depth jump (e.g. 0.05), 0 disables rejection
+ * @param sigma smoothing depth range (in depth_unit result unit), 0 disables smoothing
+ * @return
+ * - UNHVD_OK on success
+ * - UNHVD_ERROR on invalid arguments or if depth unprojection is not enabled
+ */
+UNHVD_EXPORT int UNHVD_API unhvd_set_spatial_filter(unhvd *u, float threshold, float sigma);
+
+/**
+ * @brief Set sensor to world pose.
+ *
+ * Points are transformed to world coordinates during unprojection, in the same pass.
+ * The pose is used from the next unprojected frame until changed.
+ * Frames streamed with pose in unhvd_depth_config::pose_aux channel use their own pose.
+ *
+ * @param u pointer to internal library data
+ * @param pose 4x4 row major transform of unprojected points (last row ignored) or NULL for sensor coordinates
+ * @return
+ * - UNHVD_OK on success
+ * - UNHVD_ERROR if depth unprojection is not enabled
+ */
+UNHVD_EXPORT int UNHVD_API unhvd_set_pose(unhvd *u, const float *pose);
+
+/**
+ * @brief Request point cloud predicted from the last decoded frame.
+ *
+ * Intended to be called at display rate between decoded frames (e.g. 90 Hz display with 30 Hz depth).
+ * The unprojection thread extrapolates the last decoded frame by point velocities to seconds from now
+ * (no further than two decoded frame intervals) and optionally moves it by predicted sensor motion.
+ * The result is published as the next point cloud (with unhvd_point_cloud::predicted),
+ * retrieve it with ::unhvd_get_point_cloud_begin as usual. Newly decoded frame takes precedence.
+ *
+ * Requires unhvd_depth_config::predict.
+ *
+ * @param u pointer to internal library data
+ * @param pose NULL or 4x4 row major rigid predicted sensor pose relative to its pose at the last decoded frame,
+ *  points are expressed in predicted sensor frame (for point clouds in sensor coordinates)
+ * @param seconds prediction time after now (e.g. display latency)
+ * @return
+ * - UNHVD_OK on success
+ * - UNHVD_ERROR if prediction is not enabled
+ */
+UNHVD_EXPORT int UNHVD_API unhvd_predict(unhvd *u, const float *pose, float seconds);
+
+/**
+ * @brief Set depth image region of interest.
+ *
+ * Only the rectangle is unprojected, rows and tiles outside are skipped.
+ * Intended to be called per frame, the region is used from the next unprojected frame until changed.
+ * With organized point cloud points outside are at position 0.
+ *
+ * @param u pointer to internal library data
+ * @param x first column
+ * @param y first row
+ * @param width columns, 0 (with height 0) for whole image
+ * @param height rows
+ * @return
+ * - UNHVD_OK on success
+ * - UNHVD_ERROR on invalid arguments or if depth unprojection is not enabled
+ */
+UNHVD_EXPORT int UNHVD_API unhvd_set_roi(unhvd *u, int x, int y, int width, int height);
+
+/**
+ * @brief Set view frustum.
+ *
+ * Only points inside the frustum are unprojected, tiles entirely outside are skipped.
+ * Intended to be called per frame with headset view, used from the next unprojected frame until changed.
+ * The frustum is in world coordinates if pose is set (see ::unhvd_set_pose).
+ *
+ * @param u pointer to internal library data
+ * @param view_projection 4x4 row major view projection matrix (OpenGL clip space) or NULL to disable
+ * @return
+ * - UNHVD_OK on success
+ * - UNHVD_ERROR if depth unprojection is not enabled
+ */
+UNHVD_EXPORT int UNHVD_API unhvd_set_frustum(unhvd *u, const float *view_projection);
+
+/**
+ * @brief Learn static background model.
+ *
+ * Background depth is learned per pixel from the next frames (empty room or people moving through).
+ * Points near or behind the background are then not stored in point cloud,
+ * leaving just the dynamic foreground. The previous model (if any) is used until the new one is learned.
+ *
+ * @param u pointer to internal library data
+ * @param frames number of frames to learn from (1 - 15), 0 cancels learning
+ * @param mode unhvd_background_mode
+ * @return
+ * - UNHVD_OK on success
+ * - UNHVD_ERROR on invalid arguments or if depth unprojection is not enabled
+ */
+UNHVD_EXPORT int UNHVD_API unhvd_background_learn(unhvd *u, int frames, int mode);
+
+/**
+ * @brief Set background suppression margin.
+ *
+ * The change takes effect with the next unprojected frame.
+ *
+ * @param u pointer to internal library data
+ * @param threshold margin in front of background (in depth_unit result unit) treated as background, 0 disables suppression
+ * @return
+ * - UNHVD_OK on success
+ * - UNHVD_ERROR on invalid arguments or if depth unprojection is not enabled
+ */
+UNHVD_EXPORT int UNHVD_API unhvd_set_background(unhvd *u, float threshold);
+
+/**
+ * @brief Save learned background model.
+ *
+ * With multiple cameras model of camera i > 0 is saved with .i suffix appended to file.
+ *
+ * @param u pointer to internal library data
+ * @param file path of model file
+ * @return
+ * - UNHVD_OK on success
+ * - UNHVD_ERROR on failure, if there is no model or depth unprojection is not enabled
+ */
+UNHVD_EXPORT int UNHVD_API unhvd_background_save(unhvd *u, const char *file);
+
+/**
+ * @brief Load background model.
+ *
+ * The model is used for the depth resolution it was learned for.
+ * With multiple cameras model of camera i > 0 is loaded with .i suffix appended to file.
+ *
+ * @param u pointer to internal library data
+ * @param file path of model file saved with unhvd_background_save
+ * @return
+ * - UNHVD_OK on success
+ * - UNHVD_ERROR on failure or if depth unprojection is not enabled
+ */
+UNHVD_EXPORT int UNHVD_API unhvd_background_load(unhvd *u, const char *file);
+
+/**
+ * @brief Cast ray against the last unprojected point cloud.
+ *
+ * Requires unhvd_depth_config::index_cell_size. The spatial index is rebuilt
+ * by the unprojection thread after each frame, queries are thread-safe
+ * and take microseconds. Positions are in the point cloud (pose) frame.
+ *
+ * @param u pointer to internal library data
+ * @param origin ray origin (3 floats)
+ * @param direction ray direction (3 floats), doesn't have to be normalized
+ * @param max_distance max distance along the ray
+ * @param radius max distance of point from the ray, at most index_cell_size
+ * @param point first point hit (3 floats), may be NULL
+ * @param distance distance along the ray to the point hit, may be NULL
+ * @return
+ * - 1 on hit
+ * - 0 if there is no hit
+ * - UNHVD_ERROR on invalid arguments or if spatial index is not enabled
+ */
+UNHVD_EXPORT int UNHVD_API unhvd_raycast(unhvd *u, const float *origin, const float *direction, float max_distance, float radius,
+	float *point, float *distance);
+
+/**
+ * @brief Find nearest points of the last unprojected point cloud.
+ *
+ * Requires unhvd_depth_config::index_cell_size, see ::unhvd_raycast.
+ *
+ * @param u pointer to internal library data
+ * @param point query position (3 floats)
+ * @param k max number of points (at most UNHVD_NEAREST_MAX_K)
+ * @param max_distance max distance from query position (finite, search is also limited to indexed points bounds)
+ * @param points nearest first positions (3 floats per point), may be NULL
+ * @param distances nearest first distances, may be NULL
+ * @return
+ * - number of points found on success
+ * - UNHVD_ERROR on invalid arguments or if spatial index is not enabled
+ */
+UNHVD_EXPORT int UNHVD_API unhvd_nearest(unhvd *u, const float *point, int k, float max_distance, float *points, float *distances);
+
 /** @}*/
 }
 